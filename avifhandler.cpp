@@ -1,10 +1,198 @@
 #include "avifhandler.h"
+#include "bufferpool.h"
+#include "pixelformat.h"
+#include "tracer.h"
 
 #include <QFile>
 #include <QDebug>
 
 #ifdef HAVE_LIBAVIF
 #include <avif/avif.h>
+
+namespace {
+
+// Convert a decoded libavif image to an 8-bit RGBA QImage (RGBX when it has no alpha)
+bool toQImage(const avifImage* yuv, QImage& image, QString& errorMessage)
+{
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, yuv);
+    rgb.format = AVIF_RGB_FORMAT_RGBA;
+    rgb.depth = 8;
+
+    // Convert straight into the QImage; without an alpha plane libavif writes opaque alpha
+    image = BufferPool::createImage(static_cast<int>(yuv->width), static_cast<int>(yuv->height),
+                                    yuv->alphaPlane ? QImage::Format_RGBA8888 : QImage::Format_RGBX8888);
+    if (image.isNull()) {
+        errorMessage = "Failed to allocate image";
+        return false;
+    }
+    rgb.pixels = image.bits();
+    rgb.rowBytes = static_cast<uint32_t>(image.bytesPerLine());
+
+    avifResult result = avifImageYUVToRGB(yuv, &rgb);
+    if (result != AVIF_RESULT_OK) {
+        errorMessage = QString("Failed to convert to RGB: %1").arg(avifResultToString(result));
+        image = QImage();
+        return false;
+    }
+    return true;
+}
+
+// Convert a QImage to a libavif image in a resolved layout; nullptr on failure
+avifImage* createYuvImage(const QImage& image, const YuvFormat& layout, QString& errorMessage)
+{
+    avifPixelFormat pixelFormat = AVIF_PIXEL_FORMAT_YUV444;
+    switch (layout.chroma) {
+        case ChromaSubsampling::YUV420: pixelFormat = AVIF_PIXEL_FORMAT_YUV420; break;
+        case ChromaSubsampling::YUV422: pixelFormat = AVIF_PIXEL_FORMAT_YUV422; break;
+        default: break;
+    }
+
+    // libavif reads the common RGB(A) byte orders as they are; 16 bits per channel feed deeper YUV
+    const bool wide = layout.bitDepth > 8;
+    const QImage rgbaImage = PixelFormat::negotiate(image, AvifHandler::writeFormats(wide),
+                                                    wide ? QImage::Format_RGBA64 : QImage::Format_RGBA8888);
+
+    // Create AVIF image
+    avifImage* avifImg = avifImageCreate(rgbaImage.width(), rgbaImage.height(), layout.bitDepth, pixelFormat);
+    if (!avifImg) {
+        errorMessage = "Failed to create AVIF image";
+        return nullptr;
+    }
+
+    // Create RGB image for conversion
+    avifRGBImage rgb;
+    avifRGBImageSetDefaults(&rgb, avifImg);
+    switch (rgbaImage.format()) {
+        case QImage::Format_RGB888:
+            rgb.format = AVIF_RGB_FORMAT_RGB;
+            break;
+        case QImage::Format_ARGB32:
+        case QImage::Format_RGB32:
+            // 0xAARRGGBB words
+            rgb.format = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? AVIF_RGB_FORMAT_BGRA : AVIF_RGB_FORMAT_ARGB;
+            break;
+        default:
+            rgb.format = AVIF_RGB_FORMAT_RGBA;
+            break;
+    }
+#if AVIF_VERSION >= 90100
+    // Padding bytes of opaque layouts must not become an alpha plane
+    rgb.ignoreAlpha = rgbaImage.hasAlphaChannel() ? AVIF_FALSE : AVIF_TRUE;
+#endif
+    rgb.depth = wide ? 16 : 8;
+    rgb.pixels = const_cast<uint8_t*>(rgbaImage.constBits());
+    rgb.rowBytes = static_cast<uint32_t>(rgbaImage.bytesPerLine());
+
+    // Convert RGB to YUV
+    avifResult result = avifImageRGBToYUV(avifImg, &rgb);
+    if (result != AVIF_RESULT_OK) {
+        errorMessage = QString("Failed to convert to YUV: %1").arg(avifResultToString(result));
+        avifImageDestroy(avifImg);
+        return nullptr;
+    }
+    return avifImg;
+}
+
+// Encoder with the quality settings shared by still and animated output
+avifEncoder* createEncoder(int quality)
+{
+    avifEncoder* encoder = avifEncoderCreate();
+    if (!encoder) {
+        return nullptr;
+    }
+
+    // Set quality (convert 0-100 to AVIF's 0-63 quantizer, where 0 is best quality)
+    int q = quality > 0 ? quality : 80;
+    encoder->quality = q;
+    encoder->qualityAlpha = q;
+    encoder->speed = AVIF_SPEED_DEFAULT;
+    return encoder;
+}
+
+class AvifSequenceReader : public FrameReader
+{
+public:
+    explicit AvifSequenceReader(avifDecoder* decoder) : m_decoder(decoder) {}
+    ~AvifSequenceReader() override { avifDecoderDestroy(m_decoder); }
+
+    int frameCount() const override { return m_decoder->imageCount; }
+
+    int loopCount() const override
+    {
+#if AVIF_VERSION_MAJOR >= 1
+        return m_decoder->repetitionCount;
+#else
+        return -1;
+#endif
+    }
+
+    bool readFrame(Frame& frame, QString& errorMessage) override
+    {
+        TraceSpan span("AvifHandler::readFrame", "codec");
+
+        avifResult result = avifDecoderNextImage(m_decoder);
+        if (result == AVIF_RESULT_NO_IMAGES_REMAINING) {
+            return false;
+        }
+        if (result != AVIF_RESULT_OK) {
+            errorMessage = QString("Failed to decode AVIF frame: %1").arg(avifResultToString(result));
+            return false;
+        }
+        frame.durationMs = static_cast<int>(m_decoder->imageTiming.duration * 1000.0 + 0.5);
+        return toQImage(m_decoder->image, frame.image, errorMessage);
+    }
+
+private:
+    avifDecoder* m_decoder;
+};
+
+class AvifSequenceWriter : public FrameWriter
+{
+public:
+    AvifSequenceWriter(avifEncoder* encoder, const YuvFormat& layout)
+        : m_encoder(encoder), m_layout(layout) {}
+    ~AvifSequenceWriter() override { avifEncoderDestroy(m_encoder); }
+
+    bool addFrame(const Frame& frame, QString& errorMessage) override
+    {
+        TraceSpan span("AvifHandler::writeFrame", "codec");
+
+        avifImage* yuv = createYuvImage(frame.image, m_layout, errorMessage);
+        if (!yuv) {
+            return false;
+        }
+        // The encoder compresses the frame now and keeps only the result
+        const int durationMs = frame.durationMs > 0 ? frame.durationMs : DEFAULT_FRAME_MS;
+        avifResult result = avifEncoderAddImage(m_encoder, yuv, static_cast<uint64_t>(durationMs),
+                                                AVIF_ADD_IMAGE_FLAG_NONE);
+        avifImageDestroy(yuv);
+        if (result != AVIF_RESULT_OK) {
+            errorMessage = QString("Failed to encode AVIF frame: %1").arg(avifResultToString(result));
+            return false;
+        }
+        return true;
+    }
+
+    bool finish(QByteArray& output, QString& errorMessage) override
+    {
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifResult result = avifEncoderFinish(m_encoder, &encoded);
+        if (result != AVIF_RESULT_OK) {
+            errorMessage = QString("Failed to finish AVIF sequence: %1").arg(avifResultToString(result));
+            return false;
+        }
+        output = QByteArray(reinterpret_cast<const char*>(encoded.data), static_cast<int>(encoded.size));
+        avifRWDataFree(&encoded);
+        return true;
+    }
+
+private:
+    avifEncoder* m_encoder;
+    YuvFormat m_layout;
+};
+
+} // namespace
 #endif
 
 AvifHandler::AvifHandler()
@@ -36,6 +224,20 @@ bool AvifHandler::read(const QString& filePath, QImage& image, QString& errorMes
     QByteArray fileData = file.readAll();
     file.close();
 
+    return readData(fileData, image, errorMessage);
+#else
+    errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
+    Q_UNUSED(filePath);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool AvifHandler::readData(const QByteArray& data, QImage& image, QString& errorMessage)
+{
+    TraceSpan span("AvifHandler::read", "codec");
+
+#ifdef HAVE_LIBAVIF
     // Create decoder
     avifDecoder* decoder = avifDecoderCreate();
     if (!decoder) {
@@ -45,8 +247,8 @@ bool AvifHandler::read(const QString& filePath, QImage& image, QString& errorMes
 
     // Parse the file
     avifResult result = avifDecoderSetIOMemory(decoder,
-        reinterpret_cast<const uint8_t*>(fileData.constData()),
-        fileData.size());
+        reinterpret_cast<const uint8_t*>(data.constData()),
+        data.size());
     if (result != AVIF_RESULT_OK) {
         errorMessage = QString("Failed to set decoder input: %1").arg(avifResultToString(result));
         avifDecoderDestroy(decoder);
@@ -69,124 +271,178 @@ bool AvifHandler::read(const QString& filePath, QImage& image, QString& errorMes
     }
 
     // Convert to RGBA
-    avifRGBImage rgb;
-    avifRGBImageSetDefaults(&rgb, decoder->image);
-    rgb.format = AVIF_RGB_FORMAT_RGBA;
-    rgb.depth = 8;
+    bool ok = toQImage(decoder->image, image, errorMessage);
 
-    avifRGBImageAllocatePixels(&rgb);
-    result = avifImageYUVToRGB(decoder->image, &rgb);
-    if (result != AVIF_RESULT_OK) {
-        errorMessage = QString("Failed to convert to RGB: %1").arg(avifResultToString(result));
-        avifRGBImageFreePixels(&rgb);
-        avifDecoderDestroy(decoder);
+    // Cleanup
+    avifDecoderDestroy(decoder);
+
+    return ok;
+#else
+    errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool AvifHandler::write(const QString& filePath, const QImage& image, int quality, QString& errorMessage)
+{
+#ifdef HAVE_LIBAVIF
+    QByteArray output;
+    if (!writeData(image, quality, output, errorMessage)) {
         return false;
     }
 
-    // Create QImage
-    image = QImage(rgb.width, rgb.height, QImage::Format_RGBA8888);
-    for (uint32_t y = 0; y < rgb.height; ++y) {
-        memcpy(image.scanLine(y), rgb.pixels + y * rgb.rowBytes, rgb.width * 4);
+    // Write to file
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = "Failed to open file for writing";
+        return false;
     }
 
-    // Cleanup
-    avifRGBImageFreePixels(&rgb);
-    avifDecoderDestroy(decoder);
+    qint64 written = file.write(output);
+    file.close();
+
+    if (written != output.size()) {
+        errorMessage = "Failed to write complete file";
+        return false;
+    }
 
     return true;
 #else
     errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
     Q_UNUSED(filePath);
     Q_UNUSED(image);
+    Q_UNUSED(quality);
     return false;
 #endif
 }
 
-bool AvifHandler::write(const QString& filePath, const QImage& image, int quality, QString& errorMessage)
+bool AvifHandler::writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage)
 {
-#ifdef HAVE_LIBAVIF
-    // Convert image to RGBA format if needed
-    QImage rgbaImage = image.convertToFormat(QImage::Format_RGBA8888);
+    return writeData(image, quality, YuvFormat(), output, errorMessage);
+}
 
-    // Create AVIF image
-    avifImage* avifImg = avifImageCreate(rgbaImage.width(), rgbaImage.height(), 8, AVIF_PIXEL_FORMAT_YUV444);
+bool AvifHandler::writeData(const QImage& image, int quality, const YuvFormat& yuv,
+                            QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("AvifHandler::write", "codec");
+
+#ifdef HAVE_LIBAVIF
+    avifImage* avifImg = createYuvImage(image, yuv.resolved(image), errorMessage);
     if (!avifImg) {
-        errorMessage = "Failed to create AVIF image";
         return false;
     }
 
-    // Create RGB image for conversion
-    avifRGBImage rgb;
-    avifRGBImageSetDefaults(&rgb, avifImg);
-    rgb.format = AVIF_RGB_FORMAT_RGBA;
-    rgb.depth = 8;
-    rgb.pixels = const_cast<uint8_t*>(rgbaImage.bits());
-    rgb.rowBytes = rgbaImage.bytesPerLine();
-
-    // Convert RGB to YUV
-    avifResult result = avifImageRGBToYUV(avifImg, &rgb);
-    if (result != AVIF_RESULT_OK) {
-        errorMessage = QString("Failed to convert to YUV: %1").arg(avifResultToString(result));
-        avifImageDestroy(avifImg);
-        return false;
-    }
+    bool ok = writeYuv(avifImg, quality, output, errorMessage);
+    avifImageDestroy(avifImg);
+    return ok;
+#else
+    errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
+    Q_UNUSED(image);
+    Q_UNUSED(quality);
+    Q_UNUSED(yuv);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
 
+bool AvifHandler::writeYuv(const avifImage* image, int quality, QByteArray& output, QString& errorMessage)
+{
+#ifdef HAVE_LIBAVIF
     // Create encoder
-    avifEncoder* encoder = avifEncoderCreate();
+    avifEncoder* encoder = createEncoder(quality);
     if (!encoder) {
         errorMessage = "Failed to create AVIF encoder";
-        avifImageDestroy(avifImg);
         return false;
     }
 
-    // Set quality (convert 0-100 to AVIF's 0-63 quantizer, where 0 is best quality)
-    int q = quality > 0 ? quality : 80;
-    encoder->quality = q;
-    encoder->qualityAlpha = q;
-    encoder->speed = AVIF_SPEED_DEFAULT;
-
     // Encode
-    avifRWData output = AVIF_DATA_EMPTY;
-    result = avifEncoderWrite(encoder, avifImg, &output);
+    avifRWData encoded = AVIF_DATA_EMPTY;
+    avifResult result = avifEncoderWrite(encoder, image, &encoded);
     if (result != AVIF_RESULT_OK) {
         errorMessage = QString("Failed to encode AVIF: %1").arg(avifResultToString(result));
         avifEncoderDestroy(encoder);
-        avifImageDestroy(avifImg);
         return false;
     }
 
-    // Write to file
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        errorMessage = "Failed to open file for writing";
-        avifRWDataFree(&output);
-        avifEncoderDestroy(encoder);
-        avifImageDestroy(avifImg);
-        return false;
-    }
-
-    qint64 written = file.write(reinterpret_cast<const char*>(output.data), output.size);
-    file.close();
-
-    if (written != static_cast<qint64>(output.size)) {
-        errorMessage = "Failed to write complete file";
-        avifRWDataFree(&output);
-        avifEncoderDestroy(encoder);
-        avifImageDestroy(avifImg);
-        return false;
-    }
+    // Copy into the output buffer
+    output = QByteArray(reinterpret_cast<const char*>(encoded.data), static_cast<int>(encoded.size));
 
     // Cleanup
-    avifRWDataFree(&output);
+    avifRWDataFree(&encoded);
     avifEncoderDestroy(encoder);
-    avifImageDestroy(avifImg);
 
     return true;
 #else
     errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
-    Q_UNUSED(filePath);
     Q_UNUSED(image);
     Q_UNUSED(quality);
+    Q_UNUSED(output);
     return false;
 #endif
 }
+
+QVector<QImage::Format> AvifHandler::writeFormats(bool wide)
+{
+    if (wide) {
+        return {QImage::Format_RGBA64, QImage::Format_RGBX64};
+    }
+    // Opaque images converted anyway go to packed RGB, which carries no alpha plane
+    return {QImage::Format_RGBA8888, QImage::Format_RGB888, QImage::Format_RGBX8888,
+            QImage::Format_ARGB32, QImage::Format_RGB32};
+}
+
+std::unique_ptr<FrameReader> AvifHandler::createSequenceReader(const QByteArray& data, QString& errorMessage)
+{
+#ifdef HAVE_LIBAVIF
+    avifDecoder* decoder = avifDecoderCreate();
+    if (!decoder) {
+        errorMessage = "Failed to create AVIF decoder";
+        return nullptr;
+    }
+
+    avifResult result = avifDecoderSetIOMemory(decoder,
+        reinterpret_cast<const uint8_t*>(data.constData()),
+        data.size());
+    if (result == AVIF_RESULT_OK) {
+        result = avifDecoderParse(decoder);
+    }
+    if (result != AVIF_RESULT_OK) {
+        errorMessage = QString("Failed to parse AVIF: %1").arg(avifResultToString(result));
+        avifDecoderDestroy(decoder);
+        return nullptr;
+    }
+    return std::unique_ptr<FrameReader>(new AvifSequenceReader(decoder));
+#else
+    errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
+    Q_UNUSED(data);
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<FrameWriter> AvifHandler::createSequenceWriter(int quality, const YuvFormat& yuv, int loopCount,
+                                                               QString& errorMessage)
+{
+#ifdef HAVE_LIBAVIF
+    avifEncoder* encoder = createEncoder(quality);
+    if (!encoder) {
+        errorMessage = "Failed to create AVIF encoder";
+        return nullptr;
+    }
+    // Frame durations are given in milliseconds
+    encoder->timescale = 1000;
+#if AVIF_VERSION_MAJOR >= 1
+    encoder->repetitionCount = loopCount < 0 ? AVIF_REPETITION_COUNT_INFINITE : loopCount;
+#else
+    Q_UNUSED(loopCount);
+#endif
+    return std::unique_ptr<FrameWriter>(new AvifSequenceWriter(encoder, yuv));
+#else
+    errorMessage = "AVIF support not compiled. Install libavif and rebuild with HAVE_LIBAVIF defined.";
+    Q_UNUSED(quality);
+    Q_UNUSED(yuv);
+    Q_UNUSED(loopCount);
+    return nullptr;
+#endif
+}
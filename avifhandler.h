@@ -3,6 +3,12 @@
 
 #include <QImage>
 #include <QString>
+#include <QVector>
+#include <memory>
+#include "framestream.h"
+#include "yuvformat.h"
+
+struct avifImage;
 
 /**
  * @brief Handler for AVIF image format using libavif
@@ -31,6 +37,15 @@ public:
      */
     static bool read(const QString& filePath, QImage& image, QString& errorMessage);
 
+    /**
+     * @brief Decode an AVIF image held in memory
+     * @param data Encoded file contents
+     * @param image Output QImage: RGBA8888 if the image has alpha, RGBX8888 otherwise
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool readData(const QByteArray& data, QImage& image, QString& errorMessage);
+
     /**
      * @brief Write a QImage to AVIF format
      * @param filePath Path to the output file
@@ -40,6 +55,63 @@ public:
      * @return true if successful, false otherwise
      */
     static bool write(const QString& filePath, const QImage& image, int quality, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to AVIF in memory
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 80)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to AVIF in memory with a chosen YUV layout
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 80)
+     * @param yuv Chroma subsampling and bit depth (Auto is resolved from the image)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, const YuvFormat& yuv,
+                          QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     * @param wide true for output above 8 bits per channel
+     */
+    static QVector<QImage::Format> writeFormats(bool wide);
+
+    /**
+     * @brief Encode an image already in libavif's YUV layout
+     * @param image The libavif image to encode (not taken over)
+     * @param quality Quality setting (0-100, default 80)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeYuv(const avifImage* image, int quality, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Open an AVIF file (still image or sequence) for frame-by-frame decoding
+     * @param data Encoded file contents; must outlive the reader
+     * @param errorMessage Output error message if parsing fails
+     * @return The reader, or nullptr on failure
+     */
+    static std::unique_ptr<FrameReader> createSequenceReader(const QByteArray& data, QString& errorMessage);
+
+    /**
+     * @brief Create an animated AVIF encoder fed one frame at a time
+     * @param quality Quality setting (0-100, default 80)
+     * @param yuv Chroma subsampling and bit depth; must already be resolved
+     * @param loopCount Animation repeats (-1 forever)
+     * @param errorMessage Output error message if the encoder cannot be created
+     * @return The writer, or nullptr on failure
+     */
+    static std::unique_ptr<FrameWriter> createSequenceWriter(int quality, const YuvFormat& yuv, int loopCount,
+                                                             QString& errorMessage);
 };
 
 #endif // AVIFHANDLER_H
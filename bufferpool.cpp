@@ -0,0 +1,182 @@
+#include "bufferpool.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPixelFormat>
+#include <QVector>
+
+#include <climits>
+
+namespace {
+
+// Touching one byte per page faults the whole buffer in
+const qint64 PAGE_BYTES = 4096;
+
+// Header in front of every pooled buffer; its size keeps the pixels aligned
+struct Block {
+    qint64 capacity;    // Usable bytes after the header
+    int sizeClass;
+};
+const qint64 HEADER_BYTES = 64;
+
+uchar* pixelsOf(Block* block)
+{
+    return reinterpret_cast<uchar*>(block) + HEADER_BYTES;
+}
+
+// Quarter-octave classes: 2^k, 1.25 * 2^k, 1.5 * 2^k and 1.75 * 2^k, so a
+// buffer wastes less than a quarter of its size
+int sizeClassFor(qint64 bytes, qint64& classBytes)
+{
+    int octave = 0;
+    while ((Q_INT64_C(2) << octave) <= bytes) {
+        ++octave;
+    }
+    const qint64 base = Q_INT64_C(1) << octave;
+    const qint64 step = base / 4;
+    int quarter = static_cast<int>((bytes - base + step - 1) / step);
+    if (quarter == 4) {
+        ++octave;
+        quarter = 0;
+        classBytes = base * 2;
+    } else {
+        classBytes = base + quarter * step;
+    }
+    return octave * 4 + quarter;
+}
+
+struct Pool {
+    QMutex mutex;
+    QHash<int, QVector<Block*>> idle;
+    qint64 idleBytes = 0;
+    qint64 capacity = BufferPool::DEFAULT_CAPACITY;
+    BufferPool::Statistics statistics;
+};
+
+// Never destroyed: images released during static destruction still return their buffers
+Pool& pool()
+{
+    static Pool* instance = new Pool;
+    return *instance;
+}
+
+Block* allocateBlock(qint64 capacity, int sizeClass)
+{
+    void* memory = qMallocAligned(static_cast<size_t>(HEADER_BYTES + capacity), HEADER_BYTES);
+    if (!memory) {
+        return nullptr;
+    }
+    Block* block = static_cast<Block*>(memory);
+    block->capacity = capacity;
+    block->sizeClass = sizeClass;
+
+    // Fault every page in now, once, instead of on first touch in every decode
+    uchar* pixels = pixelsOf(block);
+    for (qint64 offset = 0; offset < capacity; offset += PAGE_BYTES) {
+        pixels[offset] = 0;
+    }
+    return block;
+}
+
+Block* acquire(qint64 bytes)
+{
+    qint64 classBytes = 0;
+    const int sizeClass = sizeClassFor(bytes, classBytes);
+    Pool& p = pool();
+    {
+        QMutexLocker locker(&p.mutex);
+        QVector<Block*>& blocks = p.idle[sizeClass];
+        if (!blocks.isEmpty()) {
+            Block* block = blocks.takeLast();
+            p.idleBytes -= block->capacity;
+            ++p.statistics.reused;
+            return block;
+        }
+        ++p.statistics.allocated;
+    }
+    return allocateBlock(classBytes, sizeClass);
+}
+
+// QImage cleanup callback: keep the buffer for the next image, or free it past the cap
+void release(void* info)
+{
+    Block* block = static_cast<Block*>(info);
+    Pool& p = pool();
+    {
+        QMutexLocker locker(&p.mutex);
+        if (p.idleBytes + block->capacity <= p.capacity) {
+            p.idle[block->sizeClass].append(block);
+            p.idleBytes += block->capacity;
+            return;
+        }
+    }
+    qFreeAligned(block);
+}
+
+} // namespace
+
+QImage BufferPool::createImage(const QSize& size, QImage::Format format)
+{
+    return createImage(size.width(), size.height(), format);
+}
+
+QImage BufferPool::createImage(int width, int height, QImage::Format format)
+{
+    if (width <= 0 || height <= 0 || format == QImage::Format_Invalid) {
+        return QImage();
+    }
+
+    // Scanlines padded to 32 bits, as QImage lays out its own
+    const qint64 depth = QImage::toPixelFormat(format).bitsPerPixel();
+    const qint64 bytesPerLine = (width * depth + 31) / 32 * 4;
+    const qint64 bytes = bytesPerLine * height;
+    if (bytes < MIN_POOLED_BYTES || bytesPerLine > INT_MAX || capacity() <= 0) {
+        return QImage(width, height, format);
+    }
+
+    Block* block = acquire(bytes);
+    if (!block) {
+        return QImage();
+    }
+    return QImage(pixelsOf(block), width, height, static_cast<int>(bytesPerLine), format, release, block);
+}
+
+void BufferPool::setCapacity(qint64 bytes)
+{
+    {
+        QMutexLocker locker(&pool().mutex);
+        pool().capacity = qMax<qint64>(0, bytes);
+    }
+    trim();
+}
+
+qint64 BufferPool::capacity()
+{
+    QMutexLocker locker(&pool().mutex);
+    return pool().capacity;
+}
+
+void BufferPool::trim()
+{
+    QVector<Block*> freed;
+    {
+        QMutexLocker locker(&pool().mutex);
+        for (const QVector<Block*>& blocks : pool().idle) {
+            freed += blocks;
+        }
+        pool().idle.clear();
+        pool().idleBytes = 0;
+    }
+    for (Block* block : freed) {
+        qFreeAligned(block);
+    }
+}
+
+BufferPool::Statistics BufferPool::statistics()
+{
+    QMutexLocker locker(&pool().mutex);
+    Statistics statistics = pool().statistics;
+    statistics.idleBytes = pool().idleBytes;
+    return statistics;
+}
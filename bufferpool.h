@@ -0,0 +1,62 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QImage>
+#include <QSize>
+#include <QtGlobal>
+
+/**
+ * @brief Size-classed pool of large image buffers shared by the codec handlers
+ *
+ * Decoding a large image allocates buffers of tens or hundreds of megabytes.
+ * Handed back to the system, each one is a fresh mapping whose pages fault
+ * in again on first touch in the next file. The pool instead keeps released
+ * buffers, already faulted in, in size classes a quarter octave apart, so the
+ * next image of similar size reuses one without a system call or page fault.
+ *
+ * Idle buffers are capped in total; buffers released past the cap are freed.
+ * Images below MIN_POOLED_BYTES come from the regular allocator.
+ */
+class BufferPool
+{
+public:
+    // Smallest pixel buffer worth pooling; malloc recycles smaller ones itself
+    static const qint64 MIN_POOLED_BYTES = 1024 * 1024;
+
+    // Default cap on the memory held by idle buffers
+    static const qint64 DEFAULT_CAPACITY = 512 * 1024 * 1024;
+
+    struct Statistics {
+        qint64 reused = 0;      // Buffers served from the pool
+        qint64 allocated = 0;   // Buffers allocated and pre-faulted fresh
+        qint64 idleBytes = 0;   // Memory currently held by idle buffers
+    };
+
+    /**
+     * @brief Create an uninitialized image over a pooled buffer
+     *
+     * The buffer returns to the pool when the last copy of the image is
+     * destroyed. Writing to the image does not detach it while unshared.
+     *
+     * @param size Image size in pixels
+     * @param format Pixel format
+     * @return The image, or a null image if allocation fails
+     */
+    static QImage createImage(const QSize& size, QImage::Format format);
+    static QImage createImage(int width, int height, QImage::Format format);
+
+    /**
+     * @brief Set the cap on idle pooled memory (0 disables pooling)
+     */
+    static void setCapacity(qint64 bytes);
+    static qint64 capacity();
+
+    /**
+     * @brief Free every idle buffer
+     */
+    static void trim();
+
+    static Statistics statistics();
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,372 @@
+#include "contentindex.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const int CHUNK_BYTES = 1024 * 1024;
+
+const quint64 PRIME1 = Q_UINT64_C(0x9E3779B185EBCA87);
+const quint64 PRIME2 = Q_UINT64_C(0xC2B2AE3D27D4EB4F);
+const quint64 PRIME3 = Q_UINT64_C(0x165667B19E3779F9);
+const quint64 PRIME4 = Q_UINT64_C(0x85EBCA77C2B2AE63);
+const quint64 PRIME5 = Q_UINT64_C(0x27D4EB2F165667C5);
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 mixLane(quint64 lane, quint64 input)
+{
+    lane += input * PRIME2;
+    return rotateLeft(lane, 31) * PRIME1;
+}
+
+inline quint64 mergeLane(quint64 hash, quint64 lane)
+{
+    hash ^= mixLane(0, lane);
+    return hash * PRIME1 + PRIME4;
+}
+
+// Streaming XXH64 with seed 0: four independent lanes over 32-byte stripes
+class Xxh64
+{
+public:
+    void update(const uchar* data, qint64 length)
+    {
+        m_length += static_cast<quint64>(length);
+        if (m_buffered + length < 32) {
+            std::memcpy(m_buffer + m_buffered, data, static_cast<size_t>(length));
+            m_buffered += static_cast<int>(length);
+            return;
+        }
+        if (m_buffered > 0) {
+            const int fill = 32 - m_buffered;
+            std::memcpy(m_buffer + m_buffered, data, static_cast<size_t>(fill));
+            consumeStripe(m_buffer);
+            data += fill;
+            length -= fill;
+            m_buffered = 0;
+        }
+        for (; length >= 32; data += 32, length -= 32) {
+            consumeStripe(data);
+        }
+        std::memcpy(m_buffer, data, static_cast<size_t>(length));
+        m_buffered = static_cast<int>(length);
+    }
+
+    quint64 digest() const
+    {
+        quint64 hash;
+        if (m_length >= 32) {
+            hash = rotateLeft(m_lanes[0], 1) + rotateLeft(m_lanes[1], 7) +
+                   rotateLeft(m_lanes[2], 12) + rotateLeft(m_lanes[3], 18);
+            for (quint64 lane : m_lanes) {
+                hash = mergeLane(hash, lane);
+            }
+        } else {
+            hash = PRIME5;
+        }
+        hash += m_length;
+
+        const uchar* tail = m_buffer;
+        int remaining = m_buffered;
+        for (; remaining >= 8; tail += 8, remaining -= 8) {
+            hash ^= mixLane(0, qFromLittleEndian<quint64>(tail));
+            hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+        }
+        if (remaining >= 4) {
+            hash ^= static_cast<quint64>(qFromLittleEndian<quint32>(tail)) * PRIME1;
+            hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+            tail += 4;
+            remaining -= 4;
+        }
+        for (; remaining > 0; ++tail, --remaining) {
+            hash ^= *tail * PRIME5;
+            hash = rotateLeft(hash, 11) * PRIME1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+private:
+    void consumeStripe(const uchar* stripe)
+    {
+        for (int i = 0; i < 4; ++i) {
+            m_lanes[i] = mixLane(m_lanes[i], qFromLittleEndian<quint64>(stripe + i * 8));
+        }
+    }
+
+    quint64 m_lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+    uchar m_buffer[32];
+    int m_buffered = 0;
+    quint64 m_length = 0;
+};
+
+// Byte-for-byte comparison, guarding against hash collisions
+bool sameContent(const QString& firstPath, const QString& secondPath)
+{
+    QFile first(firstPath);
+    QFile second(secondPath);
+    if (!first.open(QIODevice::ReadOnly) || !second.open(QIODevice::ReadOnly) ||
+        first.size() != second.size()) {
+        return false;
+    }
+    for (;;) {
+        const QByteArray a = first.read(CHUNK_BYTES);
+        const QByteArray b = second.read(CHUNK_BYTES);
+        if (a != b) {
+            return false;
+        }
+        if (a.isEmpty()) {
+            return true;
+        }
+    }
+}
+
+} // namespace
+
+ContentIndex::ContentIndex()
+    : m_generation(0)
+    , m_stopped(false)
+{
+    // Two readers keep the disk busy without starving the conversions
+    m_pool.setMaxThreadCount(2);
+}
+
+ContentIndex::~ContentIndex()
+{
+    stop();
+}
+
+void ContentIndex::add(const QStringList& files)
+{
+    // Stat before taking the lock; on a network share each one is a round trip
+    QVector<qint64> sizes;
+    sizes.reserve(files.size());
+    for (const QString& file : files) {
+        const QFileInfo info(file);
+        sizes.append(info.isFile() ? info.size() : -1);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < files.size(); ++i) {
+        const QString& file = files.at(i);
+        if (m_entries.contains(file)) {
+            continue;
+        }
+        Entry entry;
+        entry.size = sizes.at(i);
+        entry.generation = ++m_generation;
+        m_entries.insert(file, entry);
+        if (entry.size < 0) {
+            continue;
+        }
+
+        // A shared size is the first sign of a duplicate; hash the whole group
+        QStringList& sameSize = m_sizes[entry.size];
+        sameSize.append(file);
+        if (sameSize.size() > 1) {
+            for (const QString& other : sameSize) {
+                startHashing(other);
+            }
+        }
+    }
+}
+
+QString ContentIndex::claim(const QString& file, ConversionResult& original)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Queued again after a rewrite: let the earlier claim complete, then
+    // start over from a fresh stat so the old content answers for nothing
+    if (m_entries.value(file).claimed) {
+        while (!m_entries.value(file).done) {
+            m_changed.wait(&m_mutex);
+        }
+        forget(file);
+    }
+    if (!m_entries.contains(file)) {
+        locker.unlock();
+        add(QStringList(file));
+        locker.relock();
+    }
+    m_entries[file].claimed = true;
+
+    // Unreadable files convert (and fail) on their own
+    const qint64 size = m_entries.value(file).size;
+    if (size < 0) {
+        return QString();
+    }
+
+    // Claimed inputs are only ever appended, so each pass checks the ones
+    // claimed since the last, until none have been added while comparing
+    int checked = 0;
+    for (;;) {
+        const QVector<First> firsts = m_firsts.value(size);
+        if (checked == firsts.size()) {
+            m_firsts[size].append({file, m_entries.value(file).generation});
+            return QString();
+        }
+        const QVector<First> candidates = firsts.mid(checked);
+        checked = firsts.size();
+
+        while (!hashesReady(file, candidates)) {
+            m_changed.wait(&m_mutex);
+        }
+        const Entry entry = m_entries.value(file);
+        if (!entry.hashed) {
+            return QString();
+        }
+        QVector<First> matches;
+        for (const First& first : candidates) {
+            const Entry other = m_entries.value(first.file);
+            if (first.file != file && other.generation == first.generation &&
+                other.hashed && other.hash == entry.hash) {
+                matches.append(first);
+            }
+        }
+        if (matches.isEmpty()) {
+            continue;
+        }
+
+        // Reading both files can take long on a share; never hold up the index for it
+        locker.unlock();
+        for (const First& first : matches) {
+            if (sameContent(first.file, file)) {
+                locker.relock();
+                while (!m_results.contains(first.generation)) {
+                    m_changed.wait(&m_mutex);
+                }
+                original = m_results.value(first.generation);
+                m_entries[file].done = true;
+                m_changed.wakeAll();
+                return first.file;
+            }
+        }
+        locker.relock();
+    }
+}
+
+void ContentIndex::finish(const QString& file, const ConversionResult& result)
+{
+    QMutexLocker locker(&m_mutex);
+    // A claimed file is not claimed again until this has run, so the entry is still its own
+    Entry& entry = m_entries[file];
+    entry.done = true;
+    m_results.insert(entry.generation, result);
+    m_changed.wakeAll();
+}
+
+void ContentIndex::stop()
+{
+    m_stopped = true;
+    m_pool.waitForDone();
+}
+
+void ContentIndex::forget(const QString& file)
+{
+    // Its generation goes with it, which retires it from m_firsts
+    const Entry entry = m_entries.take(file);
+    if (entry.size >= 0) {
+        m_sizes[entry.size].removeAll(file);
+    }
+}
+
+void ContentIndex::startHashing(const QString& file)
+{
+    Entry& entry = m_entries[file];
+    if (entry.hashing) {
+        return;
+    }
+    entry.hashing = true;
+    const quint64 generation = entry.generation;
+    m_pool.start([this, file, generation]() {
+        if (!m_stopped) {
+            hashInto(file, generation);
+            return;
+        }
+        // Nobody claims after stop(), but never leave a waiter hanging
+        QMutexLocker locker(&m_mutex);
+        auto entry = m_entries.find(file);
+        if (entry != m_entries.end() && entry->generation == generation) {
+            entry->ready = true;
+        }
+        m_changed.wakeAll();
+    });
+}
+
+bool ContentIndex::hashesReady(const QString& file, const QVector<First>& candidates) const
+{
+    if (!m_entries.value(file).ready) {
+        return false;
+    }
+    // A candidate re-queued since its claim is no longer compared, so it need not wait
+    for (const First& candidate : candidates) {
+        const Entry entry = m_entries.value(candidate.file);
+        if (entry.generation == candidate.generation && !entry.ready) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ContentIndex::hashInto(const QString& file, quint64 generation)
+{
+    quint64 hash = 0;
+    qint64 size = 0;
+    QString ignored;
+    const bool hashed = hashFile(file, hash, size, ignored);
+
+    QMutexLocker locker(&m_mutex);
+    auto entry = m_entries.find(file);
+    if (entry == m_entries.end() || entry->generation != generation) {
+        return;  // Re-queued meanwhile; the new entry hashes for itself
+    }
+    entry->ready = true;
+    // A file rewritten since it was queued no longer matches its group
+    entry->hashed = hashed && size == entry->size;
+    entry->hash = hash;
+    m_changed.wakeAll();
+}
+
+bool ContentIndex::hashFile(const QString& filePath, quint64& hash, qint64& size, QString& errorMessage)
+{
+    TraceSpan span("ContentIndex::hashFile", "io", filePath);
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMessage = "Failed to open input file";
+        return false;
+    }
+
+    Xxh64 hasher;
+    QByteArray chunk(CHUNK_BYTES, Qt::Uninitialized);
+    size = 0;
+    for (;;) {
+        const qint64 read = file.read(chunk.data(), chunk.size());
+        if (read < 0) {
+            errorMessage = "Failed to read input file";
+            return false;
+        }
+        if (read == 0) {
+            break;
+        }
+        hasher.update(reinterpret_cast<const uchar*>(chunk.constData()), read);
+        size += read;
+    }
+    hash = hasher.digest();
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef CONTENTINDEX_H
+#define CONTENTINDEX_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include "imageconverter.h"
+
+/**
+ * @brief Finds byte-identical inputs in a batch so each content converts once
+ *
+ * Queued files are grouped by size, which costs one stat each. Only files
+ * whose size matches another input's are hashed (XXH64), on background
+ * threads so hashing overlaps the conversions already running; an input
+ * of unique size is never read twice. The first input with a given content
+ * is claimed for conversion; later inputs with the same size and hash are
+ * compared byte for byte and, if identical, reuse that conversion's result.
+ */
+class ContentIndex
+{
+public:
+    ContentIndex();
+    ~ContentIndex();
+
+    /**
+     * @brief Register files, hashing in the background those whose size is shared
+     */
+    void add(const QStringList& files);
+
+    /**
+     * @brief Find an earlier input with the same content, or claim the content
+     *
+     * Returns at once if no claimed input has the file's size; otherwise
+     * waits for the hashes and compares candidates without holding the
+     * index lock. When an earlier input matches, waits for its conversion
+     * and returns its result. Otherwise the file is registered as the first
+     * of its content and the caller must report its conversion through
+     * finish(). A file claimed again (rewritten and re-queued) waits for its
+     * earlier claim to complete, is stat'ed afresh and never matches itself.
+     *
+     * @param file Input path
+     * @param original Output result of the matching input's conversion
+     * @return The first input with identical bytes, or empty if there is none
+     */
+    QString claim(const QString& file, ConversionResult& original);
+
+    /**
+     * @brief Record the result of converting a claimed file
+     */
+    void finish(const QString& file, const ConversionResult& result);
+
+    /**
+     * @brief Stop hashing queued files and wait for running hashes
+     */
+    void stop();
+
+    /**
+     * @brief Hash a file's content
+     * @param filePath File to hash
+     * @param hash Output XXH64 of the content
+     * @param size Output size in bytes
+     * @param errorMessage Output error message if reading fails
+     * @return true if successful, false otherwise
+     */
+    static bool hashFile(const QString& filePath, quint64& hash, qint64& size, QString& errorMessage);
+
+private:
+    struct Entry {
+        qint64 size = -1;       // -1 if the file could not be read
+        bool hashing = false;   // Hash requested
+        bool ready = false;     // Hash finished, or failed
+        bool hashed = false;    // Hash valid
+        bool claimed = false;   // claim() entered
+        bool done = false;      // claim() returned a match, or finish() ran
+        quint64 hash = 0;
+        quint64 generation = 0; // Tells a re-queued file's entry from the one it replaced
+    };
+
+    // A claimed input, stale once its path is queued and claimed again
+    struct First {
+        QString file;
+        quint64 generation = 0;
+    };
+
+    // Under m_mutex
+    void forget(const QString& file);
+    void startHashing(const QString& file);
+    bool hashesReady(const QString& file, const QVector<First>& candidates) const;
+    void hashInto(const QString& file, quint64 generation);
+
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+    QHash<QString, Entry> m_entries;
+    QHash<qint64, QStringList> m_sizes;     // Registered inputs by size
+    QHash<qint64, QVector<First>> m_firsts; // Claimed inputs by size
+    QHash<quint64, ConversionResult> m_results; // By the claimed entry's generation
+    quint64 m_generation;
+    QThreadPool m_pool;
+    std::atomic<bool> m_stopped;
+};
+
+#endif // CONTENTINDEX_H
@@ -0,0 +1,224 @@
+#include "conversionserver.h"
+#include "imageconverter.h"
+#include "tracer.h"
+
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThread>
+#include <QThreadPool>
+
+ConversionServer::ConversionServer(QObject *parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+    , m_pool(new QThreadPool(this))
+{
+    // Keep worker threads alive between requests
+    m_pool->setExpiryTimeout(-1);
+
+    connect(m_server, &QLocalServer::newConnection, this, &ConversionServer::onNewConnection);
+}
+
+ConversionServer::~ConversionServer()
+{
+    close();
+    m_pool->waitForDone();
+}
+
+bool ConversionServer::listen(const QString& name, QString& errorMessage)
+{
+    // Remove a stale socket left behind by a previous instance
+    QLocalServer::removeServer(name);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(name)) {
+        errorMessage = QString("Failed to listen on %1: %2").arg(name, m_server->errorString());
+        return false;
+    }
+
+    // Warm the plugin format cache before the first request arrives
+    ImageConverter::isFormatSupported(ImageConverter::Format::PNG);
+    return true;
+}
+
+void ConversionServer::close()
+{
+    m_server->close();
+}
+
+QString ConversionServer::serverName() const
+{
+    return m_server->fullServerName();
+}
+
+void ConversionServer::setMaxThreads(int count)
+{
+    m_pool->setMaxThreadCount(count);
+}
+
+void ConversionServer::onNewConnection()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void ConversionServer::readRequests(QLocalSocket* socket)
+{
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (!line.isEmpty()) {
+            handleRequest(socket, line);
+        }
+    }
+
+    if (socket->bytesAvailable() > MAX_REQUEST_BYTES) {
+        QJsonObject response;
+        response["success"] = false;
+        response["error"] = "Request too large";
+        sendResponse(socket, response);
+        socket->disconnectFromServer();
+    }
+}
+
+void ConversionServer::handleRequest(QLocalSocket* socket, const QByteArray& line)
+{
+    QJsonParseError parseError;
+    const QJsonObject request = QJsonDocument::fromJson(line, &parseError).object();
+
+    QJsonObject response;
+    response["id"] = request.value("id");
+    response["success"] = false;
+
+    if (parseError.error != QJsonParseError::NoError) {
+        response["error"] = QString("Invalid JSON request: %1").arg(parseError.errorString());
+        sendResponse(socket, response);
+        return;
+    }
+
+    if (request.value("command").toString() == "shutdown") {
+        response["success"] = true;
+        sendResponse(socket, response);
+        emit shutdownRequested();
+        return;
+    }
+
+    ImageConverter::Format format;
+    if (!ImageConverter::formatFromName(request.value("format").toString(), format)) {
+        response["error"] = "Unknown target format";
+        sendResponse(socket, response);
+        return;
+    }
+    ConversionOptions options;
+    options.quality = request.value("quality").toInt(-1);
+    options.targetBytes = static_cast<qint64>(request.value("targetBytes").toDouble(0));
+    options.minSsim = request.value("minSsim").toDouble(0);
+    options.pngOptimizeMs = request.value("pngOptimizeMs").toInt(0);
+    options.yuv.bitDepth = request.value("bitDepth").toInt(0);
+    options.progressive = request.value("progressive").toBool(false);
+    options.fastDct = request.value("fastDct").toBool(false);
+    options.webpMethod = request.value("webpMethod").toInt(options.webpMethod);
+    options.webpLossless = request.value("webpLossless").toBool(false);
+    options.webpNearLossless = request.value("webpNearLossless").toInt(options.webpNearLossless);
+    options.webpAlphaQuality = request.value("webpAlphaQuality").toInt(options.webpAlphaQuality);
+    options.pngFastEncode = request.value("pngFastEncode").toBool(false);
+    options.trustedInput = request.value("trustedInput").toBool(false);
+    options.forceReencode = request.value("forceReencode").toBool(false);
+    options.tiff.predictor = request.value("tiffPredictor").toBool(true);
+    options.tiff.tileSize = request.value("tiffTileSize").toInt(0);
+    // Requests already run one per pool thread; their trial encodes share the rest
+    options.maxThreads = qMax(1, QThread::idealThreadCount() / qMax(1, m_pool->maxThreadCount()));
+    if (request.contains("tiffCompression") &&
+        !TiffHandler::compressionFromName(request.value("tiffCompression").toString(), options.tiff.compression)) {
+        response["error"] = "Unknown TIFF compression";
+        sendResponse(socket, response);
+        return;
+    }
+    if (!TiffHandler::isValidTileSize(options.tiff.tileSize)) {
+        response["error"] = "Invalid TIFF tile size";
+        sendResponse(socket, response);
+        return;
+    }
+    if (!YuvFormat::isValidBitDepth(options.yuv.bitDepth)) {
+        response["error"] = "Invalid bit depth";
+        sendResponse(socket, response);
+        return;
+    }
+    if (request.contains("chroma") &&
+        !YuvFormat::chromaFromName(request.value("chroma").toString(), options.yuv.chroma)) {
+        response["error"] = "Unknown chroma subsampling";
+        sendResponse(socket, response);
+        return;
+    }
+
+    QPointer<QLocalSocket> client(socket);
+
+    if (request.contains("data")) {
+        QByteArray input = QByteArray::fromBase64(request.value("data").toString().toLatin1());
+        QString hint = request.value("hint").toString().toLower();
+
+        m_pool->start([this, client, response, input, hint, format, options]() mutable {
+            TraceSpan span("serverRequest", "server");
+            QElapsedTimer timer;
+            timer.start();
+
+            QByteArray output;
+            QString error;
+            if (ImageConverter::convertData(input, format, options, output, error, hint)) {
+                response["success"] = true;
+                response["data"] = QString::fromLatin1(output.toBase64());
+                response["outputSize"] = static_cast<qint64>(output.size());
+            } else {
+                response["error"] = error;
+            }
+            response["elapsedMs"] = timer.elapsed();
+            sendResponse(client, response);
+        });
+        return;
+    }
+
+    if (request.contains("input")) {
+        QString input = request.value("input").toString();
+        QString outputFolder = request.value("outputFolder").toString();
+
+        m_pool->start([this, client, response, input, outputFolder, format, options]() mutable {
+            TraceSpan span("serverRequest", "server", input);
+            QElapsedTimer timer;
+            timer.start();
+
+            ImageConverter converter;
+            ConversionResult result = converter.convert(input, outputFolder, format, options);
+            response["input"] = result.inputFile;
+            response["success"] = result.success;
+            if (result.success) {
+                response["output"] = result.outputFile;
+                response["outputSize"] = result.outputSize;
+            } else {
+                response["error"] = result.errorMessage;
+            }
+            response["elapsedMs"] = timer.elapsed();
+            sendResponse(client, response);
+        });
+        return;
+    }
+
+    response["error"] = "Request needs an \"input\" path or inline \"data\"";
+    sendResponse(socket, response);
+}
+
+void ConversionServer::sendResponse(const QPointer<QLocalSocket>& socket, const QJsonObject& response)
+{
+    // Sockets belong to the server thread; pool threads hand results over
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, socket, response]() {
+            sendResponse(socket, response);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (!socket || socket->state() != QLocalSocket::ConnectedState) {
+        return;
+    }
+    socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact) + '\n');
+}
@@ -0,0 +1,76 @@
+#ifndef CONVERSIONSERVER_H
+#define CONVERSIONSERVER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QPointer>
+#include <QString>
+
+class QLocalServer;
+class QLocalSocket;
+class QThreadPool;
+
+/**
+ * @brief Long-running conversion service on a local (Unix domain) socket
+ *
+ * Clients send one JSON request per line and receive one JSON response per
+ * line, streamed back as each conversion finishes (not necessarily in
+ * request order; responses echo the request "id"). Conversions run on a
+ * thread pool that is kept warm for the lifetime of the server.
+ *
+ * Requests:
+ *   {"id": 1, "input": "/in/a.heic", "outputFolder": "/out", "format": "avif", "quality": 80}
+ *   {"id": 2, "data": "<base64>", "hint": "heic", "format": "png"}
+ *   {"id": 3, "input": "/in/b.png", "outputFolder": "/out", "format": "jpg", "targetBytes": 200000}
+ *   {"id": 4, "input": "/in/c.png", "outputFolder": "/out", "format": "webp", "minSsim": 0.98}
+ *   {"id": 5, "input": "/in/d.png", "outputFolder": "/out", "format": "avif", "chroma": "444", "bitDepth": 10}
+ *   {"id": 6, "input": "/in/e.png", "outputFolder": "/out", "format": "jpg", "progressive": true, "fastDct": true}
+ *   {"id": 7, "input": "/in/f.png", "outputFolder": "/out", "format": "webp", "webpMethod": 6, "webpLossless": true}
+ *   {"id": 8, "input": "/in/g.png", "outputFolder": "/out", "format": "png", "pngFastEncode": true, "trustedInput": true}
+ *   {"id": 9, "input": "/in/h.png", "outputFolder": "/out", "format": "tiff", "tiffCompression": "zstd", "tiffTileSize": 256}
+ *   {"id": 10, "input": "/in/i.png", "outputFolder": "/out", "format": "png", "forceReencode": true}
+ *   {"command": "shutdown"}
+ *
+ * Path requests answer with "output" and "outputSize"; inline requests
+ * answer with the converted bytes in "data" (base64). Every response
+ * carries "success" and, on failure, "error".
+ */
+class ConversionServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Largest request line accepted before the client is disconnected
+    static const qint64 MAX_REQUEST_BYTES = 256 * 1024 * 1024;
+
+    explicit ConversionServer(QObject *parent = nullptr);
+    ~ConversionServer();
+
+    /**
+     * @brief Start listening on a local socket
+     * @param name Socket name, or an absolute path for a Unix socket file
+     * @param errorMessage Output error message if listening fails
+     * @return true if successful, false otherwise
+     */
+    bool listen(const QString& name, QString& errorMessage);
+
+    void close();
+    QString serverName() const;
+    void setMaxThreads(int count);
+
+signals:
+    void shutdownRequested();
+
+private slots:
+    void onNewConnection();
+
+private:
+    void readRequests(QLocalSocket* socket);
+    void handleRequest(QLocalSocket* socket, const QByteArray& line);
+    void sendResponse(const QPointer<QLocalSocket>& socket, const QJsonObject& response);
+
+    QLocalServer* m_server;
+    QThreadPool* m_pool;
+};
+
+#endif // CONVERSIONSERVER_H
@@ -1,15 +1,29 @@
 #include "conversionworker.h"
+#include "bufferpool.h"
+#include "tracer.h"
 
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QThreadPool>
 
 // ConversionWorker implementation
 ConversionWorker::ConversionWorker(QObject *parent)
     : QObject(parent)
+    , m_queuedCount(0)
+    , m_drained(false)
     , m_targetFormat(ImageConverter::Format::PNG)
-    , m_quality(-1)
     , m_cancelled(false)
-    , m_converter(new ImageConverter(this))
+    , m_sink(nullptr)
+    , m_progressIntervalMs(50)
+    , m_maxThreads(QThread::idealThreadCount())
+    , m_prefetchCount(-1)
+    , m_prefetchBudget(ReadAhead::DEFAULT_BUDGET)
+    , m_prefetchedBytes(0)
 {
+    // Hints are cheap; one thread keeps a slow open() off the converting threads
+    m_prefetchPool.setMaxThreadCount(1);
+    // Header reads are mostly latency on a share, so a few overlap well
+    m_estimatePool.setMaxThreadCount(ESTIMATE_THREADS);
 }
 
 ConversionWorker::~ConversionWorker()
@@ -18,7 +32,102 @@ ConversionWorker::~ConversionWorker()
 
 void ConversionWorker::setFiles(const QStringList& files)
 {
+    // Queued when processing starts
+    QMutexLocker locker(&m_queueMutex);
     m_files = files;
+    m_drained = false;
+}
+
+bool ConversionWorker::addFiles(const QStringList& files)
+{
+    QMutexLocker locker(&m_queueMutex);
+    if (m_drained) {
+        return false;
+    }
+    queueJobs(files);
+    return true;
+}
+
+void ConversionWorker::queueJobs(const QStringList& files)
+{
+    // Queued untouched, so conversion starts at once; the estimates follow in the background
+    const QVector<JobScheduler::Job> jobs = m_jobs.add(files);
+    m_queuedCount += files.size();
+    for (int i = 0; i < jobs.size(); i += ESTIMATE_CHUNK) {
+        const QVector<JobScheduler::Job> chunk = jobs.mid(i, ESTIMATE_CHUNK);
+        m_estimatePool.start([this, chunk]() { estimateJobs(chunk); });
+    }
+}
+
+void ConversionWorker::estimateJobs(const QVector<JobScheduler::Job>& chunk)
+{
+    QVector<JobScheduler::Job> jobs;
+    {
+        QMutexLocker locker(&m_queueMutex);
+        if (m_cancelled) {
+            return;
+        }
+        // Files already converting need no estimate
+        jobs = m_jobs.stillQueued(chunk);
+    }
+    if (jobs.isEmpty()) {
+        return;
+    }
+    m_jobs.estimate(jobs);
+
+    QStringList files;
+    for (const JobScheduler::Job& job : jobs) {
+        files.append(job.file);
+    }
+    m_contents.add(files);
+
+    QMutexLocker locker(&m_queueMutex);
+    m_jobs.update(jobs);
+}
+
+bool ConversionWorker::takeNextJob(JobScheduler::Job& job)
+{
+    QStringList hints;
+    {
+        QMutexLocker locker(&m_queueMutex);
+        if (m_cancelled || !m_jobs.take(job)) {
+            m_drained = true;
+            return false;
+        }
+        m_prefetchedBytes -= m_prefetched.take(job.file);
+
+        // Keep the next inputs reading ahead, within the byte budget
+        for (const JobScheduler::Job& next : m_jobs.upcoming(prefetchDepth())) {
+            // Unestimated sizes are unknown and cannot be charged to the budget
+            if (!next.estimated || m_prefetched.contains(next.file)) {
+                continue;
+            }
+            if (m_prefetchedBytes + next.bytes > m_prefetchBudget) {
+                break;
+            }
+            m_prefetched.insert(next.file, next.bytes);
+            m_prefetchedBytes += next.bytes;
+            hints.append(next.file);
+        }
+    }
+    for (const QString& file : hints) {
+        m_prefetchPool.start([file]() { ReadAhead::prefetch(file); });
+    }
+    return true;
+}
+
+int ConversionWorker::prefetchDepth() const
+{
+    if (!ReadAhead::isSupported()) {
+        return 0;
+    }
+    return m_prefetchCount >= 0 ? m_prefetchCount : 2 * m_maxThreads;
+}
+
+int ConversionWorker::queuedCount()
+{
+    QMutexLocker locker(&m_queueMutex);
+    return m_queuedCount;
 }
 
 void ConversionWorker::setOutputFolder(const QString& folder)
@@ -29,11 +138,44 @@ void ConversionWorker::setOutputFolder(const QString& folder)
 void ConversionWorker::setTargetFormat(ImageConverter::Format format)
 {
     m_targetFormat = format;
+    m_jobs.setTargetFormat(format);
 }
 
 void ConversionWorker::setQuality(int quality)
 {
-    m_quality = quality;
+    m_options.quality = quality;
+}
+
+void ConversionWorker::setOptions(const ConversionOptions& options)
+{
+    m_options = options;
+}
+
+void ConversionWorker::setResultSink(ConversionResultSink* sink)
+{
+    m_sink = sink;
+}
+
+void ConversionWorker::setProgressInterval(int milliseconds)
+{
+    m_progressIntervalMs = milliseconds;
+}
+
+void ConversionWorker::setMaxThreads(int count)
+{
+    m_maxThreads = qMax(1, count);
+}
+
+void ConversionWorker::setPrefetch(int count, qint64 budget)
+{
+    m_prefetchCount = count;
+    m_prefetchBudget = budget;
+}
+
+void ConversionWorker::setLocalityOrder(bool enabled)
+{
+    QMutexLocker locker(&m_queueMutex);
+    m_jobs.setOrder(enabled ? JobScheduler::Order::Locality : JobScheduler::Order::LongestFirst);
 }
 
 void ConversionWorker::process()
@@ -41,26 +183,124 @@ void ConversionWorker::process()
     m_cancelled = false;
     emit started();
 
-    QList<ConversionResult> results;
-    int total = m_files.size();
+    TraceSpan batchSpan("batch", "worker");
+
+    ConversionSummary summary;
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 lastReport = 0;
+
+    // Largest predicted cost first, so small files fill in at the end (or in locality order)
+    {
+        QMutexLocker locker(&m_queueMutex);
+        queueJobs(m_files);
+        m_files.clear();
+    }
+
+    // Results not yet delivered through resultsReady; flushed every interval.
+    // Guarded by resultMutex, like the summary counters.
+    QMutex resultMutex;
+    QList<ConversionResult> pending;
+    QString lastFile;
+    int completed = 0;
+
+    auto report = [&]() {
+        emit progress(completed, queuedCount(), lastFile);
+        if (!pending.isEmpty()) {
+            emit resultsReady(pending);
+            pending.clear();
+        }
+        lastReport = timer.elapsed();
+    };
+
+    // Thread-safe: runs on conversion threads and, for written outputs, on the writer
+    auto deliver = [&](const ConversionResult& result) {
+        if (m_sink) {
+            m_sink->consume(result);
+        }
+
+        QMutexLocker locker(&resultMutex);
+        if (result.success) {
+            summary.succeeded++;
+        } else {
+            summary.failed++;
+        }
+        if (!result.duplicateOf.isEmpty()) {
+            summary.duplicates++;
+        }
+        pending.append(result);
+        lastFile = QFileInfo(result.inputFile).fileName();
+        completed++;
 
-    for (int i = 0; i < total && !m_cancelled; ++i) {
-        const QString& file = m_files[i];
-        QFileInfo info(file);
+        if (timer.elapsed() - lastReport >= m_progressIntervalMs) {
+            report();
+        }
+    };
 
-        emit progress(i + 1, total, info.fileName());
+    // Files already run one per thread; a conversion's own trial encodes share what is left
+    ConversionOptions options = m_options;
+    if (m_maxThreads > 1 && options.maxThreads <= 0) {
+        options.maxThreads = qMax(1, QThread::idealThreadCount() / m_maxThreads);
+    }
+
+    // The queue may grow while running (see addFiles)
+    auto convertJobs = [&](int index) {
+        Tracer::setThreadName(QString("ConversionWorker %1").arg(index));
+        ImageConverter converter;
+        JobScheduler::Job job;
+        while (takeNextJob(job)) {
+            const QString file = job.file;
+            TraceSpan fileSpan("convertFile", "worker", file);
+            QElapsedTimer fileTimer;
+            fileTimer.start();
+
+            // Byte-identical inputs reuse the first one's output
+            ConversionResult original;
+            if (!m_contents.claim(file, original).isEmpty()) {
+                ConversionResult result = converter.convertDuplicate(file, m_outputFolder, m_targetFormat,
+                                                                     original);
+                result.elapsedMs = fileTimer.elapsed();
+                deliver(result);
+                continue;
+            }
 
-        ConversionResult result = m_converter->convert(file, m_outputFolder, m_targetFormat, m_quality);
-        results.append(result);
+            // Encoded outputs complete on the writer; elapsedMs then includes the write
+            converter.convert(file, m_outputFolder, m_targetFormat, options, &m_writer,
+                              [this, &deliver, file, fileTimer](const ConversionResult& converted) {
+                ConversionResult result = converted;
+                result.elapsedMs = fileTimer.elapsed();
+                m_contents.finish(file, result);
+                deliver(result);
+            });
+            // Predictions are about this thread's time, not the writer's
+            m_jobs.record(job, fileTimer.elapsed());
+        }
+    };
 
-        emit fileCompleted(result);
+    m_writer.start();
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_maxThreads);
+    for (int i = 1; i < m_maxThreads; ++i) {
+        pool.start([&convertJobs, i]() { convertJobs(i); });
     }
+    convertJobs(0);
+    pool.waitForDone();
+    m_writer.close();
+    m_estimatePool.waitForDone();
+
+    report();
+    m_contents.stop();
+
+    summary.total = queuedCount();
+    summary.cancelled = m_cancelled;
+    summary.elapsedMs = timer.elapsed();
 
     if (m_cancelled) {
         emit error("Conversion cancelled by user");
     }
 
-    emit finished(results);
+    emit finished(summary);
 }
 
 void ConversionWorker::cancel()
@@ -73,8 +313,16 @@ ConversionController::ConversionController(QObject *parent)
     : QObject(parent)
     , m_thread(nullptr)
     , m_worker(nullptr)
+    , m_sink(nullptr)
     , m_running(false)
+    , m_maxThreads(QThread::idealThreadCount())
+    , m_prefetchCount(-1)
+    , m_localityOrder(false)
+    , m_format(ImageConverter::Format::PNG)
 {
+    // Both travel from the worker thread over queued connections
+    qRegisterMetaType<ConversionSummary>("ConversionSummary");
+    qRegisterMetaType<QList<ConversionResult>>("QList<ConversionResult>");
 }
 
 ConversionController::~ConversionController()
@@ -90,12 +338,24 @@ ConversionController::~ConversionController()
 
 void ConversionController::startConversion(const QStringList& files, const QString& outputFolder,
                                             ImageConverter::Format format, int quality)
+{
+    ConversionOptions options;
+    options.quality = quality;
+    startConversion(files, outputFolder, format, options);
+}
+
+void ConversionController::startConversion(const QStringList& files, const QString& outputFolder,
+                                            ImageConverter::Format format, const ConversionOptions& options)
 {
     if (m_running) {
         emit error("Conversion already in progress");
         return;
     }
 
+    m_outputFolder = outputFolder;
+    m_format = format;
+    m_options = options;
+
     // Create thread and worker
     m_thread = new QThread();
     m_worker = new ConversionWorker();
@@ -105,13 +365,17 @@ void ConversionController::startConversion(const QStringList& files, const QStri
     m_worker->setFiles(files);
     m_worker->setOutputFolder(outputFolder);
     m_worker->setTargetFormat(format);
-    m_worker->setQuality(quality);
+    m_worker->setOptions(options);
+    m_worker->setResultSink(m_sink);
+    m_worker->setMaxThreads(m_maxThreads);
+    m_worker->setPrefetch(m_prefetchCount);
+    m_worker->setLocalityOrder(m_localityOrder);
 
     // Connect signals
     connect(m_thread, &QThread::started, m_worker, &ConversionWorker::process);
     connect(m_worker, &ConversionWorker::started, this, &ConversionController::started);
     connect(m_worker, &ConversionWorker::progress, this, &ConversionController::progress);
-    connect(m_worker, &ConversionWorker::fileCompleted, this, &ConversionController::fileCompleted);
+    connect(m_worker, &ConversionWorker::resultsReady, this, &ConversionController::resultsReady);
     connect(m_worker, &ConversionWorker::finished, this, &ConversionController::onWorkerFinished);
     connect(m_worker, &ConversionWorker::error, this, &ConversionController::error);
 
@@ -124,8 +388,24 @@ void ConversionController::startConversion(const QStringList& files, const QStri
     m_thread->start();
 }
 
+void ConversionController::enqueueFiles(const QStringList& files)
+{
+    if (files.isEmpty()) {
+        return;
+    }
+    if (m_running) {
+        // A worker that already drained its queue picks these up in a new batch
+        if (!m_worker->addFiles(files)) {
+            m_pendingFiles.append(files);
+        }
+        return;
+    }
+    startConversion(files, m_outputFolder, m_format, m_options);
+}
+
 void ConversionController::cancelConversion()
 {
+    m_pendingFiles.clear();
     if (m_worker) {
         m_worker->cancel();
     }
@@ -136,10 +416,39 @@ bool ConversionController::isRunning() const
     return m_running;
 }
 
-void ConversionController::onWorkerFinished(const QList<ConversionResult>& results)
+void ConversionController::setResultSink(ConversionResultSink* sink)
+{
+    m_sink = sink;
+}
+
+void ConversionController::setMaxThreads(int count)
+{
+    m_maxThreads = qMax(1, count);
+}
+
+void ConversionController::setPrefetch(int count)
+{
+    m_prefetchCount = count;
+}
+
+void ConversionController::setLocalityOrder(bool enabled)
+{
+    m_localityOrder = enabled;
+}
+
+void ConversionController::onWorkerFinished(const ConversionSummary& summary)
 {
     m_running = false;
     m_thread = nullptr;
     m_worker = nullptr;
-    emit finished(results);
+    emit finished(summary);
+
+    if (!m_pendingFiles.isEmpty()) {
+        QStringList files = m_pendingFiles;
+        m_pendingFiles.clear();
+        startConversion(files, m_outputFolder, m_format, m_options);
+        return;
+    }
+    // Idle until the next batch; the pool would otherwise keep its buffers for the whole session
+    BufferPool::trim();
 }
@@ -2,12 +2,51 @@
 #define CONVERSIONWORKER_H
 
 #include <QObject>
+#include <QHash>
+#include <QMutex>
 #include <QThread>
+#include <QThreadPool>
 #include <QStringList>
+#include <atomic>
+#include "contentindex.h"
 #include "imageconverter.h"
+#include "jobscheduler.h"
+#include "outputwriter.h"
+#include "readahead.h"
+
+/**
+ * @brief Summary counters reported when a batch finishes
+ */
+struct ConversionSummary {
+    int total = 0;
+    int succeeded = 0;
+    int failed = 0;
+    int duplicates = 0;     // Inputs identical to an earlier one, given its output
+    bool cancelled = false;
+    qint64 elapsedMs = 0;
+};
+Q_DECLARE_METATYPE(ConversionSummary)
+
+/**
+ * @brief Receives each conversion result as soon as it completes
+ *
+ * consume() is called on the thread doing the conversion, so
+ * implementations must not touch GUI objects and must be thread-safe.
+ */
+class ConversionResultSink
+{
+public:
+    virtual ~ConversionResultSink() = default;
+    virtual void consume(const ConversionResult& result) = 0;
+};
 
 /**
  * @brief Worker class for batch image conversion in a separate thread
+ *
+ * The worker thread and a pool of helpers convert files in parallel,
+ * taking the files with the longest predicted conversion time first.
+ * Encoded outputs go to an OutputWriter, so conversion threads never wait
+ * on output I/O.
  */
 class ConversionWorker : public QObject
 {
@@ -21,6 +60,18 @@ public:
     void setOutputFolder(const QString& folder);
     void setTargetFormat(ImageConverter::Format format);
     void setQuality(int quality);
+    void setOptions(const ConversionOptions& options);
+    void setResultSink(ConversionResultSink* sink);
+    void setProgressInterval(int milliseconds);
+    // Files converted in parallel (default: one per core)
+    void setMaxThreads(int count);
+    // Upcoming inputs to read ahead (-1: two per thread, 0: none), within a byte budget
+    void setPrefetch(int count, qint64 budget = ReadAhead::DEFAULT_BUDGET);
+    // Convert in directory and inode order instead of longest first
+    void setLocalityOrder(bool enabled);
+
+    // Thread-safe; returns false once the worker has run out of files
+    bool addFiles(const QStringList& files);
 
 public slots:
     void process();
@@ -28,18 +79,45 @@ public slots:
 
 signals:
     void started();
+    // Coalesced: emitted at most once per progress interval, plus once at the end
     void progress(int current, int total, const QString& currentFile);
-    void fileCompleted(const ConversionResult& result);
-    void finished(const QList<ConversionResult>& results);
+    void resultsReady(const QList<ConversionResult>& results);
+    void finished(const ConversionSummary& summary);
     void error(const QString& message);
 
 private:
-    QStringList m_files;
+    // Threads reading headers for estimates, and the jobs each task estimates
+    static const int ESTIMATE_THREADS = 4;
+    static const int ESTIMATE_CHUNK = 64;
+
+    void queueJobs(const QStringList& files);   // Under m_queueMutex
+    void estimateJobs(const QVector<JobScheduler::Job>& chunk);
+    bool takeNextJob(JobScheduler::Job& job);
+    int queuedCount();
+    int prefetchDepth() const;
+
+    QMutex m_queueMutex;
+    QStringList m_files;        // Set before processing, not yet queued
+    JobScheduler m_jobs;
+    int m_queuedCount;
+    bool m_drained;
     QString m_outputFolder;
     ImageConverter::Format m_targetFormat;
-    int m_quality;
-    bool m_cancelled;
-    ImageConverter* m_converter;
+    ConversionOptions m_options;
+    std::atomic<bool> m_cancelled;
+    ConversionResultSink* m_sink;
+    int m_progressIntervalMs;
+    int m_maxThreads;
+    ContentIndex m_contents;    // Hashes queued files so identical inputs convert once
+    OutputWriter m_writer;      // Writes encoded outputs off the conversion threads
+
+    // Inputs hinted for read-ahead and not yet taken, with their sizes; under m_queueMutex
+    int m_prefetchCount;
+    qint64 m_prefetchBudget;
+    QHash<QString, qint64> m_prefetched;
+    qint64 m_prefetchedBytes;
+    QThreadPool m_prefetchPool;
+    QThreadPool m_estimatePool;
 };
 
 /**
@@ -55,23 +133,48 @@ public:
 
     void startConversion(const QStringList& files, const QString& outputFolder,
                          ImageConverter::Format format, int quality = -1);
+    void startConversion(const QStringList& files, const QString& outputFolder,
+                         ImageConverter::Format format, const ConversionOptions& options);
+
+    // Add files to the running batch, or start a new one with the last settings
+    void enqueueFiles(const QStringList& files);
     void cancelConversion();
     bool isRunning() const;
 
+    // Sink for the next conversion; not owned, must outlive the batch
+    void setResultSink(ConversionResultSink* sink);
+
+    // Files converted in parallel by the next conversion
+    void setMaxThreads(int count);
+
+    // Read-ahead and ordering of the next conversion (see ConversionWorker)
+    void setPrefetch(int count);
+    void setLocalityOrder(bool enabled);
+
 signals:
     void started();
     void progress(int current, int total, const QString& currentFile);
-    void fileCompleted(const ConversionResult& result);
-    void finished(const QList<ConversionResult>& results);
+    void resultsReady(const QList<ConversionResult>& results);
+    void finished(const ConversionSummary& summary);
     void error(const QString& message);
 
 private slots:
-    void onWorkerFinished(const QList<ConversionResult>& results);
+    void onWorkerFinished(const ConversionSummary& summary);
 
 private:
     QThread* m_thread;
     ConversionWorker* m_worker;
+    ConversionResultSink* m_sink;
     bool m_running;
+    int m_maxThreads;
+    int m_prefetchCount;
+    bool m_localityOrder;
+
+    // Settings of the last batch, reused by enqueueFiles
+    QString m_outputFolder;
+    ImageConverter::Format m_format;
+    ConversionOptions m_options;
+    QStringList m_pendingFiles;
 };
 
 #endif // CONVERSIONWORKER_H
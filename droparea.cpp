@@ -1,4 +1,5 @@
 #include "droparea.h"
+#include "imageconverter.h"
 
 #include <QFileInfo>
 #include <QUrl>
@@ -9,11 +10,7 @@ DropArea::DropArea(QWidget *parent)
     setAcceptDrops(true);
 
     // Supported image extensions
-    m_supportedExtensions = {
-        "jpg", "jpeg", "png", "webp", "gif",
-        "tiff", "tif", "bmp", "heic", "heif",
-        "avif", "ico"
-    };
+    m_supportedExtensions = ImageConverter::supportedInputExtensions();
 }
 
 void DropArea::dragEnterEvent(QDragEnterEvent *event)
@@ -0,0 +1,124 @@
+#include "filecopy.h"
+#include "tracer.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int CHUNK_BYTES = 1024 * 1024;
+
+#ifdef Q_OS_LINUX
+// Reflink, else copy_file_range; false when the filesystem supports neither
+// (or gave up part way), bytesCopied telling how far the copy got
+bool copyInKernel(int source, int destination, qint64 size, qint64& bytesCopied)
+{
+#ifdef FICLONE
+    if (ioctl(destination, FICLONE, source) == 0) {
+        bytesCopied = size;
+        return true;
+    }
+#endif
+#ifdef SYS_copy_file_range
+    while (bytesCopied < size) {
+        const long copied = syscall(SYS_copy_file_range, source, nullptr, destination, nullptr,
+                                    static_cast<size_t>(size - bytesCopied), 0u);
+        if (copied <= 0) {
+            return false;
+        }
+        bytesCopied += copied;
+    }
+    return true;
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(destination);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+#endif
+
+bool copyThroughBuffer(QFile& source, QFileDevice& destination, qint64& bytesCopied, QString& errorMessage)
+{
+    QByteArray chunk(CHUNK_BYTES, Qt::Uninitialized);
+    for (;;) {
+        const qint64 read = source.read(chunk.data(), chunk.size());
+        if (read < 0) {
+            errorMessage = "Failed to read input file";
+            return false;
+        }
+        if (read == 0) {
+            return true;
+        }
+        if (destination.write(chunk.constData(), read) != read) {
+            errorMessage = "Failed to write complete file";
+            return false;
+        }
+        bytesCopied += read;
+    }
+}
+
+} // namespace
+
+bool FileCopy::copy(const QString& sourcePath, const QString& destinationPath,
+                    qint64& bytesCopied, QString& errorMessage)
+{
+    TraceSpan span("FileCopy::copy", "io", sourcePath);
+    bytesCopied = 0;
+
+    // Unbuffered, so kernel-side copies and seeks see the same file offsets
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        errorMessage = "Failed to open input file";
+        return false;
+    }
+    // Copied into a temporary file renamed over the destination on commit(), like
+    // OutputWriter::writeFile, so a failed copy never leaves a truncated output
+    QSaveFile destination(destinationPath);
+    if (!destination.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        errorMessage = "Failed to open output file for writing";
+        return false;
+    }
+
+    bool copied = false;
+#ifdef Q_OS_LINUX
+    copied = copyInKernel(source.handle(), destination.handle(), source.size(), bytesCopied);
+    // Finish in user space from wherever the kernel copy stopped
+    if (!copied && (!source.seek(bytesCopied) || !destination.seek(bytesCopied))) {
+        errorMessage = "Failed to resume the copy";
+        return false;
+    }
+#endif
+    if (!copied && !copyThroughBuffer(source, destination, bytesCopied, errorMessage)) {
+        return false;
+    }
+    if (!destination.commit()) {
+        errorMessage = "Failed to move output file into place";
+        return false;
+    }
+    return true;
+}
+
+bool FileCopy::linkOrCopy(const QString& sourcePath, const QString& destinationPath,
+                          qint64& size, QString& errorMessage)
+{
+#ifdef Q_OS_UNIX
+    // Fails across filesystems and on those without hard links (FAT, some network shares)
+    if (::link(QFile::encodeName(sourcePath).constData(), QFile::encodeName(destinationPath).constData()) == 0) {
+        size = QFileInfo(destinationPath).size();
+        return true;
+    }
+#endif
+    return copy(sourcePath, destinationPath, size, errorMessage);
+}
@@ -0,0 +1,44 @@
+#ifndef FILECOPY_H
+#define FILECOPY_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Byte-for-byte file copy that stays in the kernel where it can
+ *
+ * On Linux a copy is first attempted as a reflink (FICLONE), which shares
+ * the source's extents on filesystems such as Btrfs and XFS, then with
+ * copy_file_range, which moves data without a round trip through user
+ * space (and is offloaded by NFS and SMB servers). Other systems, and
+ * filesystems supporting neither, copy through a buffer. The copy goes to
+ * a temporary file renamed into place, so an interrupted copy never
+ * leaves a partial destination behind.
+ */
+class FileCopy
+{
+public:
+    /**
+     * @brief Copy a file, replacing the destination atomically
+     * @param sourcePath File to copy
+     * @param destinationPath File to create or overwrite
+     * @param bytesCopied Output size of the copy
+     * @param errorMessage Output error message if copying fails
+     * @return true if successful, false otherwise
+     */
+    static bool copy(const QString& sourcePath, const QString& destinationPath,
+                     qint64& bytesCopied, QString& errorMessage);
+
+    /**
+     * @brief Hard-link a file, or copy it where links are not possible
+     * @param sourcePath Existing file
+     * @param destinationPath New name; must not exist yet
+     * @param size Output size of the linked or copied file
+     * @param errorMessage Output error message if both fail
+     * @return true if successful, false otherwise
+     */
+    static bool linkOrCopy(const QString& sourcePath, const QString& destinationPath,
+                           qint64& size, QString& errorMessage);
+};
+
+#endif // FILECOPY_H
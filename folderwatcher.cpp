@@ -0,0 +1,235 @@
+#include "folderwatcher.h"
+#include "imageconverter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent)
+    , m_settleTimer(new QTimer(this))
+    , m_watcher(nullptr)
+    , m_notifier(nullptr)
+    , m_inotifyFd(-1)
+    , m_settleTimeMs(1000)
+{
+    connect(m_settleTimer, &QTimer::timeout, this, &FolderWatcher::checkPending);
+    setSettleTime(m_settleTimeMs);
+}
+
+FolderWatcher::~FolderWatcher()
+{
+    stop();
+}
+
+bool FolderWatcher::start(const QString& folder, bool includeExisting, QString& errorMessage)
+{
+    stop();
+
+    QFileInfo info(folder);
+    if (!info.isDir()) {
+        errorMessage = "Watch folder does not exist";
+        return false;
+    }
+    m_folder = info.absoluteFilePath();
+    m_clock.start();
+
+#ifdef Q_OS_LINUX
+    // Each event names the file, so bursts never trigger a directory rescan
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0 ||
+        inotify_add_watch(m_inotifyFd, QFile::encodeName(m_folder).constData(),
+                          IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0) {
+        errorMessage = QString("Failed to watch folder: %1").arg(qt_error_string(errno));
+        stop();
+        return false;
+    }
+    m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &FolderWatcher::readInotifyEvents);
+#else
+    m_watcher = new QFileSystemWatcher(this);
+    if (!m_watcher->addPath(m_folder)) {
+        errorMessage = "Failed to watch folder";
+        stop();
+        return false;
+    }
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, [this]() { scanFolder(true); });
+#endif
+
+    // The snapshot is the baseline later listings are diffed against
+    scanFolder(includeExisting);
+
+    return true;
+}
+
+void FolderWatcher::stop()
+{
+    delete m_notifier;
+    m_notifier = nullptr;
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+    }
+#endif
+    m_inotifyFd = -1;
+
+    delete m_watcher;
+    m_watcher = nullptr;
+
+    m_settleTimer->stop();
+    m_pending.clear();
+    m_snapshot.clear();
+}
+
+void FolderWatcher::setSettleTime(int milliseconds)
+{
+    m_settleTimeMs = milliseconds;
+    // Poll a few times per settle period so files are reported promptly
+    m_settleTimer->setInterval(qMax(50, milliseconds / 4));
+}
+
+void FolderWatcher::setExcludedSuffixes(const QStringList& suffixes)
+{
+    m_excludedSuffixes.clear();
+    for (const QString& suffix : suffixes) {
+        QString key = suffix.toLower();
+        if (key.startsWith('.')) {
+            key.remove(0, 1);
+        }
+        m_excludedSuffixes.append(key);
+    }
+}
+
+bool FolderWatcher::isCandidate(const QString& filePath) const
+{
+    QFileInfo info(filePath);
+    // Hidden names are typically temporary files of in-progress copies
+    if (info.fileName().startsWith('.')) {
+        return false;
+    }
+    static const QStringList extensions = ImageConverter::supportedInputExtensions();
+    QString suffix = info.suffix().toLower();
+    return extensions.contains(suffix) &&
+           !m_excludedSuffixes.contains(suffix);
+}
+
+void FolderWatcher::markChanged(const QString& filePath)
+{
+    if (!isCandidate(filePath)) {
+        return;
+    }
+
+    QFileInfo info(filePath);
+    if (!info.isFile()) {
+        m_pending.remove(filePath);
+        return;
+    }
+
+    PendingFile& pending = m_pending[filePath];
+    pending.size = info.size();
+    pending.modified = info.lastModified();
+    pending.stableSince = m_clock.elapsed();
+
+    if (!m_settleTimer->isActive()) {
+        m_settleTimer->start();
+    }
+}
+
+void FolderWatcher::checkPending()
+{
+    const qint64 now = m_clock.elapsed();
+    QStringList ready;
+
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        QFileInfo info(it.key());
+        if (!info.isFile()) {
+            it = m_pending.erase(it);
+            continue;
+        }
+
+        if (info.size() != it->size || info.lastModified() != it->modified) {
+            // Still being written; restart the settle period
+            it->size = info.size();
+            it->modified = info.lastModified();
+            it->stableSince = now;
+            ++it;
+        } else if (now - it->stableSince >= m_settleTimeMs) {
+            ready.append(it.key());
+            m_snapshot.insert(it.key(), it->modified);
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_pending.isEmpty()) {
+        m_settleTimer->stop();
+    }
+    if (!ready.isEmpty()) {
+        emit filesReady(ready);
+    }
+}
+
+void FolderWatcher::scanFolder(bool report)
+{
+    QHash<QString, QDateTime> snapshot;
+    const QFileInfoList entries = QDir(m_folder).entryInfoList(QDir::Files);
+    for (const QFileInfo& info : entries) {
+        QString path = info.absoluteFilePath();
+        QDateTime modified = info.lastModified();
+        snapshot.insert(path, modified);
+
+        auto previous = m_snapshot.constFind(path);
+        bool changed = previous == m_snapshot.constEnd() || previous.value() != modified;
+        if (changed && report) {
+            markChanged(path);
+        }
+    }
+    m_snapshot.swap(snapshot);
+}
+
+void FolderWatcher::readInotifyEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(inotify_event) char buffer[64 * 1024];
+    bool overflow = false;
+
+    for (;;) {
+        ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                const QString path = m_folder + "/" + QFile::decodeName(event->name);
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    // Keeps the snapshot to the files still in the folder
+                    m_snapshot.remove(path);
+                    m_pending.remove(path);
+                } else {
+                    markChanged(path);
+                }
+            }
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    // Events were dropped by the kernel; a rescan is the only way to catch up
+    if (overflow) {
+        scanFolder(true);
+    }
+#endif
+}
@@ -0,0 +1,80 @@
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @brief Watches a hot folder and reports image files once they are stable
+ *
+ * On Linux the folder is watched with inotify, so each event names the file
+ * that changed; beyond one listing at start the directory is only rescanned
+ * after an event queue overflow. Elsewhere QFileSystemWatcher is used and the directory
+ * listing is diffed against the last snapshot.
+ *
+ * A file is reported only after its size and modification time have not
+ * changed for the settle time, so half-copied files are never converted.
+ */
+class FolderWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FolderWatcher(QObject *parent = nullptr);
+    ~FolderWatcher();
+
+    /**
+     * @brief Start watching a folder
+     * @param folder Folder to watch (not recursive)
+     * @param includeExisting Also report the images already in the folder
+     * @param errorMessage Output error message if watching fails
+     * @return true if successful, false otherwise
+     */
+    bool start(const QString& folder, bool includeExisting, QString& errorMessage);
+    void stop();
+
+    // Time a file must stay unchanged before it is reported (default 1000 ms)
+    void setSettleTime(int milliseconds);
+
+    // Suffixes never reported, e.g. the target format when writing in place
+    void setExcludedSuffixes(const QStringList& suffixes);
+
+signals:
+    void filesReady(const QStringList& files);
+
+private slots:
+    void checkPending();
+
+private:
+    struct PendingFile {
+        qint64 size;
+        QDateTime modified;
+        qint64 stableSince;
+    };
+
+    void markChanged(const QString& filePath);
+    void scanFolder(bool report);
+    bool isCandidate(const QString& filePath) const;
+    void readInotifyEvents();
+
+    QString m_folder;
+    QStringList m_excludedSuffixes;
+    QHash<QString, PendingFile> m_pending;
+    QHash<QString, QDateTime> m_snapshot;
+    QTimer* m_settleTimer;
+    QFileSystemWatcher* m_watcher;
+    QSocketNotifier* m_notifier;
+    int m_inotifyFd;
+    int m_settleTimeMs;
+    QElapsedTimer m_clock;
+};
+
+#endif // FOLDERWATCHER_H
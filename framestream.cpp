@@ -0,0 +1,84 @@
+#include "framestream.h"
+#include "avifhandler.h"
+#include "heifhandler.h"
+#include "imageconverter.h"
+#include "tracer.h"
+
+#include <QBuffer>
+#include <QImageReader>
+
+namespace {
+
+// Formats Qt decodes frame by frame (GIF, animated WebP/PNG, multi-page TIFF)
+class QtFrameReader : public FrameReader
+{
+public:
+    QtFrameReader(const QByteArray& data, const QString& formatHint)
+        : m_buffer()
+    {
+        m_buffer.setData(data);
+        m_buffer.open(QIODevice::ReadOnly);
+        m_reader.setDevice(&m_buffer);
+        // Tried first; content detection remains the fallback
+        if (!formatHint.isEmpty()) {
+            m_reader.setFormat(formatHint.toLatin1());
+        }
+    }
+
+    bool isValid() const { return m_reader.canRead(); }
+
+    int frameCount() const override { return qMax(0, m_reader.imageCount()); }
+
+    int loopCount() const override { return m_reader.loopCount(); }
+
+    bool readFrame(Frame& frame, QString& errorMessage) override
+    {
+        if (m_done || (m_frames > 0 && !m_reader.canRead())) {
+            m_done = true;
+            return false;
+        }
+
+        TraceSpan span("QImageReader::read", "codec");
+        QImage image = m_reader.read();
+        if (image.isNull()) {
+            // Some plugins only signal the end by failing to read
+            m_done = true;
+            if (m_frames == 0) {
+                errorMessage = QString("Failed to load image: %1").arg(m_reader.errorString());
+            }
+            return false;
+        }
+
+        frame.image = image;
+        frame.durationMs = m_reader.nextImageDelay();
+        ++m_frames;
+        return true;
+    }
+
+private:
+    QBuffer m_buffer;
+    QImageReader m_reader;
+    int m_frames = 0;
+    bool m_done = false;
+};
+
+} // namespace
+
+std::unique_ptr<FrameReader> FrameReader::open(const QByteArray& data, const QString& formatHint,
+                                               QString& errorMessage)
+{
+    const QString detected = ImageConverter::detectFormat(data);
+    if (detected == "avif" && AvifHandler::isAvailable()) {
+        return AvifHandler::createSequenceReader(data, errorMessage);
+    }
+    if (detected == "heif" && HeifHandler::isAvailable()) {
+        return HeifHandler::createCollectionReader(data, errorMessage);
+    }
+
+    std::unique_ptr<QtFrameReader> reader(new QtFrameReader(data, formatHint));
+    if (!reader->isValid()) {
+        errorMessage = "Unsupported or corrupted image";
+        return nullptr;
+    }
+    return std::move(reader);
+}
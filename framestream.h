@@ -0,0 +1,73 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <memory>
+#include "yuvformat.h"
+
+/**
+ * @brief One decoded frame of an animation, sequence or collection
+ */
+struct Frame {
+    QImage image;
+    int durationMs = 0;   // Display time; 0 if the source has none
+};
+
+/**
+ * @brief Decodes the frames of an image one at a time
+ *
+ * Only the frame being returned (plus any frames a reader decodes ahead)
+ * is held in memory, so long animations need about one frame of memory.
+ */
+class FrameReader
+{
+public:
+    virtual ~FrameReader() = default;
+
+    // Number of frames, or 0 if the source does not say
+    virtual int frameCount() const = 0;
+
+    // Animation repeats: -1 forever, 0 play once
+    virtual int loopCount() const { return 0; }
+
+    /**
+     * @brief Decode the next frame
+     * @param frame Output frame
+     * @param errorMessage Output error message; left empty at the end of the stream
+     * @return true if a frame was decoded, false at the end or on error
+     */
+    virtual bool readFrame(Frame& frame, QString& errorMessage) = 0;
+
+    /**
+     * @brief Open a reader for encoded data (AVIF sequences, HEIF collections,
+     *        and anything Qt reads frame by frame, such as GIF)
+     * @param data Encoded file contents; must outlive the reader
+     * @param formatHint Source suffix, used if the content is not recognised
+     * @param errorMessage Output error message if no reader can be opened
+     * @return The reader, or nullptr on failure
+     */
+    static std::unique_ptr<FrameReader> open(const QByteArray& data, const QString& formatHint,
+                                             QString& errorMessage);
+};
+
+/**
+ * @brief Encodes frames one at a time into a multi-frame file
+ */
+class FrameWriter
+{
+public:
+    // Display time for frames whose source gives none
+    static const int DEFAULT_FRAME_MS = 100;
+
+    virtual ~FrameWriter() = default;
+
+    // Encode a frame; the writer keeps only its encoded form
+    virtual bool addFrame(const Frame& frame, QString& errorMessage) = 0;
+
+    // Finish the file after the last frame
+    virtual bool finish(QByteArray& output, QString& errorMessage) = 0;
+};
+
+#endif // FRAMESTREAM_H
@@ -1,10 +1,309 @@
 #include "heifhandler.h"
+#include "bufferpool.h"
+#include "pixelformat.h"
+#include "tracer.h"
 
 #include <QFile>
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include <climits>
+#include <cstring>
+
+namespace {
+
+// Find the first box of a type among the sibling boxes in [offset, end) of an
+// ISO-BMFF file; on success offset and end delimit the box's payload
+bool findBox(const QByteArray& data, const char* type, qint64& offset, qint64& end)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    for (qint64 pos = offset; pos + 8 <= end; ) {
+        quint64 size = qFromBigEndian<quint32>(bytes + pos);
+        qint64 header = 8;
+        if (size == 1) {
+            // 64-bit size after the type
+            if (pos + 16 > end) {
+                return false;
+            }
+            size = qFromBigEndian<quint64>(bytes + pos + 8);
+            header = 16;
+        } else if (size == 0) {
+            // Extends to the end of the enclosing box
+            size = end - pos;
+        }
+        if (size < static_cast<quint64>(header) || size > static_cast<quint64>(end - pos)) {
+            return false;
+        }
+        if (memcmp(bytes + pos + 4, type, 4) == 0) {
+            offset = pos + header;
+            end = pos + static_cast<qint64>(size);
+            return true;
+        }
+        pos += static_cast<qint64>(size);
+    }
+    return false;
+}
+
+} // namespace
 
 #ifdef HAVE_LIBHEIF
 #include <libheif/heif.h>
+
+namespace {
+
+#if LIBHEIF_HAVE_VERSION(1, 20, 0)
+// Samples of the first image ('pict') or video ('vide') track, from its
+// 'stsz' or 'stz2' box; 0 if there is none
+int sequenceSampleCount(const QByteArray& data)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    qint64 moovStart = 0;
+    qint64 moovEnd = data.size();
+    if (!findBox(data, "moov", moovStart, moovEnd)) {
+        return 0;
+    }
+
+    qint64 trakStart = moovStart;
+    qint64 trakEnd = moovEnd;
+    while (findBox(data, "trak", trakStart, trakEnd)) {
+        qint64 mdiaStart = trakStart;
+        qint64 mdiaEnd = trakEnd;
+        // The next search starts after this track
+        trakStart = trakEnd;
+        trakEnd = moovEnd;
+        if (!findBox(data, "mdia", mdiaStart, mdiaEnd)) {
+            continue;
+        }
+
+        // hdlr: version/flags and pre_defined, then the handler type
+        qint64 start = mdiaStart;
+        qint64 end = mdiaEnd;
+        if (!findBox(data, "hdlr", start, end) || end - start < 12 ||
+            (memcmp(bytes + start + 8, "pict", 4) != 0 && memcmp(bytes + start + 8, "vide", 4) != 0)) {
+            continue;
+        }
+
+        qint64 stblStart = mdiaStart;
+        qint64 stblEnd = mdiaEnd;
+        if (!findBox(data, "minf", stblStart, stblEnd) || !findBox(data, "stbl", stblStart, stblEnd)) {
+            continue;
+        }
+
+        // Both keep sample_count after version/flags and one more 32-bit field
+        for (const char* type : {"stsz", "stz2"}) {
+            start = stblStart;
+            end = stblEnd;
+            if (findBox(data, type, start, end) && end - start >= 12) {
+                return static_cast<int>(qMin<quint32>(qFromBigEndian<quint32>(bytes + start + 8), INT_MAX));
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+// heif_writer callback appending the encoded stream to a QByteArray
+heif_error appendToByteArray(heif_context* ctx, const void* data, size_t size, void* userdata)
+{
+    Q_UNUSED(ctx);
+    static_cast<QByteArray*>(userdata)->append(static_cast<const char*>(data), static_cast<int>(size));
+    heif_error ok = { heif_error_Ok, heif_suberror_Unspecified, "Success" };
+    return ok;
+}
+
+// Copy a decoded interleaved RGBA image into an 8-bit RGBA QImage (RGBX without alpha)
+bool copyImage(const heif_image* heifImage, bool alpha, QImage& image, QString& errorMessage)
+{
+    // Get image dimensions
+    int width = heif_image_get_width(heifImage, heif_channel_interleaved);
+    int height = heif_image_get_height(heifImage, heif_channel_interleaved);
+
+    // Get image data
+    int stride;
+    const uint8_t* pixels = heif_image_get_plane_readonly(heifImage, heif_channel_interleaved, &stride);
+
+    // Create QImage; libheif fills a missing alpha channel as opaque, so
+    // consumers can skip flattening and alpha handling altogether
+    image = BufferPool::createImage(width, height, alpha ? QImage::Format_RGBA8888 : QImage::Format_RGBX8888);
+    if (image.isNull()) {
+        errorMessage = "Failed to allocate image";
+        return false;
+    }
+    for (int y = 0; y < height; ++y) {
+        memcpy(image.scanLine(y), pixels + y * stride, width * 4);
+    }
+    return true;
+}
+
+// Decode an image handle to an 8-bit RGBA QImage (RGBX when it has no alpha)
+bool decodeHandle(heif_image_handle* handle, QImage& image, QString& errorMessage)
+{
+    heif_image* heifImage = nullptr;
+    heif_error error = heif_decode_image(handle, &heifImage, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to decode image: %1").arg(error.message);
+        return false;
+    }
+
+    bool ok = copyImage(heifImage, heif_image_handle_has_alpha_channel(handle) != 0, image, errorMessage);
+    heif_image_release(heifImage);
+    return ok;
+}
+
+// Decode one top-level image of an already parsed file
+bool decodeItem(heif_context* ctx, heif_item_id id, QImage& image, QString& errorMessage)
+{
+    heif_image_handle* handle = nullptr;
+    heif_error error = heif_context_get_image_handle(ctx, id, &handle);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to read HEIF image: %1").arg(error.message);
+        return false;
+    }
+
+    bool ok = decodeHandle(handle, image, errorMessage);
+    heif_image_handle_release(handle);
+    return ok;
+}
+
+// The file is parsed once and its context kept for every frame. A context
+// must not decode on several threads at once, so the next frames are decoded
+// on one pool thread while the caller encodes.
+class HeifCollectionReader : public FrameReader
+{
+public:
+    // Full-resolution frames decoded ahead of the caller; each can be hundreds of MB
+    static const int LOOKAHEAD = 2;
+
+    // Takes ownership of ctx, parsed from data
+    HeifCollectionReader(const QByteArray& data, heif_context* ctx, const QVector<heif_item_id>& ids)
+        : m_data(data), m_ctx(ctx), m_ids(ids), m_next(0), m_scheduled(0)
+    {
+        m_pool.setMaxThreadCount(1);
+    }
+
+    ~HeifCollectionReader() override
+    {
+        m_pool.waitForDone();
+        heif_context_free(m_ctx);
+    }
+
+    int frameCount() const override { return m_ids.size(); }
+
+    bool readFrame(Frame& frame, QString& errorMessage) override
+    {
+        if (m_next >= m_ids.size()) {
+            return false;
+        }
+
+        // Keep LOOKAHEAD decodes in flight, so at most that many frames wait in memory
+        while (m_scheduled < m_ids.size() && m_scheduled < m_next + LOOKAHEAD) {
+            schedule(m_scheduled++);
+        }
+
+        TraceSpan span("HeifHandler::readFrame", "codec");
+        QMutexLocker locker(&m_mutex);
+        while (!m_slots.value(m_next).ready) {
+            m_ready.wait(&m_mutex);
+        }
+        Slot slot = m_slots.take(m_next++);
+        locker.unlock();
+
+        if (slot.image.isNull()) {
+            errorMessage = slot.error;
+            return false;
+        }
+        frame.image = slot.image;
+        frame.durationMs = 0;
+        return true;
+    }
+
+private:
+    struct Slot {
+        QImage image;
+        QString error;
+        bool ready = false;
+    };
+
+    void schedule(int index)
+    {
+        m_pool.start([this, index]() {
+            Slot slot;
+            decodeItem(m_ctx, m_ids[index], slot.image, slot.error);
+            slot.ready = true;
+
+            QMutexLocker locker(&m_mutex);
+            m_slots.insert(index, slot);
+            m_ready.wakeAll();
+        });
+    }
+
+    const QByteArray m_data;      // Backs m_ctx, which reads it without a copy
+    heif_context* m_ctx;
+    const QVector<heif_item_id> m_ids;
+    int m_next;
+    int m_scheduled;
+    QHash<int, Slot> m_slots;   // Decoded ahead, not yet returned
+    QMutex m_mutex;
+    QWaitCondition m_ready;
+    QThreadPool m_pool;
+};
+
+#if LIBHEIF_HAVE_VERSION(1, 20, 0)
+// Frames of an image sequence depend on each other, so they are decoded in order
+class HeifSequenceReader : public FrameReader
+{
+public:
+    // Takes ownership of ctx, parsed from data, and of its track
+    HeifSequenceReader(const QByteArray& data, heif_context* ctx, heif_track* track, int frameCount)
+        : m_data(data), m_ctx(ctx), m_track(track), m_frameCount(frameCount)
+    {
+    }
+
+    ~HeifSequenceReader() override
+    {
+        heif_track_release(m_track);
+        heif_context_free(m_ctx);
+    }
+
+    int frameCount() const override { return m_frameCount; }
+
+    bool readFrame(Frame& frame, QString& errorMessage) override
+    {
+        TraceSpan span("HeifHandler::readFrame", "codec");
+
+        heif_image* heifImage = nullptr;
+        heif_error error = heif_track_decode_next_image(m_track, &heifImage, heif_colorspace_RGB,
+                                                        heif_chroma_interleaved_RGBA, nullptr);
+        if (error.code == heif_error_End_of_sequence) {
+            return false;
+        }
+        if (error.code != heif_error_Ok) {
+            errorMessage = QString("Failed to decode HEIF frame: %1").arg(error.message);
+            return false;
+        }
+
+        bool ok = copyImage(heifImage, true, frame.image, errorMessage);
+        const quint32 timescale = heif_track_get_timescale(m_track);
+        frame.durationMs = timescale > 0 ?
+            static_cast<int>(qint64(heif_image_get_duration(heifImage)) * 1000 / timescale) : 0;
+        heif_image_release(heifImage);
+        return ok;
+    }
+
+private:
+    const QByteArray m_data;      // Backs m_ctx, which reads it without a copy
+    heif_context* m_ctx;
+    heif_track* m_track;
+    const int m_frameCount;
+};
+#endif
+
+} // namespace
 #endif
 
 HeifHandler::HeifHandler()
@@ -26,6 +325,28 @@ bool HeifHandler::isAvailable()
 
 bool HeifHandler::read(const QString& filePath, QImage& image, QString& errorMessage)
 {
+#ifdef HAVE_LIBHEIF
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMessage = "Failed to open file for reading";
+        return false;
+    }
+    QByteArray fileData = file.readAll();
+    file.close();
+
+    return readData(fileData, image, errorMessage);
+#else
+    errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
+    Q_UNUSED(filePath);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool HeifHandler::readData(const QByteArray& data, QImage& image, QString& errorMessage)
+{
+    TraceSpan span("HeifHandler::read", "codec");
+
 #ifdef HAVE_LIBHEIF
     // Create HEIF context
     heif_context* ctx = heif_context_alloc();
@@ -34,8 +355,8 @@ bool HeifHandler::read(const QString& filePath, QImage& image, QString& errorMes
         return false;
     }
 
-    // Read file
-    heif_error error = heif_context_read_from_file(ctx, filePath.toUtf8().constData(), nullptr);
+    // Parse from memory; data outlives the context so no copy is needed
+    heif_error error = heif_context_read_from_memory_without_copy(ctx, data.constData(), data.size(), nullptr);
     if (error.code != heif_error_Ok) {
         errorMessage = QString("Failed to read HEIF file: %1").arg(error.message);
         heif_context_free(ctx);
@@ -52,48 +373,142 @@ bool HeifHandler::read(const QString& filePath, QImage& image, QString& errorMes
     }
 
     // Decode image
-    heif_image* heifImage = nullptr;
-    error = heif_decode_image(handle, &heifImage, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, nullptr);
+    bool ok = decodeHandle(handle, image, errorMessage);
+
+    // Cleanup
+    heif_image_handle_release(handle);
+    heif_context_free(ctx);
+
+    return ok;
+#else
+    errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool HeifHandler::readThumbnail(const QByteArray& data, int minSize, QImage& image,
+                                QSize& imageSize, QString& errorMessage)
+{
+    TraceSpan span("HeifHandler::readThumbnail", "codec");
+
+#ifdef HAVE_LIBHEIF
+    heif_context* ctx = heif_context_alloc();
+    if (!ctx) {
+        errorMessage = "Failed to allocate HEIF context";
+        return false;
+    }
+
+    heif_image_handle* handle = nullptr;
+    heif_error error = heif_context_read_from_memory_without_copy(ctx, data.constData(), data.size(), nullptr);
+    if (error.code == heif_error_Ok) {
+        error = heif_context_get_primary_image_handle(ctx, &handle);
+    }
     if (error.code != heif_error_Ok) {
-        errorMessage = QString("Failed to decode image: %1").arg(error.message);
-        heif_image_handle_release(handle);
+        errorMessage = QString("Failed to read HEIF file: %1").arg(error.message);
         heif_context_free(ctx);
         return false;
     }
 
-    // Get image dimensions
-    int width = heif_image_get_width(heifImage, heif_channel_interleaved);
-    int height = heif_image_get_height(heifImage, heif_channel_interleaved);
+    const int width = heif_image_handle_get_width(handle);
+    const int height = heif_image_handle_get_height(handle);
+    imageSize = QSize(width, height);
 
-    // Get image data
-    int stride;
-    const uint8_t* data = heif_image_get_plane_readonly(heifImage, heif_channel_interleaved, &stride);
+    // Pick the smallest thumbnail covering minSize with the primary image's shape
+    QVector<heif_item_id> ids(heif_image_handle_get_number_of_thumbnails(handle));
+    heif_image_handle_get_list_of_thumbnail_IDs(handle, ids.data(), ids.size());
 
-    // Create QImage
-    image = QImage(width, height, QImage::Format_RGBA8888);
-    for (int y = 0; y < height; ++y) {
-        memcpy(image.scanLine(y), data + y * stride, width * 4);
+    heif_image_handle* best = nullptr;
+    for (heif_item_id id : ids) {
+        heif_image_handle* thumbnail = nullptr;
+        if (heif_image_handle_get_thumbnail(handle, id, &thumbnail).code != heif_error_Ok) {
+            continue;
+        }
+        const int thumbWidth = heif_image_handle_get_width(thumbnail);
+        const int thumbHeight = heif_image_handle_get_height(thumbnail);
+        const bool sameShape = qAbs(qint64(thumbWidth) * height - qint64(thumbHeight) * width) <= qMax(width, height);
+        if (qMax(thumbWidth, thumbHeight) >= minSize && sameShape &&
+            (!best || thumbWidth < heif_image_handle_get_width(best))) {
+            std::swap(best, thumbnail);
+        }
+        if (thumbnail) {
+            heif_image_handle_release(thumbnail);
+        }
+    }
+
+    bool ok = false;
+    if (best) {
+        ok = decodeHandle(best, image, errorMessage);
+        heif_image_handle_release(best);
+    } else {
+        errorMessage = "No embedded thumbnail is large enough";
     }
 
-    // Cleanup
-    heif_image_release(heifImage);
     heif_image_handle_release(handle);
     heif_context_free(ctx);
+    return ok;
+#else
+    errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(minSize);
+    Q_UNUSED(image);
+    Q_UNUSED(imageSize);
+    return false;
+#endif
+}
+
+bool HeifHandler::write(const QString& filePath, const QImage& image, int quality, QString& errorMessage)
+{
+#ifdef HAVE_LIBHEIF
+    QByteArray output;
+    if (!writeData(image, quality, output, errorMessage)) {
+        return false;
+    }
+
+    // Write to file
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = "Failed to open file for writing";
+        return false;
+    }
+
+    qint64 written = file.write(output);
+    file.close();
+
+    if (written != output.size()) {
+        errorMessage = "Failed to write complete file";
+        return false;
+    }
 
     return true;
 #else
     errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
     Q_UNUSED(filePath);
     Q_UNUSED(image);
+    Q_UNUSED(quality);
     return false;
 #endif
 }
 
-bool HeifHandler::write(const QString& filePath, const QImage& image, int quality, QString& errorMessage)
+bool HeifHandler::writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage)
 {
+    return writeData(image, quality, YuvFormat(), output, errorMessage);
+}
+
+bool HeifHandler::writeData(const QImage& image, int quality, const YuvFormat& yuv,
+                            QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("HeifHandler::write", "codec");
+
 #ifdef HAVE_LIBHEIF
-    // Convert image to RGBA format if needed
-    QImage rgbaImage = image.convertToFormat(QImage::Format_RGBA8888);
+    const YuvFormat layout = yuv.resolved(image);
+    const bool wide = layout.bitDepth > 8;
+
+    // Interleaved RGB(A) layouts are read as they are; 16 bits per channel feed deeper YUV
+    const QImage rgbaImage = PixelFormat::negotiate(image, writeFormats(wide),
+                                                    wide ? QImage::Format_RGBA64 : QImage::Format_RGBA8888);
+    const bool packed = rgbaImage.format() == QImage::Format_RGB888;
 
     // Create HEIF context
     heif_context* ctx = heif_context_alloc();
@@ -114,10 +529,18 @@ bool HeifHandler::write(const QString& filePath, const QImage& image, int qualit
     // Set quality
     heif_encoder_set_lossy_quality(encoder, quality > 0 ? quality : 90);
 
+    // The encoder converts RGB to YUV itself; its "chroma" parameter picks the
+    // subsampling (encoders without the parameter keep their default)
+    const char* chroma = layout.chroma == ChromaSubsampling::YUV444 ? "444" :
+                         layout.chroma == ChromaSubsampling::YUV422 ? "422" : "420";
+    heif_encoder_set_parameter_string(encoder, "chroma", chroma);
+
     // Create HEIF image
     heif_image* heifImage = nullptr;
-    error = heif_image_create(rgbaImage.width(), rgbaImage.height(),
-                               heif_colorspace_RGB, heif_chroma_interleaved_RGBA, &heifImage);
+    error = heif_image_create(rgbaImage.width(), rgbaImage.height(), heif_colorspace_RGB,
+                               wide ? heif_chroma_interleaved_RRGGBBAA_LE :
+                               packed ? heif_chroma_interleaved_RGB : heif_chroma_interleaved_RGBA,
+                               &heifImage);
     if (error.code != heif_error_Ok) {
         errorMessage = QString("Failed to create HEIF image: %1").arg(error.message);
         heif_encoder_release(encoder);
@@ -127,7 +550,8 @@ bool HeifHandler::write(const QString& filePath, const QImage& image, int qualit
 
     // Add plane
     error = heif_image_add_plane(heifImage, heif_channel_interleaved,
-                                  rgbaImage.width(), rgbaImage.height(), 32);
+                                  rgbaImage.width(), rgbaImage.height(),
+                                  wide ? layout.bitDepth : packed ? 24 : 32);
     if (error.code != heif_error_Ok) {
         errorMessage = QString("Failed to add image plane: %1").arg(error.message);
         heif_image_release(heifImage);
@@ -138,9 +562,19 @@ bool HeifHandler::write(const QString& filePath, const QImage& image, int qualit
 
     // Copy image data
     int stride;
-    uint8_t* data = heif_image_get_plane(heifImage, heif_channel_interleaved, &stride);
+    uint8_t* pixels = heif_image_get_plane(heifImage, heif_channel_interleaved, &stride);
     for (int y = 0; y < rgbaImage.height(); ++y) {
-        memcpy(data + y * stride, rgbaImage.scanLine(y), rgbaImage.width() * 4);
+        if (!wide) {
+            memcpy(pixels + y * stride, rgbaImage.constScanLine(y), rgbaImage.width() * (packed ? 3 : 4));
+            continue;
+        }
+        // Little-endian samples holding bitDepth significant bits
+        const quint16* source = reinterpret_cast<const quint16*>(rgbaImage.constScanLine(y));
+        uint8_t* destination = pixels + y * stride;
+        const int shift = 16 - layout.bitDepth;
+        for (int i = 0; i < rgbaImage.width() * 4; ++i) {
+            qToLittleEndian<quint16>(source[i] >> shift, destination + i * 2);
+        }
     }
 
     // Encode image
@@ -154,10 +588,14 @@ bool HeifHandler::write(const QString& filePath, const QImage& image, int qualit
         return false;
     }
 
-    // Write to file
-    error = heif_context_write_to_file(ctx, filePath.toUtf8().constData());
+    // Serialize into the output buffer
+    output.clear();
+    heif_writer writer;
+    writer.writer_api_version = 1;
+    writer.write = &appendToByteArray;
+    error = heif_context_write(ctx, &writer, &output);
     if (error.code != heif_error_Ok) {
-        errorMessage = QString("Failed to write file: %1").arg(error.message);
+        errorMessage = QString("Failed to write HEIF data: %1").arg(error.message);
         heif_image_handle_release(handle);
         heif_image_release(heifImage);
         heif_encoder_release(encoder);
@@ -174,9 +612,104 @@ bool HeifHandler::write(const QString& filePath, const QImage& image, int qualit
     return true;
 #else
     errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
-    Q_UNUSED(filePath);
     Q_UNUSED(image);
     Q_UNUSED(quality);
+    Q_UNUSED(yuv);
+    Q_UNUSED(output);
     return false;
 #endif
 }
+
+QVector<QImage::Format> HeifHandler::writeFormats(bool wide)
+{
+    if (wide) {
+        return {QImage::Format_RGBA64, QImage::Format_RGBX64};
+    }
+    // Opaque images converted anyway go to packed RGB, which carries no alpha plane
+    return {QImage::Format_RGBA8888, QImage::Format_RGB888, QImage::Format_RGBX8888};
+}
+
+std::unique_ptr<FrameReader> HeifHandler::createCollectionReader(const QByteArray& data, QString& errorMessage)
+{
+#ifdef HAVE_LIBHEIF
+    heif_context* ctx = heif_context_alloc();
+    if (!ctx) {
+        errorMessage = "Failed to allocate HEIF context";
+        return nullptr;
+    }
+
+    heif_error error = heif_context_read_from_memory_without_copy(ctx, data.constData(), data.size(), nullptr);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to read HEIF file: %1").arg(error.message);
+        heif_context_free(ctx);
+        return nullptr;
+    }
+
+#if LIBHEIF_HAVE_VERSION(1, 20, 0)
+    // Image sequences are tracks ('msf1' brand with 'pict' or 'vide' handlers) and play as animations
+    if (heif_context_has_sequence(ctx)) {
+        const int frameCount = sequenceSampleCount(data);
+        heif_track* track = heif_context_get_track(ctx, 0);
+        if (track && frameCount > 0) {
+            return std::unique_ptr<FrameReader>(new HeifSequenceReader(data, ctx, track, frameCount));
+        }
+        if (track) {
+            heif_track_release(track);
+        }
+    }
+#endif
+
+    // A slideshow group lists its frames in order. Other top-level images
+    // ('altr' alternatives, 'brst' bursts, unrelated images) do not make an
+    // animation, so only the primary image is read from those files.
+    QVector<heif_item_id> ids;
+#if LIBHEIF_HAVE_VERSION(1, 18, 0)
+    const uint32_t slideshow = (uint32_t('s') << 24) | (uint32_t('l') << 16) | (uint32_t('i') << 8) | 'd';
+    int groupCount = 0;
+    heif_entity_group* groups = heif_context_get_entity_groups(ctx, slideshow, 0, &groupCount);
+    if (groups && groupCount > 0) {
+        for (uint32_t i = 0; i < groups[0].num_entities; ++i) {
+            ids.append(groups[0].entities[i]);
+        }
+    }
+    if (groups) {
+        heif_entity_groups_release(groups, groupCount);
+    }
+#endif
+    if (ids.isEmpty()) {
+        heif_item_id primary = 0;
+        error = heif_context_get_primary_image_ID(ctx, &primary);
+        if (error.code != heif_error_Ok) {
+            errorMessage = QString("Failed to get image handle: %1").arg(error.message);
+            heif_context_free(ctx);
+            return nullptr;
+        }
+        ids.append(primary);
+    }
+
+    return std::unique_ptr<FrameReader>(new HeifCollectionReader(data, ctx, ids));
+#else
+    errorMessage = "HEIF support not compiled. Install libheif and rebuild with HAVE_LIBHEIF defined.";
+    Q_UNUSED(data);
+    return nullptr;
+#endif
+}
+
+bool HeifHandler::mayHaveFrames(const QByteArray& data)
+{
+    // Image sequences keep their tracks in a top-level 'moov' box
+    qint64 offset = 0;
+    qint64 end = data.size();
+    if (findBox(data, "moov", offset, end)) {
+        return true;
+    }
+
+    // Slideshows are entity groups in the 'grpl' box of 'meta', a full box
+    offset = 0;
+    end = data.size();
+    if (!findBox(data, "meta", offset, end)) {
+        return false;
+    }
+    offset += 4;
+    return findBox(data, "grpl", offset, end);
+}
@@ -3,6 +3,10 @@
 
 #include <QImage>
 #include <QString>
+#include <QVector>
+#include <memory>
+#include "framestream.h"
+#include "yuvformat.h"
 
 /**
  * @brief Handler for HEIC/HEIF image format using libheif
@@ -31,6 +35,15 @@ public:
      */
     static bool read(const QString& filePath, QImage& image, QString& errorMessage);
 
+    /**
+     * @brief Decode a HEIC/HEIF image held in memory
+     * @param data Encoded file contents
+     * @param image Output QImage: RGBA8888 if the image has alpha, RGBX8888 otherwise
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool readData(const QByteArray& data, QImage& image, QString& errorMessage);
+
     /**
      * @brief Write a QImage to HEIC/HEIF format
      * @param filePath Path to the output file
@@ -40,6 +53,73 @@ public:
      * @return true if successful, false otherwise
      */
     static bool write(const QString& filePath, const QImage& image, int quality, QString& errorMessage);
+
+    /**
+     * @brief Decode the smallest embedded thumbnail that is large enough
+     *
+     * Thumbnails are tiny next to the primary image, so this is far cheaper
+     * than readData() when only a small image is needed. Thumbnails whose
+     * aspect ratio differs from the primary image (letterboxed) are skipped.
+     *
+     * @param data Encoded file contents
+     * @param minSize Smallest acceptable longer side in pixels
+     * @param image Output QImage (the thumbnail)
+     * @param imageSize Output size of the primary image
+     * @param errorMessage Output error message if no thumbnail fits
+     * @return true if a thumbnail was decoded, false otherwise
+     */
+    static bool readThumbnail(const QByteArray& data, int minSize, QImage& image,
+                              QSize& imageSize, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to HEIC/HEIF in memory
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 90)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to HEIC/HEIF in memory with a chosen YUV layout
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 90)
+     * @param yuv Chroma subsampling and bit depth (Auto is resolved from the image)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, const YuvFormat& yuv,
+                          QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     * @param wide true for output above 8 bits per channel
+     */
+    static QVector<QImage::Format> writeFormats(bool wide);
+
+    /**
+     * @brief Check from the box structure whether a HEIF file may be animated
+     *
+     * True for image sequences (a 'moov' box) and files with entity groups,
+     * which may hold a slideshow; other files are read as their primary image.
+     */
+    static bool mayHaveFrames(const QByteArray& data);
+
+    /**
+     * @brief Open the frames of a HEIF file
+     *
+     * Image sequences are decoded track sample by sample (libheif 1.20 and
+     * later). Slideshow groups give their images in order, decoded a few
+     * ahead on a background thread; any other file gives its primary image
+     * as the only frame, so alternatives and bursts are not animated.
+     *
+     * @param data Encoded file contents; must outlive the reader
+     * @param errorMessage Output error message if parsing fails
+     * @return The reader, or nullptr on failure
+     */
+    static std::unique_ptr<FrameReader> createCollectionReader(const QByteArray& data, QString& errorMessage);
 };
 
 #endif // HEIFHANDLER_H
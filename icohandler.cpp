@@ -1,4 +1,5 @@
 #include "icohandler.h"
+#include "tracer.h"
 
 #include <QFile>
 #include <QBuffer>
@@ -35,6 +36,20 @@ bool IcoHandler::read(const QString& filePath, QImage& image, QString& errorMess
     return false;
 }
 
+bool IcoHandler::readData(const QByteArray& data, QImage& image, QString& errorMessage)
+{
+    if (image.loadFromData(data, "ICO")) {
+        return true;
+    }
+
+    if (image.loadFromData(data)) {
+        return true;
+    }
+
+    errorMessage = "Failed to load ICO data";
+    return false;
+}
+
 bool IcoHandler::write(const QString& filePath, const QImage& image, QString& errorMessage)
 {
     return write(filePath, image, STANDARD_SIZES, errorMessage);
@@ -43,6 +58,32 @@ bool IcoHandler::write(const QString& filePath, const QImage& image, QString& er
 bool IcoHandler::write(const QString& filePath, const QImage& image,
                        const QList<int>& sizes, QString& errorMessage)
 {
+    QByteArray output;
+    if (!writeData(image, sizes, output, errorMessage)) {
+        return false;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = "Failed to open file for writing";
+        return false;
+    }
+
+    qint64 written = file.write(output);
+    file.close();
+
+    if (written != output.size()) {
+        errorMessage = "Failed to write complete file";
+        return false;
+    }
+    return true;
+}
+
+bool IcoHandler::writeData(const QImage& image, const QList<int>& sizes,
+                           QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("IcoHandler::write", "codec");
+
     if (image.isNull()) {
         errorMessage = "Source image is null";
         return false;
@@ -53,24 +94,20 @@ bool IcoHandler::write(const QString& filePath, const QImage& image,
         return false;
     }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly)) {
-        errorMessage = "Failed to open file for writing";
-        return false;
-    }
-
     // Prepare PNG data for each size
     QList<QByteArray> pngDataList;
     for (int size : sizes) {
         QByteArray pngData = createPngData(image, size);
         if (pngData.isEmpty()) {
             errorMessage = QString("Failed to create PNG data for size %1").arg(size);
-            file.close();
             return false;
         }
         pngDataList.append(pngData);
     }
 
+    QBuffer buffer(&output);
+    buffer.open(QIODevice::WriteOnly);
+
     // Calculate offsets
     int headerSize = sizeof(ICONDIR) + sizes.count() * sizeof(ICONDIRENTRY);
     QList<quint32> offsets;
@@ -85,7 +122,7 @@ bool IcoHandler::write(const QString& filePath, const QImage& image,
     iconDir.idReserved = 0;
     iconDir.idType = 1; // Icon
     iconDir.idCount = sizes.count();
-    file.write(reinterpret_cast<const char*>(&iconDir), sizeof(ICONDIR));
+    buffer.write(reinterpret_cast<const char*>(&iconDir), sizeof(ICONDIR));
 
     // Write ICONDIRENTRY for each size
     for (int i = 0; i < sizes.count(); ++i) {
@@ -99,15 +136,15 @@ bool IcoHandler::write(const QString& filePath, const QImage& image,
         entry.wBitCount = 32; // 32-bit RGBA
         entry.dwBytesInRes = pngDataList[i].size();
         entry.dwImageOffset = offsets[i];
-        file.write(reinterpret_cast<const char*>(&entry), sizeof(ICONDIRENTRY));
+        buffer.write(reinterpret_cast<const char*>(&entry), sizeof(ICONDIRENTRY));
     }
 
     // Write PNG data for each size
     for (const QByteArray& pngData : pngDataList) {
-        file.write(pngData);
+        buffer.write(pngData);
     }
 
-    file.close();
+    buffer.close();
     return true;
 }
 
@@ -35,6 +35,15 @@ public:
      */
     static bool read(const QString& filePath, QImage& image, QString& errorMessage);
 
+    /**
+     * @brief Decode an ICO file held in memory
+     * @param data Encoded file contents
+     * @param image Output QImage (largest size in the ICO)
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool readData(const QByteArray& data, QImage& image, QString& errorMessage);
+
     /**
      * @brief Write a QImage to ICO format with multiple sizes
      * @param filePath Path to the output file
@@ -51,6 +60,17 @@ public:
      */
     static bool write(const QString& filePath, const QImage& image, QString& errorMessage);
 
+    /**
+     * @brief Encode a QImage to a multi-size ICO in memory
+     * @param image The source QImage to convert
+     * @param sizes List of sizes to include
+     * @param output Output buffer receiving the ICO file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, const QList<int>& sizes,
+                          QByteArray& output, QString& errorMessage);
+
 private:
     // ICO file format structures
     #pragma pack(push, 1)
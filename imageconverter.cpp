@@ -1,14 +1,202 @@
 #include "imageconverter.h"
 #include "heifhandler.h"
 #include "avifhandler.h"
+#include "bufferpool.h"
+#include "filecopy.h"
+#include "framestream.h"
 #include "icohandler.h"
+#include "jpeghandler.h"
+#include "outputwriter.h"
+#include "pixelformat.h"
+#include "pnghandler.h"
+#include "pngoptimizer.h"
+#include "qualitysearch.h"
+#include "thumbnailloader.h"
+#include "tracer.h"
+#include "webphandler.h"
+#include "yuvtranscoder.h"
 
 #include <QImage>
+#include <QBuffer>
+#include <QFile>
 #include <QFileInfo>
 #include <QDir>
 #include <QImageReader>
 #include <QImageWriter>
 #include <QPainter>
+#include <QMutex>
+#include <QSet>
+#include <QtEndian>
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+WebpHandler::Settings webpSettings(const ConversionOptions& options)
+{
+    WebpHandler::Settings settings;
+    settings.method = options.webpMethod;
+    settings.lossless = options.webpLossless;
+    settings.nearLossless = options.webpNearLossless;
+    settings.alphaQuality = options.webpAlphaQuality;
+    return settings;
+}
+
+// Source-over onto white of one straight-alpha channel
+inline uchar blendOnWhite(uint channel, uint alpha)
+{
+    return static_cast<uchar>((channel * alpha + 255 * (255 - alpha) + 127) / 255);
+}
+
+// Whether the options ask the encoder for anything a copy of the source would not give
+bool requestsTransform(ImageConverter::Format format, const ConversionOptions& options)
+{
+    using Format = ImageConverter::Format;
+    const ConversionOptions defaults;
+    if (options.targetBytes > 0 || options.minSsim > 0 || !options.region.isEmpty()) {
+        return true;
+    }
+    if (options.quality >= 0 && ImageConverter::hasQualitySetting(format)) {
+        return true;
+    }
+    switch (format) {
+        case Format::JPEG:
+            return options.progressive || options.fastDct || options.yuv.chroma != ChromaSubsampling::Auto;
+        case Format::PNG:
+            return options.pngOptimizeMs > 0 || options.pngFastEncode;
+        case Format::WebP:
+            return options.webpMethod != defaults.webpMethod || options.webpLossless != defaults.webpLossless ||
+                   options.webpNearLossless != defaults.webpNearLossless ||
+                   options.webpAlphaQuality != defaults.webpAlphaQuality;
+        case Format::HEIC:
+        case Format::AVIF:
+            return options.yuv.chroma != ChromaSubsampling::Auto || options.yuv.bitDepth != 0;
+        case Format::TIFF:
+            return options.tiff.compression != defaults.tiff.compression ||
+                   options.tiff.predictor != defaults.tiff.predictor ||
+                   options.tiff.tileSize != defaults.tiff.tileSize;
+        default:
+            return false;
+    }
+}
+
+// Major and compatible brands of an ISO-BMFF 'ftyp' box; empty if there is none
+QList<QByteArray> ftypBrands(const QByteArray& data)
+{
+    QList<QByteArray> brands;
+    if (data.size() < 16 || data.mid(4, 4) != "ftyp") {
+        return brands;
+    }
+
+    quint32 boxSize = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data.constData()));
+    int end = qMin(static_cast<int>(qMin<quint32>(boxSize, 4096)), static_cast<int>(data.size()));
+
+    // Major brand at offset 8, compatible brands from offset 16
+    brands.append(data.mid(8, 4));
+    for (int offset = 16; offset + 4 <= end; offset += 4) {
+        brands.append(data.mid(offset, 4));
+    }
+    return brands;
+}
+
+// Whether a TIFF header's first IFD links to a second one; true if the header cannot tell
+bool tiffHasSecondIfd(const QByteArray& data)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    const quint64 size = static_cast<quint64>(data.size());
+    const bool little = bytes[0] == 'I';
+    auto read16 = [&](quint64 offset) -> quint64 {
+        return little ? qFromLittleEndian<quint16>(bytes + offset) : qFromBigEndian<quint16>(bytes + offset);
+    };
+    auto read32 = [&](quint64 offset) -> quint64 {
+        return little ? qFromLittleEndian<quint32>(bytes + offset) : qFromBigEndian<quint32>(bytes + offset);
+    };
+    auto read64 = [&](quint64 offset) -> quint64 {
+        return little ? qFromLittleEndian<quint64>(bytes + offset) : qFromBigEndian<quint64>(bytes + offset);
+    };
+
+    // Classic TIFF: 32-bit offsets and 12-byte entries; BigTIFF (version 43): 64-bit and 20-byte
+    const bool big = read16(2) == 43;
+    if (size < (big ? 16u : 8u)) {
+        return true;
+    }
+    const quint64 ifd = big ? read64(8) : read32(4);
+    if (ifd > size || size - ifd < (big ? 8u : 2u)) {
+        return true;
+    }
+    const quint64 count = big ? read64(ifd) : read16(ifd);
+    if (count > size) {
+        return true;
+    }
+    const quint64 next = ifd + (big ? 8 + count * 20 : 2 + count * 12);
+    if (next > size || size - next < (big ? 8u : 4u)) {
+        return true;
+    }
+    return (big ? read64(next) : read32(next)) != 0;
+}
+
+// Whether encoded data, judged by its leading bytes, is already in the target format
+bool isEncodedAs(const QByteArray& header, ImageConverter::Format format)
+{
+    using Format = ImageConverter::Format;
+    const QString detected = ImageConverter::detectFormat(header);
+    switch (format) {
+        case Format::JPEG:
+            return detected == "jpeg";
+        case Format::PNG:
+            return detected == "png";
+        case Format::WebP:
+            return detected == "webp";
+        case Format::AVIF:
+            return detected == "avif";
+        case Format::HEIC:
+            // Only HEVC-coded HEIF; other HEIF brands would not be HEIC
+            return detected == "heif" && (header.mid(8, 4) == "heic" || header.mid(8, 4) == "heix");
+        case Format::GIF:
+            return header.startsWith("GIF87a") || header.startsWith("GIF89a");
+        case Format::TIFF:
+            return header.startsWith(QByteArray("II*\0", 4)) || header.startsWith(QByteArray("MM\0*", 4));
+        case Format::BMP:
+            return header.startsWith("BM");
+        case Format::ICO:
+            return header.startsWith(QByteArray("\0\0\1\0", 4));
+    }
+    return false;
+}
+
+// Output paths handed out but not written yet, so parallel conversions of
+// same-named inputs never pick the same name
+struct OutputReservations {
+    QMutex mutex;
+    QSet<QString> paths;
+};
+
+OutputReservations& outputReservations()
+{
+    static OutputReservations reservations;
+    return reservations;
+}
+
+// Releases a path reserved by generateOutputPath once its file is written or abandoned
+class OutputReservation
+{
+public:
+    explicit OutputReservation(const QString& path)
+        : m_path(path)
+    {
+    }
+
+    ~OutputReservation()
+    {
+        QMutexLocker locker(&outputReservations().mutex);
+        outputReservations().paths.remove(m_path);
+    }
+
+private:
+    QString m_path;
+};
+
+} // namespace
 
 ImageConverter::ImageConverter(QObject *parent)
     : QObject(parent)
@@ -16,6 +204,25 @@ ImageConverter::ImageConverter(QObject *parent)
 }
 
 ConversionResult ImageConverter::convert(const QString& inputPath, const QString& outputFolder, Format targetFormat, int quality)
+{
+    ConversionOptions options;
+    options.quality = quality;
+    return convert(inputPath, outputFolder, targetFormat, options);
+}
+
+ConversionResult ImageConverter::convert(const QString& inputPath, const QString& outputFolder, Format targetFormat,
+                                         const ConversionOptions& options)
+{
+    // Without a writer every path completes before returning
+    ConversionResult result;
+    convert(inputPath, outputFolder, targetFormat, options, nullptr,
+            [&result](const ConversionResult& converted) { result = converted; });
+    return result;
+}
+
+void ImageConverter::convert(const QString& inputPath, const QString& outputFolder, Format targetFormat,
+                             const ConversionOptions& options, OutputWriter* writer,
+                             const std::function<void(const ConversionResult&)>& done)
 {
     ConversionResult result;
     result.inputFile = inputPath;
@@ -25,48 +232,348 @@ ConversionResult ImageConverter::convert(const QString& inputPath, const QString
     QFileInfo inputInfo(inputPath);
     if (!inputInfo.exists()) {
         result.errorMessage = "Input file does not exist";
+        done(result);
+        return;
+    }
+
+    QByteArray header;
+    {
+        QFile inputFile(inputPath);
+        if (inputFile.open(QIODevice::ReadOnly)) {
+            header = inputFile.read(4096);
+        }
+    }
+
+    // Inputs already in the target format, with nothing asked of the encoder, are copied as they are
+    if (!options.forceReencode && !requestsTransform(targetFormat, options)) {
+        if (isEncodedAs(header, targetFormat)) {
+            result.outputFile = generateOutputPath(inputPath, outputFolder, targetFormat);
+            OutputReservation reservation(result.outputFile);
+            QFileInfo outputInfo(result.outputFile);
+            QDir().mkpath(outputInfo.absolutePath());
+            if (outputInfo.exists() && outputInfo.canonicalFilePath() == inputInfo.canonicalFilePath()) {
+                result.outputSize = inputInfo.size();
+                result.success = true;
+            } else {
+                result.success = FileCopy::copy(inputPath, result.outputFile, result.outputSize,
+                                                result.errorMessage);
+            }
+            done(result);
+            return;
+        }
+    }
+
+    QByteArray outputData;
+    if (!options.region.isEmpty() && TiffHandler::isAvailable() && isEncodedAs(header, Format::TIFF)) {
+        // A region of a TIFF reads only the tiles or strips it covers, not the whole file
+        QImage image;
+        if (!TiffHandler::readRegion(inputPath, options.region, image, result.errorMessage) ||
+            !encode(image, targetFormat, options, outputData, result.errorMessage)) {
+            done(result);
+            return;
+        }
+    } else {
+        // Read the whole input; decoding happens in memory
+        QByteArray inputData;
+        {
+            TraceSpan readSpan("readInput", "io", inputPath);
+            QFile inputFile(inputPath);
+            if (!inputFile.open(QIODevice::ReadOnly)) {
+                result.errorMessage = "Failed to open input file";
+                done(result);
+                return;
+            }
+            inputData = inputFile.readAll();
+        }
+
+        if (!convertData(inputData, targetFormat, options, outputData, result.errorMessage,
+                         inputInfo.suffix().toLower())) {
+            done(result);
+            return;
+        }
+    }
+
+    // Generate output path, held until the file is in place
+    result.outputFile = generateOutputPath(inputPath, outputFolder, targetFormat);
+    auto reservation = std::make_shared<OutputReservation>(result.outputFile);
+
+    // Ensure output directory exists
+    QFileInfo outputInfo(result.outputFile);
+    QDir().mkpath(outputInfo.absolutePath());
+
+    if (!writer) {
+        result.success = OutputWriter::writeFile(result.outputFile, outputData, result.errorMessage);
+        result.outputSize = result.success ? outputData.size() : 0;
+        done(result);
+        return;
+    }
+
+    // The writer finishes the result; this thread moves on to the next file
+    const qint64 outputSize = outputData.size();
+    writer->submit(result.outputFile, outputData,
+                   [result, outputSize, reservation, done](bool written, const QString& errorMessage) mutable {
+        result.success = written;
+        if (written) {
+            result.outputSize = outputSize;
+        } else {
+            result.errorMessage = errorMessage;
+        }
+        reservation.reset();
+        done(result);
+    });
+}
+
+ConversionResult ImageConverter::convertDuplicate(const QString& inputPath, const QString& outputFolder,
+                                                  Format targetFormat, const ConversionResult& original)
+{
+    ConversionResult result;
+    result.inputFile = inputPath;
+    result.duplicateOf = original.inputFile;
+    result.success = false;
+
+    // Same content, same outcome
+    if (!original.success) {
+        result.errorMessage = original.errorMessage;
         return result;
     }
 
-    // Load the image
+    result.outputFile = generateOutputPath(inputPath, outputFolder, targetFormat);
+    OutputReservation reservation(result.outputFile);
+    QFileInfo outputInfo(result.outputFile);
+    QDir().mkpath(outputInfo.absolutePath());
+
+    // An output path naming the input itself is overwritten, as convert() would
+    bool written;
+    if (outputInfo.exists()) {
+        written = FileCopy::copy(original.outputFile, result.outputFile, result.outputSize, result.errorMessage);
+    } else {
+        written = FileCopy::linkOrCopy(original.outputFile, result.outputFile, result.outputSize,
+                                       result.errorMessage);
+    }
+    result.success = written;
+    return result;
+}
+
+bool ImageConverter::convertData(const QByteArray& input, Format targetFormat, int quality,
+                                 QByteArray& output, QString& errorMessage,
+                                 const QString& formatHint)
+{
+    ConversionOptions options;
+    options.quality = quality;
+    return convertData(input, targetFormat, options, output, errorMessage, formatHint);
+}
+
+bool ImageConverter::convertData(const QByteArray& input, Format targetFormat, const ConversionOptions& options,
+                                 QByteArray& output, QString& errorMessage,
+                                 const QString& formatHint)
+{
+    // Already in the target format, with nothing asked of the encoder
+    if (!options.forceReencode && !requestsTransform(targetFormat, options) &&
+        isEncodedAs(input.left(4096), targetFormat)) {
+        output = input;
+        return true;
+    }
+
+    // Animations, sequences and collections keep every frame if the target can hold them
+    const bool cropped = !options.region.isEmpty();
+    if (supportsAnimation(targetFormat) && !cropped && mayHaveFrames(input)) {
+        QString openError;
+        std::unique_ptr<FrameReader> reader = FrameReader::open(input, formatHint, openError);
+        if (reader && reader->frameCount() > 1) {
+            return convertFrames(*reader, targetFormat, options, output, errorMessage);
+        }
+    }
+
+    // HEIC to AVIF at a fixed quality can hand the YUV planes straight over
+    if (targetFormat == Format::AVIF && options.targetBytes <= 0 && options.minSsim <= 0 && !cropped &&
+        YuvTranscoder::isAvailable() && detectFormat(input) == "heif") {
+        QString transcodeError;
+        if (YuvTranscoder::heifToAvif(input, options.quality, options.yuv, output, transcodeError)) {
+            return true;
+        }
+        // Layouts the direct path cannot carry go through RGB as before
+    }
+
+    // Trusted PNG inputs skip checksum verification
     QImage image;
-    QString inputSuffix = inputInfo.suffix().toLower();
+    QString pngError;
+    const bool trustedPng = options.trustedInput && PngHandler::isAvailable() && detectFormat(input) == "png" &&
+                            PngHandler::readData(input, true, image, pngError);
+    if (!trustedPng) {
+        // Small targets such as icons only need a reduced decode; a region needs full size
+        QSize imageSize;
+        if (!decode(input, formatHint, cropped ? 0 : decodeSizeFor(targetFormat), image, imageSize,
+                    errorMessage)) {
+            return false;
+        }
+    }
+
+    if (cropped) {
+        const QRect bounds = options.region & image.rect();
+        if (bounds.isEmpty()) {
+            errorMessage = "Region lies outside the image";
+            return false;
+        }
+        image = image.copy(bounds);
+    }
+    return encode(image, targetFormat, options, output, errorMessage);
+}
+
+bool ImageConverter::decode(const QByteArray& data, const QString& formatHint,
+                            QImage& image, QString& errorMessage)
+{
+    // Trust the container over the suffix (e.g. HEIC photos saved as .jpg)
+    QString format = detectFormat(data);
+    if (format.isEmpty()) {
+        format = formatHint;
+    }
 
     // Check if input is HEIC/HEIF
-    if (inputSuffix == "heic" || inputSuffix == "heif") {
+    if (format == "heic" || format == "heif") {
         QString heifError;
-        if (!HeifHandler::read(inputPath, image, heifError)) {
+        if (!HeifHandler::readData(data, image, heifError)) {
             // Try Qt's native loading as fallback (in case of Qt plugin)
-            if (!image.load(inputPath)) {
-                result.errorMessage = heifError.isEmpty() ?
+            TraceSpan loadSpan("QImage::load", "codec");
+            if (!image.loadFromData(data)) {
+                errorMessage = heifError.isEmpty() ?
                     "Failed to load HEIC/HEIF image" : heifError;
-                return result;
+                return false;
+            }
+        }
+    }
+    // Check if input is JPEG and libjpeg-turbo can take it
+    else if (format == "jpeg" && JpegHandler::isAvailable()) {
+        QString jpegError;
+        if (!JpegHandler::readData(data, image, jpegError)) {
+            // Qt's plugin also handles CMYK files
+            TraceSpan loadSpan("QImage::load", "codec");
+            if (!image.loadFromData(data, "jpeg")) {
+                errorMessage = jpegError;
+                return false;
+            }
+        }
+    }
+    // Check if input is PNG and libspng can take it
+    else if (format == "png" && PngHandler::isAvailable()) {
+        QString pngError;
+        if (!PngHandler::readData(data, false, image, pngError)) {
+            TraceSpan loadSpan("QImage::load", "codec");
+            if (!image.loadFromData(data, "png")) {
+                errorMessage = pngError;
+                return false;
+            }
+        }
+    }
+    // Check if input is a still WebP and libwebp can take it
+    else if (format == "webp" && WebpHandler::isAvailable()) {
+        QString webpError;
+        if (!WebpHandler::readData(data, image, webpError)) {
+            // Qt's plugin, if installed, returns the first frame of animations
+            TraceSpan loadSpan("QImage::load", "codec");
+            if (!image.loadFromData(data, "webp")) {
+                errorMessage = webpError;
+                return false;
             }
         }
     }
     // Check if input is AVIF
-    else if (inputSuffix == "avif") {
+    else if (format == "avif") {
         QString avifError;
-        if (!AvifHandler::read(inputPath, image, avifError)) {
+        if (!AvifHandler::readData(data, image, avifError)) {
             // Try Qt's native loading as fallback (in case of Qt plugin)
-            if (!image.load(inputPath)) {
-                result.errorMessage = avifError.isEmpty() ?
+            TraceSpan loadSpan("QImage::load", "codec");
+            if (!image.loadFromData(data)) {
+                errorMessage = avifError.isEmpty() ?
                     "Failed to load AVIF image" : avifError;
-                return result;
+                return false;
             }
         }
     }
-    else if (!image.load(inputPath)) {
-        result.errorMessage = "Failed to load image. Format may not be supported.";
-        return result;
+    else {
+        // Qt falls back to probing the content if the hint is wrong
+        TraceSpan loadSpan("QImage::load", "codec");
+        QByteArray qtFormat = format.toLatin1();
+        if (!image.loadFromData(data, qtFormat.isEmpty() ? nullptr : qtFormat.constData())) {
+            errorMessage = "Failed to load image. Format may not be supported.";
+            return false;
+        }
     }
 
-    // Generate output path
-    result.outputFile = generateOutputPath(inputPath, outputFolder, targetFormat);
+    return true;
+}
 
-    // Ensure output directory exists
-    QFileInfo outputInfo(result.outputFile);
-    QDir().mkpath(outputInfo.absolutePath());
+bool ImageConverter::decode(const QByteArray& data, const QString& formatHint, int minSize,
+                            QImage& image, QSize& imageSize, QString& errorMessage)
+{
+    if (minSize > 0) {
+        // Embedded thumbnails are the cheapest source of all
+        QString thumbnailError;
+        if (ThumbnailLoader::load(data, minSize, image, imageSize, thumbnailError)) {
+            return true;
+        }
+
+        // libheif and libavif always decode at full size; JPEG and some Qt decoders scale while decoding
+        QString format = detectFormat(data);
+        if (format == "jpeg" && JpegHandler::isAvailable()) {
+            QString jpegError;
+            if (JpegHandler::readData(data, minSize, image, imageSize, jpegError)) {
+                return true;
+            }
+        }
+        if (format != "heif" && format != "avif") {
+            QBuffer buffer;
+            buffer.setData(data);
+            buffer.open(QIODevice::ReadOnly);
+            QImageReader reader(&buffer, format.isEmpty() ? formatHint.toLatin1() : format.toLatin1());
+            imageSize = reader.size();
+
+            if (imageSize.isValid() && qMax(imageSize.width(), imageSize.height()) >= 2 * minSize &&
+                reader.supportsOption(QImageIOHandler::ScaledSize)) {
+                // Pick the largest 1/2^n reduction that still covers minSize, so JPEG decodes
+                // straight to it in the DCT domain with no resampling afterwards
+                const int longer = qMax(imageSize.width(), imageSize.height());
+                int factor = 1;
+                while (factor < 8 && (longer + 2 * factor - 1) / (2 * factor) >= minSize) {
+                    factor *= 2;
+                }
+                reader.setScaledSize(QSize((imageSize.width() + factor - 1) / factor,
+                                           (imageSize.height() + factor - 1) / factor));
+
+                TraceSpan loadSpan("QImageReader::readScaled", "codec");
+                if (reader.read(&image)) {
+                    return true;
+                }
+                // Full decode below if the plugin rejects the scaled read
+            }
+        }
+    }
+
+    if (!decode(data, formatHint, image, errorMessage)) {
+        return false;
+    }
+    imageSize = image.size();
+    return true;
+}
+
+int ImageConverter::decodeSizeFor(Format targetFormat)
+{
+    // Icons are built from the largest icon size down
+    if (targetFormat == Format::ICO) {
+        return *std::max_element(IcoHandler::STANDARD_SIZES.begin(), IcoHandler::STANDARD_SIZES.end());
+    }
+    return 0;
+}
+
+bool ImageConverter::encode(const QImage& source, Format targetFormat, int quality,
+                            QByteArray& output, QString& errorMessage)
+{
+    return encode(source, targetFormat, quality, YuvFormat(), output, errorMessage);
+}
+
+bool ImageConverter::encode(const QImage& source, Format targetFormat, int quality, const YuvFormat& yuv,
+                            QByteArray& output, QString& errorMessage)
+{
+    QImage image = prepareForEncode(source, targetFormat);
 
     // Determine the format string and quality for saving
     const char* formatStr = nullptr;
@@ -76,20 +583,20 @@ ConversionResult ImageConverter::convert(const QString& inputPath, const QString
         case Format::JPEG:
             formatStr = "JPEG";
             if (saveQuality < 0) saveQuality = 90; // Default JPEG quality
-            // Convert to RGB if image has alpha (JPEG doesn't support transparency)
-            if (image.hasAlphaChannel()) {
-                QImage rgbImage(image.size(), QImage::Format_RGB32);
-                rgbImage.fill(Qt::white); // Fill with white background
-                QPainter painter(&rgbImage);
-                painter.drawImage(0, 0, image);
-                painter.end();
-                image = rgbImage;
+            if (JpegHandler::isAvailable()) {
+                return JpegHandler::writeData(image, saveQuality, yuv, JpegHandler::Settings(), output, errorMessage);
             }
             break;
         case Format::PNG:
             formatStr = "PNG";
             // PNG uses compression level 0-9 (via quality), -1 for default
             if (saveQuality < 0) saveQuality = -1;
+            if (PngHandler::isAvailable() && PngHandler::canWrite(image)) {
+                // Same mapping as Qt's writer: quality 0-100 to zlib level 9-0
+                PngHandler::Settings settings;
+                settings.compressionLevel = saveQuality < 0 ? -1 : (100 - qMin(saveQuality, 100)) * 9 / 91;
+                return PngHandler::writeData(image, settings, output, errorMessage);
+            }
             break;
         case Format::GIF:
             formatStr = "GIF";
@@ -104,59 +611,387 @@ ConversionResult ImageConverter::convert(const QString& inputPath, const QString
         case Format::WebP:
             formatStr = "WEBP";
             if (saveQuality < 0) saveQuality = 90;
+            if (WebpHandler::isAvailable()) {
+                return WebpHandler::writeData(image, saveQuality, output, errorMessage);
+            }
             break;
         case Format::TIFF:
             formatStr = "TIFF";
             // TIFF uses lossless compression by default
             // Quality parameter is ignored for TIFF (always lossless)
+            if (TiffHandler::isAvailable()) {
+                return TiffHandler::writeData(image, TiffHandler::Settings(), output, errorMessage);
+            }
             break;
         case Format::HEIC:
             {
                 // Use HeifHandler for HEIC output
                 int heicQuality = (saveQuality < 0) ? 90 : saveQuality;
-                QString heifError;
-                if (HeifHandler::write(result.outputFile, image, heicQuality, heifError)) {
-                    result.success = true;
-                } else {
-                    result.errorMessage = heifError;
-                }
-                return result;
+                return HeifHandler::writeData(image, heicQuality, yuv, output, errorMessage);
             }
         case Format::AVIF:
             {
                 // Use AvifHandler for AVIF output
                 int avifQuality = (saveQuality < 0) ? 80 : saveQuality;
-                QString avifError;
-                if (AvifHandler::write(result.outputFile, image, avifQuality, avifError)) {
-                    result.success = true;
-                } else {
-                    result.errorMessage = avifError;
-                }
-                return result;
+                return AvifHandler::writeData(image, avifQuality, yuv, output, errorMessage);
             }
         case Format::ICO:
             {
                 // Use IcoHandler for ICO output with multiple sizes
-                QString icoError;
-                if (IcoHandler::write(result.outputFile, image, icoError)) {
-                    result.success = true;
-                } else {
-                    result.errorMessage = icoError;
-                }
-                return result;
+                return IcoHandler::writeData(image, IcoHandler::STANDARD_SIZES, output, errorMessage);
             }
     }
 
     // Save the image
-    bool saved = image.save(result.outputFile, formatStr, saveQuality);
+    TraceSpan saveSpan("QImage::save", "codec");
+    output.clear();
+    QBuffer buffer(&output);
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, formatStr, saveQuality)) {
+        errorMessage = "Failed to save image. Check if format is supported.";
+        return false;
+    }
 
-    if (saved) {
-        result.success = true;
-    } else {
-        result.errorMessage = "Failed to save image. Check if format is supported.";
+    return true;
+}
+
+bool ImageConverter::encode(const QImage& image, Format targetFormat, const ConversionOptions& options,
+                            QByteArray& output, QString& errorMessage)
+{
+    if (targetFormat == Format::PNG && options.pngOptimizeMs > 0) {
+        return PngOptimizer::writeData(image, options.pngOptimizeMs, output, errorMessage, options.maxThreads);
+    }
+    if (targetFormat == Format::PNG && options.pngFastEncode &&
+        PngHandler::isAvailable() && PngHandler::canWrite(image)) {
+        PngHandler::Settings settings;
+        settings.compressionLevel = 1;
+        settings.fastFilter = true;
+        return PngHandler::writeData(image, settings, output, errorMessage);
+    }
+    if (targetFormat == Format::TIFF && TiffHandler::isAvailable()) {
+        return TiffHandler::writeData(image, options.tiff, output, errorMessage);
+    }
+    if (!hasQualitySetting(targetFormat)) {
+        return encode(image, targetFormat, options.quality, output, errorMessage);
     }
 
-    return result;
+    // Resolved once, so searches do not re-analyse content (or see a proxy's)
+    YuvFormat yuv = options.yuv;
+    if (targetFormat == Format::HEIC || targetFormat == Format::AVIF ||
+        (targetFormat == Format::JPEG && JpegHandler::isAvailable())) {
+        yuv = yuv.resolved(image);
+    }
+
+    if (options.minSsim > 0) {
+        if (!QualitySearch::encodeToSsim(image, targetFormat, options.minSsim, yuv, output, errorMessage,
+                                         nullptr, options.maxThreads)) {
+            return false;
+        }
+        if (options.targetBytes <= 0 || output.size() <= options.targetBytes) {
+            return true;
+        }
+    }
+    if (options.targetBytes > 0) {
+        return QualitySearch::encodeToSize(image, targetFormat, options.targetBytes, yuv, output, errorMessage);
+    }
+    if (targetFormat == Format::JPEG && (options.progressive || options.fastDct) && JpegHandler::isAvailable()) {
+        JpegHandler::Settings settings;
+        settings.progressive = options.progressive;
+        settings.fastDct = options.fastDct;
+        return JpegHandler::writeData(prepareForEncode(image, targetFormat), options.quality < 0 ? 90 : options.quality,
+                                      yuv, settings, output, errorMessage);
+    }
+    if (targetFormat == Format::WebP && WebpHandler::isAvailable()) {
+        return WebpHandler::writeData(image, options.quality, webpSettings(options), output, errorMessage);
+    }
+    return encode(image, targetFormat, options.quality, yuv, output, errorMessage);
+}
+
+QImage ImageConverter::flattenAlpha(const QImage& image)
+{
+    if (!image.hasAlphaChannel()) {
+        return image;
+    }
+
+    TraceSpan flattenSpan("flattenAlpha", "convert");
+
+    // Straight alpha blends in one pass into the matching opaque layout, with
+    // no detour through premultiplied pixels
+    if (image.format() == QImage::Format_RGBA8888) {
+        QImage rgbImage = BufferPool::createImage(image.size(), QImage::Format_RGBX8888);
+        for (int y = 0; y < image.height(); ++y) {
+            const uchar* in = image.constScanLine(y);
+            uchar* out = rgbImage.scanLine(y);
+            for (int x = 0; x < image.width(); ++x, in += 4, out += 4) {
+                out[0] = blendOnWhite(in[0], in[3]);
+                out[1] = blendOnWhite(in[1], in[3]);
+                out[2] = blendOnWhite(in[2], in[3]);
+                out[3] = 255;
+            }
+        }
+        return rgbImage;
+    }
+    if (image.format() == QImage::Format_ARGB32) {
+        QImage rgbImage = BufferPool::createImage(image.size(), QImage::Format_RGB32);
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb* in = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            QRgb* out = reinterpret_cast<QRgb*>(rgbImage.scanLine(y));
+            for (int x = 0; x < image.width(); ++x) {
+                const uint alpha = qAlpha(in[x]);
+                out[x] = qRgb(blendOnWhite(qRed(in[x]), alpha), blendOnWhite(qGreen(in[x]), alpha),
+                              blendOnWhite(qBlue(in[x]), alpha));
+            }
+        }
+        return rgbImage;
+    }
+
+    QImage rgbImage = BufferPool::createImage(image.size(), QImage::Format_RGB32);
+    rgbImage.fill(Qt::white); // Fill with white background
+    QPainter painter(&rgbImage);
+    painter.drawImage(0, 0, image);
+    painter.end();
+    return rgbImage;
+}
+
+QVector<QImage::Format> ImageConverter::encoderFormats(Format targetFormat)
+{
+    switch (targetFormat) {
+        case Format::JPEG:
+            return JpegHandler::isAvailable() ? JpegHandler::writeFormats() : QVector<QImage::Format>();
+        case Format::PNG:
+            return PngHandler::isAvailable() ? PngHandler::writeFormats() : QVector<QImage::Format>();
+        case Format::WebP:
+            return WebpHandler::isAvailable() ? WebpHandler::writeFormats() : QVector<QImage::Format>();
+        case Format::TIFF:
+            return TiffHandler::isAvailable() ? TiffHandler::writeFormats() : QVector<QImage::Format>();
+        case Format::HEIC:
+            return HeifHandler::writeFormats(false) + HeifHandler::writeFormats(true);
+        case Format::AVIF:
+            return AvifHandler::writeFormats(false) + AvifHandler::writeFormats(true);
+        default:
+            // Qt's writers convert as they need
+            return QVector<QImage::Format>();
+    }
+}
+
+QImage ImageConverter::prepareForEncode(const QImage& image, Format targetFormat)
+{
+    const QImage flat = targetFormat == Format::JPEG ? flattenAlpha(image) : image;
+    return PixelFormat::negotiate(flat, encoderFormats(targetFormat));
+}
+
+bool ImageConverter::supportsAnimation(Format format)
+{
+    return (format == Format::AVIF && AvifHandler::isAvailable()) ||
+           (format == Format::WebP && WebpHandler::isAvailable()) ||
+           (format == Format::TIFF && TiffHandler::isAvailable());
+}
+
+bool ImageConverter::convertFrames(FrameReader& reader, Format targetFormat, const ConversionOptions& options,
+                                   QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("convertFrames", "convert");
+
+    // Sequence writers take one fixed quality; searching one per frame or for the whole file is not done
+    if (options.targetBytes > 0 || options.minSsim > 0) {
+        errorMessage = "Target size and automatic quality are not supported for multi-frame images";
+        return false;
+    }
+
+    std::unique_ptr<FrameWriter> writer;
+    Frame frame;
+    QString readError;
+    while (reader.readFrame(frame, readError)) {
+        // The first frame fixes the layout, so every frame is encoded alike
+        if (!writer) {
+            YuvFormat layout = options.yuv.resolved(frame.image);
+            if (targetFormat == Format::AVIF) {
+                writer = AvifHandler::createSequenceWriter(options.quality, layout, reader.loopCount(),
+                                                           errorMessage);
+            } else if (targetFormat == Format::WebP) {
+                writer = WebpHandler::createAnimationWriter(options.quality, webpSettings(options),
+                                                            reader.loopCount(), errorMessage);
+            } else if (targetFormat == Format::TIFF) {
+                writer = TiffHandler::createPageWriter(options.tiff, errorMessage);
+            } else {
+                errorMessage = QString("%1 output cannot hold multiple frames").arg(getFormatName(targetFormat));
+            }
+            if (!writer) {
+                return false;
+            }
+        }
+
+        if (!writer->addFrame(frame, errorMessage)) {
+            return false;
+        }
+        // Release the decoded frame before the next one is decoded
+        frame = Frame();
+    }
+
+    if (!readError.isEmpty()) {
+        errorMessage = readError;
+        return false;
+    }
+    if (!writer) {
+        errorMessage = "Image has no frames";
+        return false;
+    }
+    return writer->finish(output, errorMessage);
+}
+
+bool ImageConverter::convertToMultiPage(const QStringList& inputPaths, const QString& outputPath,
+                                        const ConversionOptions& options, QString& errorMessage)
+{
+    TraceSpan span("convertToMultiPage", "convert", outputPath);
+
+    std::unique_ptr<FrameWriter> writer = TiffHandler::createPageWriter(options.tiff, errorMessage);
+    if (!writer) {
+        return false;
+    }
+
+    for (const QString& inputPath : inputPaths) {
+        QByteArray input;
+        {
+            TraceSpan readSpan("readInput", "io", inputPath);
+            QFile inputFile(inputPath);
+            if (!inputFile.open(QIODevice::ReadOnly)) {
+                errorMessage = QString("Failed to open input file: %1").arg(inputPath);
+                return false;
+            }
+            input = inputFile.readAll();
+        }
+
+        // Multi-page inputs contribute every page; one decoded page is held at a time
+        const QString suffix = QFileInfo(inputPath).suffix().toLower();
+        QString openError;
+        std::unique_ptr<FrameReader> reader = mayHaveFrames(input) ?
+            FrameReader::open(input, suffix, openError) : nullptr;
+        Frame frame;
+        if (reader && reader->frameCount() > 1) {
+            QString readError;
+            while (reader->readFrame(frame, readError)) {
+                if (!writer->addFrame(frame, errorMessage)) {
+                    return false;
+                }
+                frame = Frame();
+            }
+            if (!readError.isEmpty()) {
+                errorMessage = QString("%1: %2").arg(inputPath, readError);
+                return false;
+            }
+        } else {
+            QString decodeError;
+            if (!decode(input, suffix, frame.image, decodeError)) {
+                errorMessage = QString("%1: %2").arg(inputPath, decodeError);
+                return false;
+            }
+            if (!writer->addFrame(frame, errorMessage)) {
+                return false;
+            }
+        }
+    }
+
+    QByteArray output;
+    if (!writer->finish(output, errorMessage)) {
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(outputPath).absolutePath());
+    return OutputWriter::writeFile(outputPath, output, errorMessage);
+}
+
+bool ImageConverter::hasQualitySetting(Format format)
+{
+    switch (format) {
+        case Format::JPEG:
+        case Format::WebP:
+        case Format::HEIC:
+        case Format::AVIF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+QString ImageConverter::detectFormat(const QByteArray& data)
+{
+    // JPEG: SOI marker followed by another marker
+    if (data.size() >= 3 && data.startsWith("\xFF\xD8\xFF")) {
+        return "jpeg";
+    }
+    // PNG: fixed eight-byte signature
+    if (data.startsWith("\x89PNG\r\n\x1a\n")) {
+        return "png";
+    }
+    // WebP: RIFF container with the WEBP form type
+    if (data.size() >= 12 && data.startsWith("RIFF") && data.mid(8, 4) == "WEBP") {
+        return "webp";
+    }
+
+    // ISO-BMFF files (HEIF, AVIF) start with an 'ftyp' box listing brands
+    const QList<QByteArray> brands = ftypBrands(data);
+    if (brands.isEmpty()) {
+        return QString();
+    }
+
+    // AVIF files also list the generic 'mif1' brand, so check them first
+    for (const QByteArray& brand : brands) {
+        if (brand == "avif" || brand == "avis") {
+            return "avif";
+        }
+    }
+    static const QList<QByteArray> heifBrands = {
+        "heic", "heix", "hevc", "hevx", "heim", "heis", "mif1", "msf1"
+    };
+    for (const QByteArray& brand : brands) {
+        if (heifBrands.contains(brand)) {
+            return "heif";
+        }
+    }
+    return QString();
+}
+
+bool ImageConverter::mayHaveFrames(const QByteArray& data)
+{
+    const QString detected = detectFormat(data);
+    if (detected == "jpeg") {
+        return false;
+    }
+    // APNG: an 'acTL' chunk ahead of the first 'IDAT'
+    if (detected == "png") {
+        const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+        for (qint64 offset = 8; offset + 8 <= data.size();
+             offset += 12 + static_cast<qint64>(qFromBigEndian<quint32>(bytes + offset))) {
+            const QByteArray type = data.mid(offset + 4, 4);
+            if (type == "acTL") {
+                return true;
+            }
+            if (type == "IDAT") {
+                return false;
+            }
+        }
+        return false;
+    }
+    // WebP: animation flag of the extended 'VP8X' header
+    if (detected == "webp") {
+        return data.size() >= 21 && data.mid(12, 4) == "VP8X" && (static_cast<quint8>(data[20]) & 0x02);
+    }
+    // AVIF: only the 'avis' brand marks an image sequence
+    if (detected == "avif") {
+        return ftypBrands(data).contains("avis");
+    }
+    if (data.startsWith(QByteArray("II*\0", 4)) || data.startsWith(QByteArray("MM\0*", 4)) ||
+        data.startsWith(QByteArray("II+\0", 4)) || data.startsWith(QByteArray("MM\0+", 4))) {
+        return tiffHasSecondIfd(data);
+    }
+    if (detected == "heif") {
+        return HeifHandler::mayHaveFrames(data);
+    }
+    if (data.startsWith("BM")) {
+        return false;
+    }
+    // GIF, ICO and whatever else Qt reads are left to the reader
+    return true;
 }
 
 QString ImageConverter::getExtension(Format format)
@@ -191,6 +1026,26 @@ ImageConverter::Format ImageConverter::formatFromIndex(int index)
     }
 }
 
+bool ImageConverter::formatFromName(const QString& name, Format& format)
+{
+    QString key = name.trimmed().toLower();
+    if (key.startsWith('.')) {
+        key.remove(0, 1);
+    }
+
+    if (key == "jpg" || key == "jpeg") format = Format::JPEG;
+    else if (key == "png") format = Format::PNG;
+    else if (key == "webp") format = Format::WebP;
+    else if (key == "gif") format = Format::GIF;
+    else if (key == "tif" || key == "tiff") format = Format::TIFF;
+    else if (key == "bmp") format = Format::BMP;
+    else if (key == "heic" || key == "heif") format = Format::HEIC;
+    else if (key == "avif") format = Format::AVIF;
+    else if (key == "ico") format = Format::ICO;
+    else return false;
+    return true;
+}
+
 bool ImageConverter::canRead(const QString& filePath)
 {
     QImageReader reader(filePath);
@@ -199,19 +1054,22 @@ bool ImageConverter::canRead(const QString& filePath)
 
 bool ImageConverter::isFormatSupported(Format format)
 {
-    QList<QByteArray> supportedFormats = QImageWriter::supportedImageFormats();
+    // Plugins are scanned once per process; the list cannot change afterwards
+    static const QList<QByteArray> supportedFormats = QImageWriter::supportedImageFormats();
 
     switch (format) {
         case Format::JPEG:
-            return supportedFormats.contains("jpg") || supportedFormats.contains("jpeg");
+            return JpegHandler::isAvailable() ||
+                   supportedFormats.contains("jpg") || supportedFormats.contains("jpeg");
         case Format::PNG:
             return supportedFormats.contains("png");
         case Format::WebP:
-            return supportedFormats.contains("webp");
+            return WebpHandler::isAvailable() || supportedFormats.contains("webp");
         case Format::GIF:
             return supportedFormats.contains("gif");
         case Format::TIFF:
-            return supportedFormats.contains("tiff") || supportedFormats.contains("tif");
+            return TiffHandler::isAvailable() ||
+                   supportedFormats.contains("tiff") || supportedFormats.contains("tif");
         case Format::BMP:
             return supportedFormats.contains("bmp");
         case Format::HEIC:
@@ -243,6 +1101,15 @@ QString ImageConverter::getFormatName(Format format)
     return "Unknown";
 }
 
+QStringList ImageConverter::supportedInputExtensions()
+{
+    return {
+        "jpg", "jpeg", "png", "webp", "gif",
+        "tiff", "tif", "bmp", "heic", "heif",
+        "avif", "ico"
+    };
+}
+
 QStringList ImageConverter::getSupportedReadFormats()
 {
     QList<QByteArray> formats = QImageReader::supportedImageFormats();
@@ -277,12 +1144,15 @@ QString ImageConverter::generateOutputPath(const QString& inputPath, const QStri
 
     QString outputPath = outputDir + "/" + baseName + extension;
 
-    // Handle filename conflicts by adding a number suffix
+    // Handle filename conflicts, including names other conversions are still writing, with a number suffix
+    QMutexLocker locker(&outputReservations().mutex);
+    QSet<QString>& reserved = outputReservations().paths;
     int counter = 1;
-    while (QFileInfo::exists(outputPath) && outputPath != inputPath) {
+    while ((QFileInfo::exists(outputPath) || reserved.contains(outputPath)) && outputPath != inputPath) {
         outputPath = outputDir + "/" + baseName + "_" + QString::number(counter) + extension;
         counter++;
     }
+    reserved.insert(outputPath);
 
     return outputPath;
 }
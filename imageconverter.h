@@ -4,12 +4,48 @@
 #include <QString>
 #include <QStringList>
 #include <QObject>
+#include <QByteArray>
+#include <QImage>
+#include <QMetaType>
+#include <QRect>
+#include <QVector>
+#include <functional>
+#include "tiffhandler.h"
+#include "yuvformat.h"
+
+class FrameReader;
+class OutputWriter;
 
 struct ConversionResult {
     QString inputFile;
     QString outputFile;
     bool success;
     QString errorMessage;
+    qint64 outputSize = 0;  // Bytes written, 0 on failure
+    qint64 elapsedMs = 0;   // Wall time spent converting this file
+    QString duplicateOf;    // Identical input whose output this one reuses; empty if converted
+};
+Q_DECLARE_METATYPE(ConversionResult)
+
+// Encoding options applied to every file of a job
+struct ConversionOptions {
+    int quality = -1;           // -1 for the format default
+    qint64 targetBytes = 0;     // > 0: highest quality whose output fits (JPEG, WebP, HEIC, AVIF)
+    double minSsim = 0.0;       // > 0: lowest quality reaching this SSIM; targetBytes still caps the size
+    int pngOptimizeMs = 0;      // > 0: smallest lossless PNG found within this many ms
+    YuvFormat yuv;              // Chroma subsampling for JPEG, AVIF and HEIC; bit depth for AVIF and HEIC
+    bool progressive = false;   // Progressive JPEG: smaller files, slower encode
+    bool fastDct = false;       // Faster, slightly less accurate JPEG DCT
+    int webpMethod = 4;         // WebP speed preset: 0 fastest, 6 smallest
+    bool webpLossless = false;  // Lossless WebP; quality then sets the compression effort
+    int webpNearLossless = 100; // < 100: near-lossless WebP with this much preprocessing
+    int webpAlphaQuality = 100; // WebP alpha plane quality
+    bool pngFastEncode = false; // Low PNG compression level with one cheap filter
+    bool trustedInput = false;  // Skip decoder integrity checks (PNG checksums)
+    TiffHandler::Settings tiff; // Compression, predictor and strip/tile layout of TIFF output
+    bool forceReencode = false; // Re-encode inputs already in the target format instead of copying them
+    int maxThreads = 0;         // Threads one conversion's encoder searches may use (<= 0: one per core)
+    QRect region;               // Non-empty: convert only this part of the (first) image
 };
 
 class ImageConverter : public QObject
@@ -33,6 +69,85 @@ public:
 
     // Convert a single file
     ConversionResult convert(const QString& inputPath, const QString& outputFolder, Format targetFormat, int quality = -1);
+    ConversionResult convert(const QString& inputPath, const QString& outputFolder, Format targetFormat,
+                             const ConversionOptions& options);
+
+    // Convert and hand the encoded output to writer, returning without waiting for it to be written;
+    // done runs on the writer's thread then, or on this thread for copies, failures and a null writer
+    void convert(const QString& inputPath, const QString& outputFolder, Format targetFormat,
+                 const ConversionOptions& options, OutputWriter* writer,
+                 const std::function<void(const ConversionResult&)>& done);
+
+    // Give an input byte-identical to an already converted one the same output, hard-linked or copied
+    ConversionResult convertDuplicate(const QString& inputPath, const QString& outputFolder, Format targetFormat,
+                                      const ConversionResult& original);
+
+    // Convert an encoded image held in memory; formatHint is the source suffix if known
+    static bool convertData(const QByteArray& input, Format targetFormat, int quality,
+                            QByteArray& output, QString& errorMessage,
+                            const QString& formatHint = QString());
+    static bool convertData(const QByteArray& input, Format targetFormat, const ConversionOptions& options,
+                            QByteArray& output, QString& errorMessage,
+                            const QString& formatHint = QString());
+
+    // Decode an encoded image held in memory; formatHint is used if the content is not recognised
+    static bool decode(const QByteArray& data, const QString& formatHint,
+                       QImage& image, QString& errorMessage);
+
+    // Decode at the smallest resolution whose longer side still covers minSize (0 for full size),
+    // using embedded thumbnails or decoder-side scaling such as JPEG's 1/2, 1/4 and 1/8 DCT;
+    // imageSize receives the full size of the source
+    static bool decode(const QByteArray& data, const QString& formatHint, int minSize,
+                       QImage& image, QSize& imageSize, QString& errorMessage);
+
+    // Longest side the decoder has to deliver for a target format (0 if it needs full size)
+    static int decodeSizeFor(Format targetFormat);
+
+    // Encode an image to the target format in memory
+    static bool encode(const QImage& image, Format targetFormat, int quality,
+                       QByteArray& output, QString& errorMessage);
+    static bool encode(const QImage& image, Format targetFormat, int quality, const YuvFormat& yuv,
+                       QByteArray& output, QString& errorMessage);
+    static bool encode(const QImage& image, Format targetFormat, const ConversionOptions& options,
+                       QByteArray& output, QString& errorMessage);
+
+    // Check if the quality setting changes the output of a format
+    static bool hasQualitySetting(Format format);
+
+    // Check if a format can be written with more than one frame
+    static bool supportsAnimation(Format format);
+
+    // Convert frame by frame into a multi-frame target; one decoded frame is held at a time.
+    // Fails if targetBytes or minSsim is set; those only apply to single images.
+    static bool convertFrames(FrameReader& reader, Format targetFormat, const ConversionOptions& options,
+                              QByteArray& output, QString& errorMessage);
+
+    // Write every page of the input files, in order, as one multi-page TIFF
+    static bool convertToMultiPage(const QStringList& inputPaths, const QString& outputPath,
+                                   const ConversionOptions& options, QString& errorMessage);
+
+    // Composite an image with alpha onto white (for formats without transparency);
+    // straight RGBA8888 and ARGB32 become RGBX8888 and RGB32
+    static QImage flattenAlpha(const QImage& image);
+
+    // Pixel formats the encoder of a format reads without converting (empty if any)
+    static QVector<QImage::Format> encoderFormats(Format targetFormat);
+
+    // Flatten and convert an image once into a layout the target's encoder reads as is
+    static QImage prepareForEncode(const QImage& image, Format targetFormat);
+
+    // Detect JPEG, PNG, WebP, and HEIF/AVIF containers from their 'ftyp' brands; empty if unknown
+    static QString detectFormat(const QByteArray& data);
+
+    /**
+     * @brief Cheap check from the container whether data may hold several frames
+     *
+     * Looks only at headers (APNG 'acTL', WebP animation flag, AVIF 'avis'
+     * brand, HEIF tracks or entity groups, a second TIFF IFD), so still
+     * images need no FrameReader.
+     * @return false only if the data certainly holds a single image
+     */
+    static bool mayHaveFrames(const QByteArray& data);
 
     // Get file extension for format
     static QString getExtension(Format format);
@@ -40,6 +155,9 @@ public:
     // Get format from combo box index
     static Format formatFromIndex(int index);
 
+    // Get format from a name or extension such as "jpg", ".heic" or "AVIF"
+    static bool formatFromName(const QString& name, Format& format);
+
     // Check if format is supported for reading
     static bool canRead(const QString& filePath);
 
@@ -49,6 +167,9 @@ public:
     // Get human-readable format name
     static QString getFormatName(Format format);
 
+    // Get the file extensions accepted as conversion input (lowercase, no dot)
+    static QStringList supportedInputExtensions();
+
     // Get list of supported read formats
     static QStringList getSupportedReadFormats();
 
@@ -60,6 +181,7 @@ signals:
     void conversionComplete(const QList<ConversionResult>& results);
 
 private:
+    // Pick a free output name and reserve it until the caller has written it
     QString generateOutputPath(const QString& inputPath, const QString& outputFolder, Format targetFormat);
 };
 
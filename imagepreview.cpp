@@ -1,5 +1,8 @@
 #include "imagepreview.h"
+#include "bufferpool.h"
+#include "imageconverter.h"
 
+#include <QFile>
 #include <QFileInfo>
 #include <QPixmap>
 
@@ -34,24 +37,43 @@ ImagePreview::ImagePreview(QWidget *parent)
 
 void ImagePreview::setImage(const QString& filePath)
 {
-    QPixmap pixmap(filePath);
+    QByteArray data;
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly)) {
+        data = file.readAll();
+        file.close();
+    }
+
+    // A thumbnail or reduced decode is enough for the preview
+    const int previewSize = m_maxPreviewSize - 10;
+    QImage image;
+    QSize imageSize;
+    QString errorMessage;
+    if (!ImageConverter::decode(data, QFileInfo(filePath).suffix().toLower(), previewSize,
+                                image, imageSize, errorMessage)) {
+        image = QImage();
+    }
 
-    if (pixmap.isNull()) {
+    if (image.isNull()) {
         m_imageLabel->setText("Preview\nnot available");
         m_infoLabel->setText("");
         return;
     }
 
     // Scale to fit
-    QPixmap scaled = pixmap.scaled(
-        m_maxPreviewSize - 10,
-        m_maxPreviewSize - 10,
+    QPixmap scaled = QPixmap::fromImage(image.scaled(
+        previewSize,
+        previewSize,
         Qt::KeepAspectRatio,
         Qt::SmoothTransformation
-    );
+    ));
 
     m_imageLabel->setPixmap(scaled);
 
+    // The label keeps its own pixmap; return the decode buffer to the system, not the pool
+    image = QImage();
+    BufferPool::trim();
+
     // Show image info
     QFileInfo info(filePath);
     QString sizeStr;
@@ -65,8 +87,8 @@ void ImagePreview::setImage(const QString& filePath)
     }
 
     m_infoLabel->setText(QString("%1x%2 | %3")
-        .arg(pixmap.width())
-        .arg(pixmap.height())
+        .arg(imageSize.width())
+        .arg(imageSize.height())
         .arg(sizeStr));
 }
 
@@ -0,0 +1,276 @@
+#include "jobscheduler.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// HEIF and AVIF keep the 'ispe' box with the image size in the leading 'meta' box
+const qint64 BMFF_HEADER_BYTES = 256 * 1024;
+
+// Unknown sizes: about half a megabyte per megapixel, typical of photos
+const double BYTES_PER_MEGAPIXEL = 500000.0;
+
+// Weight of the newest measurement in the running average
+const double LEARNING_RATE = 0.2;
+
+QString normalisedFormat(const QString& filePath)
+{
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix == "jpg" || suffix == "jpe") {
+        return "jpeg";
+    }
+    if (suffix == "tif") {
+        return "tiff";
+    }
+    if (suffix == "heif" || suffix == "hif") {
+        return "heic";
+    }
+    return suffix;
+}
+
+// Relative decode cost per megapixel before any file of the format has been measured
+double priorCost(const QString& sourceFormat)
+{
+    static const QHash<QString, double> priors = {
+        {"jpeg", 1.0}, {"png", 1.6}, {"webp", 1.4}, {"tiff", 1.2},
+        {"heic", 2.5}, {"avif", 3.0}, {"gif", 1.0}, {"bmp", 0.5}
+    };
+    return priors.value(sourceFormat, 1.5);
+}
+
+// Measured ms per megapixel, by target extension and then source format
+struct CostTable {
+    QMutex mutex;
+    QHash<QString, QHash<QString, double>> byTarget;
+};
+
+CostTable& costTable()
+{
+    static CostTable table;
+    return table;
+}
+
+double costPerMegapixel(const QString& target, const QString& sourceFormat)
+{
+    CostTable& table = costTable();
+    QMutexLocker locker(&table.mutex);
+    const QHash<QString, double>& measured = table.byTarget[target];
+    if (measured.contains(sourceFormat)) {
+        return measured.value(sourceFormat);
+    }
+    // Scale the prior by how the measured formats compare with their priors
+    double scale = 0.0;
+    for (auto it = measured.constBegin(); it != measured.constEnd(); ++it) {
+        scale += it.value() / priorCost(it.key());
+    }
+    return priorCost(sourceFormat) * (measured.isEmpty() ? 1.0 : scale / measured.size());
+}
+
+// Largest 'ispe' (image spatial extents) property; grids list their tiles too
+QSize bmffSize(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QSize();
+    }
+    const QByteArray header = file.read(BMFF_HEADER_BYTES);
+    if (header.mid(4, 4) != "ftyp") {
+        return QSize();
+    }
+
+    QSize largest;
+    // Box type, then version and flags, then 32-bit width and height
+    for (int at = header.indexOf("ispe"); at >= 0 && at + 16 <= header.size();
+         at = header.indexOf("ispe", at + 4)) {
+        const uchar* data = reinterpret_cast<const uchar*>(header.constData()) + at;
+        const QSize size(static_cast<int>(qFromBigEndian<quint32>(data + 8)),
+                         static_cast<int>(qFromBigEndian<quint32>(data + 12)));
+        if (size.width() > 0 && size.height() > 0 &&
+            (largest.isEmpty() ||
+             qint64(size.width()) * size.height() > qint64(largest.width()) * largest.height())) {
+            largest = size;
+        }
+    }
+    return largest;
+}
+
+// Size and, where there is one, inode number in a single stat
+void statFile(const QString& filePath, qint64& bytes, quint64& inode)
+{
+#ifdef Q_OS_UNIX
+    struct stat info;
+    if (::stat(QFile::encodeName(filePath).constData(), &info) == 0) {
+        bytes = info.st_size;
+        inode = info.st_ino;
+        return;
+    }
+#endif
+    bytes = QFileInfo(filePath).size();
+    inode = 0;
+}
+
+} // namespace
+
+JobScheduler::JobScheduler()
+    : m_targetFormat(ImageConverter::Format::PNG)
+    , m_nextSequence(0)
+{
+}
+
+void JobScheduler::setTargetFormat(ImageConverter::Format format)
+{
+    m_targetFormat = format;
+}
+
+void JobScheduler::setOrder(Order order)
+{
+    RunsFirst runsFirst;
+    runsFirst.order = order;
+    m_queue = std::set<Job, RunsFirst>(m_queue.begin(), m_queue.end(), runsFirst);
+}
+
+QVector<JobScheduler::Job> JobScheduler::add(const QStringList& files)
+{
+    QVector<Job> jobs;
+    jobs.reserve(files.size());
+    for (const QString& file : files) {
+        Job job;
+        job.file = file;
+        job.sourceFormat = normalisedFormat(file);
+        job.directory = QFileInfo(file).absolutePath();
+        job.sequence = m_nextSequence++;
+        m_queue.insert(job);
+        m_queued.insert(job.sequence, job);
+        jobs.append(job);
+    }
+    return jobs;
+}
+
+void JobScheduler::estimate(QVector<Job>& jobs) const
+{
+    TraceSpan span("JobScheduler::estimate", "worker");
+    const QString target = ImageConverter::getExtension(m_targetFormat);
+    const bool predictCost = m_queue.key_comp().order == Order::LongestFirst;
+
+    for (Job& job : jobs) {
+        statFile(job.file, job.bytes, job.inode);
+        job.estimated = true;
+        if (!predictCost) {
+            continue;
+        }
+
+        const QSize size = headerSize(job.file);
+        if (!size.isEmpty()) {
+            job.megapixels = qint64(size.width()) * size.height() / 1e6;
+        } else {
+            job.megapixels = job.bytes / BYTES_PER_MEGAPIXEL;
+        }
+        job.cost = job.megapixels * costPerMegapixel(target, job.sourceFormat);
+    }
+}
+
+void JobScheduler::update(const QVector<Job>& jobs)
+{
+    for (const Job& job : jobs) {
+        auto it = m_queued.find(job.sequence);
+        if (it == m_queued.end()) {
+            continue;
+        }
+        m_queue.erase(it.value());
+        m_queue.insert(job);
+        it.value() = job;
+    }
+}
+
+QVector<JobScheduler::Job> JobScheduler::stillQueued(const QVector<Job>& jobs) const
+{
+    QVector<Job> queued;
+    for (const Job& job : jobs) {
+        if (m_queued.contains(job.sequence)) {
+            queued.append(job);
+        }
+    }
+    return queued;
+}
+
+bool JobScheduler::take(Job& job)
+{
+    if (m_queue.empty()) {
+        return false;
+    }
+    job = *m_queue.begin();
+    m_queue.erase(m_queue.begin());
+    m_queued.remove(job.sequence);
+    return true;
+}
+
+QVector<JobScheduler::Job> JobScheduler::upcoming(int count) const
+{
+    QVector<Job> jobs;
+    for (auto it = m_queue.begin(); it != m_queue.end() && jobs.size() < count; ++it) {
+        jobs.append(*it);
+    }
+    return jobs;
+}
+
+bool JobScheduler::isEmpty() const
+{
+    return m_queue.empty();
+}
+
+void JobScheduler::record(const Job& job, qint64 elapsedMs) const
+{
+    if (job.megapixels <= 0 || elapsedMs <= 0) {
+        return;
+    }
+    const double sample = elapsedMs / job.megapixels;
+
+    CostTable& table = costTable();
+    QMutexLocker locker(&table.mutex);
+    QHash<QString, double>& measured = table.byTarget[ImageConverter::getExtension(m_targetFormat)];
+    auto it = measured.find(job.sourceFormat);
+    if (it == measured.end()) {
+        measured.insert(job.sourceFormat, sample);
+    } else {
+        it.value() += LEARNING_RATE * (sample - it.value());
+    }
+}
+
+QSize JobScheduler::headerSize(const QString& filePath)
+{
+    // Qt's readers parse only the header to answer size()
+    QImageReader reader(filePath);
+    const QSize size = reader.size();
+    if (size.isValid() && !size.isEmpty()) {
+        return size;
+    }
+    return bmffSize(filePath);
+}
+
+bool JobScheduler::RunsFirst::operator()(const Job& a, const Job& b) const
+{
+    if (order == Order::Locality) {
+        if (a.directory != b.directory) {
+            return a.directory < b.directory;
+        }
+        if (a.inode != b.inode) {
+            return a.inode < b.inode;
+        }
+    } else if (a.cost != b.cost) {
+        // Unestimated jobs cost 0, so they run in arrival order until estimates arrive
+        return a.cost > b.cost;
+    }
+    // Arrival order is unique, so no two queued jobs compare equal
+    return a.sequence < b.sequence;
+}
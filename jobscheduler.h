@@ -0,0 +1,127 @@
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <set>
+#include "imageconverter.h"
+
+/**
+ * @brief Orders a batch's files by predicted conversion time, longest first
+ *
+ * With several files converting in parallel, a batch finishes when its
+ * slowest thread does. Handing out the most expensive files first lets the
+ * small ones fill in at the end, instead of a few huge files left for last
+ * running alone on one core while the others idle.
+ *
+ * The predicted cost of a file is its megapixels, read from the header,
+ * times the measured milliseconds per megapixel for its source format and
+ * the target format. Measurements are shared by every batch in the process;
+ * formats not yet measured use a built-in relative cost scaled to the ones
+ * that are.
+ *
+ * Files are queued at once in arrival order and estimated afterwards, in
+ * the background; reading 100k headers over NFS takes minutes, and
+ * conversions start on the unestimated jobs meanwhile. Each estimate
+ * then moves its job to its place in the run order.
+ *
+ * For inputs on spinning disks or tape-backed storage, where seeks cost
+ * more than conversions, jobs can instead run in directory and inode
+ * order, which roughly follows their placement on the medium.
+ *
+ * Not thread-safe apart from estimate() and record(); callers serialise
+ * the rest.
+ */
+class JobScheduler
+{
+public:
+    enum class Order {
+        LongestFirst,   // Highest predicted cost first
+        Locality        // By directory, then inode
+    };
+
+    struct Job {
+        QString file;
+        QString sourceFormat;   // Normalised source suffix, e.g. "jpeg"
+        double megapixels = 0;
+        double cost = 0;        // Predicted conversion time in ms
+        qint64 bytes = 0;       // File size
+        QString directory;
+        quint64 inode = 0;      // 0 where the platform has none
+        quint64 sequence = 0;   // Arrival order, breaking ties
+        bool estimated = false; // Size and cost known
+    };
+
+    JobScheduler();
+
+    void setTargetFormat(ImageConverter::Format format);
+
+    // Reorders jobs already queued
+    void setOrder(Order order);
+
+    /**
+     * @brief Queue files in arrival order without touching them
+     * @return The queued jobs, to be passed to estimate() and update()
+     */
+    QVector<Job> add(const QStringList& files);
+
+    /**
+     * @brief Read the header of each job's file and predict its conversion time
+     *
+     * In locality order only the files' metadata is read; opening every
+     * header would cost the seeks the order is meant to save.
+     */
+    void estimate(QVector<Job>& jobs) const;
+
+    /**
+     * @brief Move estimated jobs to their place in the run order
+     *
+     * Jobs already taken are ignored.
+     */
+    void update(const QVector<Job>& jobs);
+
+    /**
+     * @brief The jobs among these that have not been taken yet
+     */
+    QVector<Job> stillQueued(const QVector<Job>& jobs) const;
+
+    /**
+     * @brief Take the next job in run order
+     * @return false if the queue is empty
+     */
+    bool take(Job& job);
+
+    /**
+     * @brief The jobs take() would return next, in order, without removing them
+     */
+    QVector<Job> upcoming(int count) const;
+
+    bool isEmpty() const;
+
+    /**
+     * @brief Feed a finished conversion's time back into later predictions
+     */
+    void record(const Job& job, qint64 elapsedMs) const;
+
+    /**
+     * @brief Image size from the file header without decoding (empty if unknown)
+     */
+    static QSize headerSize(const QString& filePath);
+
+private:
+    // Strict run order of queued jobs
+    struct RunsFirst {
+        Order order = Order::LongestFirst;
+        bool operator()(const Job& a, const Job& b) const;
+    };
+
+    ImageConverter::Format m_targetFormat;
+    std::set<Job, RunsFirst> m_queue;
+    QHash<quint64, Job> m_queued;   // The same jobs by sequence
+    quint64 m_nextSequence;
+};
+
+#endif // JOBSCHEDULER_H
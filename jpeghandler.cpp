@@ -0,0 +1,326 @@
+#include "jpeghandler.h"
+#include "bufferpool.h"
+#include "tracer.h"
+
+#include <QMap>
+#include <QtEndian>
+#include <cstring>
+#include <memory>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#endif
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+
+namespace {
+
+struct TurboJpegDeleter {
+    void operator()(void* handle) const { tjDestroy(handle); }
+};
+using TurboJpegHandle = std::unique_ptr<void, TurboJpegDeleter>;
+
+// TurboJPEG pixel format reading a QImage in place; other formats are converted to RGBX first
+int pixelFormatFor(QImage& image)
+{
+    switch (image.format()) {
+        case QImage::Format_Grayscale8:
+            return TJPF_GRAY;
+        case QImage::Format_RGB888:
+            return TJPF_RGB;
+        case QImage::Format_RGBX8888:
+        case QImage::Format_RGBA8888:
+            return TJPF_RGBX;
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32:
+            // 0xAARRGGBB words
+            return Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? TJPF_BGRX : TJPF_XRGB;
+        default:
+            image = image.convertToFormat(QImage::Format_RGBX8888);
+            return TJPF_RGBX;
+    }
+}
+
+int subsamplingFor(ChromaSubsampling chroma)
+{
+    switch (chroma) {
+        case ChromaSubsampling::YUV422: return TJSAMP_422;
+        case ChromaSubsampling::YUV444: return TJSAMP_444;
+        case ChromaSubsampling::YUV420:
+        case ChromaSubsampling::Auto:
+        default:
+            return TJSAMP_420;
+    }
+}
+
+// APP2 segments carrying an ICC profile start with this signature, then a
+// 1-based sequence number and the segment count
+const char ICC_SIGNATURE[] = "ICC_PROFILE";  // Including the terminating NUL
+const int ICC_HEADER_BYTES = sizeof(ICC_SIGNATURE) + 2;
+const int ICC_MAX_CHUNK = 65533 - ICC_HEADER_BYTES;
+
+// Reassemble the ICC profile from the APP2 segments before the scan data
+QByteArray readIccProfile(const QByteArray& data)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    QMap<int, QByteArray> chunks;
+    int count = 0;
+    int at = 2;  // After SOI
+    while (at + 4 <= data.size() && bytes[at] == 0xFF) {
+        const uchar marker = bytes[at + 1];
+        if (marker == 0xDA || marker == 0xD9) {
+            break;  // Start of scan or end of image
+        }
+        if (marker == 0xFF) {
+            ++at;  // Fill byte
+            continue;
+        }
+        const int length = qFromBigEndian<quint16>(bytes + at + 2);
+        if (length < 2 || at + 2 + length > data.size()) {
+            break;
+        }
+        const int payload = at + 4;
+        if (marker == 0xE2 && length - 2 > ICC_HEADER_BYTES &&
+            memcmp(bytes + payload, ICC_SIGNATURE, sizeof(ICC_SIGNATURE)) == 0) {
+            const int sequence = bytes[payload + sizeof(ICC_SIGNATURE)];
+            count = bytes[payload + sizeof(ICC_SIGNATURE) + 1];
+            chunks.insert(sequence, data.mid(payload + ICC_HEADER_BYTES, length - 2 - ICC_HEADER_BYTES));
+        }
+        at += 2 + length;
+    }
+
+    // A profile with a missing segment is unusable
+    if (count == 0 || chunks.size() != count || chunks.firstKey() != 1 || chunks.lastKey() != count) {
+        return QByteArray();
+    }
+    QByteArray profile;
+    for (const QByteArray& chunk : chunks) {
+        profile += chunk;
+    }
+    return profile;
+}
+
+// Insert the ICC profile as APP2 segments after SOI and any JFIF APP0 segment
+void writeIccProfile(QByteArray& jpeg, const QByteArray& profile)
+{
+    const int count = (profile.size() + ICC_MAX_CHUNK - 1) / ICC_MAX_CHUNK;
+    if (count == 0 || count > 255 || jpeg.size() < 4) {
+        return;
+    }
+
+    QByteArray segments;
+    for (int i = 0; i < count; ++i) {
+        const QByteArray chunk = profile.mid(i * ICC_MAX_CHUNK, ICC_MAX_CHUNK);
+        const int length = 2 + ICC_HEADER_BYTES + chunk.size();
+        segments += char(0xFF);
+        segments += char(0xE2);
+        segments += char(length >> 8);
+        segments += char(length & 0xFF);
+        segments += QByteArray(ICC_SIGNATURE, sizeof(ICC_SIGNATURE));
+        segments += char(i + 1);
+        segments += char(count);
+        segments += chunk;
+    }
+
+    int at = 2;
+    const uchar* bytes = reinterpret_cast<const uchar*>(jpeg.constData());
+    if (bytes[2] == 0xFF && bytes[3] == 0xE0 && jpeg.size() >= 6) {
+        at += 2 + qFromBigEndian<quint16>(bytes + 4);
+    }
+    jpeg.insert(at, segments);
+}
+
+} // namespace
+#endif
+
+JpegHandler::JpegHandler()
+{
+}
+
+JpegHandler::~JpegHandler()
+{
+}
+
+bool JpegHandler::isAvailable()
+{
+#ifdef HAVE_TURBOJPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+QVector<QImage::Format> JpegHandler::writeFormats()
+{
+    // Alpha is ignored, so straight alpha layouts read like their opaque twins
+    return {QImage::Format_RGBX8888, QImage::Format_RGB32, QImage::Format_RGB888, QImage::Format_Grayscale8,
+            QImage::Format_RGBA8888, QImage::Format_ARGB32};
+}
+
+bool JpegHandler::readData(const QByteArray& data, QImage& image, QString& errorMessage)
+{
+    QSize imageSize;
+    return readData(data, 0, image, imageSize, errorMessage);
+}
+
+bool JpegHandler::readData(const QByteArray& data, int minSize, QImage& image,
+                           QSize& imageSize, QString& errorMessage)
+{
+    TraceSpan span("JpegHandler::read", "codec");
+
+#ifdef HAVE_TURBOJPEG
+    TurboJpegHandle tj(tjInitDecompress());
+    if (!tj) {
+        errorMessage = "Failed to create JPEG decoder";
+        return false;
+    }
+
+    const unsigned char* jpegData = reinterpret_cast<const unsigned char*>(data.constData());
+    const unsigned long jpegSize = static_cast<unsigned long>(data.size());
+    int width = 0;
+    int height = 0;
+    int subsampling = 0;
+    int colorspace = 0;
+    if (tjDecompressHeader3(tj.get(), jpegData, jpegSize, &width, &height, &subsampling, &colorspace) != 0) {
+        errorMessage = QString("Failed to read JPEG header: %1").arg(tjGetErrorStr2(tj.get()));
+        return false;
+    }
+    if (colorspace == TJCS_CMYK || colorspace == TJCS_YCCK) {
+        errorMessage = "CMYK JPEG is not supported by the direct decoder";
+        return false;
+    }
+    imageSize = QSize(width, height);
+
+    // Smallest scaling factor (1/8, 1/4, 3/8, ...) whose output still covers minSize
+    int scaledWidth = width;
+    int scaledHeight = height;
+    if (minSize > 0) {
+        int count = 0;
+        const tjscalingfactor* factors = tjGetScalingFactors(&count);
+        for (int i = 0; factors && i < count; ++i) {
+            if (factors[i].num > factors[i].denom) {
+                continue;
+            }
+            const int w = TJSCALED(width, factors[i]);
+            const int h = TJSCALED(height, factors[i]);
+            if (qMax(w, h) >= minSize && qint64(w) * h < qint64(scaledWidth) * scaledHeight) {
+                scaledWidth = w;
+                scaledHeight = h;
+            }
+        }
+    }
+
+    const bool grayscale = colorspace == TJCS_GRAY;
+    QImage decoded = BufferPool::createImage(scaledWidth, scaledHeight,
+                                             grayscale ? QImage::Format_Grayscale8 : QImage::Format_RGBX8888);
+    if (decoded.isNull()) {
+        errorMessage = "Failed to allocate image";
+        return false;
+    }
+
+    if (tjDecompress2(tj.get(), jpegData, jpegSize, decoded.bits(), scaledWidth, decoded.bytesPerLine(),
+                      scaledHeight, grayscale ? TJPF_GRAY : TJPF_RGBX, 0) != 0) {
+        // Warnings (e.g. a truncated file) still leave a usable image
+        if (tjGetErrorCode(tj.get()) != TJERR_WARNING) {
+            errorMessage = QString("Failed to decode JPEG: %1").arg(tjGetErrorStr2(tj.get()));
+            return false;
+        }
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    // Qt's plugin attaches the embedded profile too; without it wide-gamut photos shift color
+    const QByteArray icc = readIccProfile(data);
+    if (!icc.isEmpty()) {
+        decoded.setColorSpace(QColorSpace::fromIccProfile(icc));
+    }
+#endif
+
+    image = decoded;
+    return true;
+#else
+    errorMessage = "JPEG support not compiled. Install libjpeg-turbo and rebuild with HAVE_TURBOJPEG defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(minSize);
+    Q_UNUSED(image);
+    Q_UNUSED(imageSize);
+    return false;
+#endif
+}
+
+bool JpegHandler::writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage)
+{
+    return writeData(image, quality, YuvFormat(), Settings(), output, errorMessage);
+}
+
+bool JpegHandler::writeData(const QImage& image, int quality, const YuvFormat& yuv, const Settings& settings,
+                            QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("JpegHandler::write", "codec");
+
+#ifdef HAVE_TURBOJPEG
+    if (image.isNull()) {
+        errorMessage = "Source image is null";
+        return false;
+    }
+
+    TurboJpegHandle tj(tjInitCompress());
+    if (!tj) {
+        errorMessage = "Failed to create JPEG encoder";
+        return false;
+    }
+
+    // Most decoded images are read in place; only unusual formats are converted
+    QImage source = image;
+    const int pixelFormat = pixelFormatFor(source);
+    const int subsampling = pixelFormat == TJPF_GRAY ? TJSAMP_GRAY : subsamplingFor(yuv.chroma);
+    const int jpegQuality = qBound(1, quality < 0 ? 90 : quality, 100);
+
+    int flags = settings.fastDct ? TJFLAG_FASTDCT : TJFLAG_ACCURATEDCT;
+    unsigned char* jpegData = nullptr;
+    unsigned long jpegSize = 0;
+    if (settings.progressive) {
+#ifdef TJFLAG_PROGRESSIVE
+        flags |= TJFLAG_PROGRESSIVE;
+#endif
+    } else {
+        // Baseline output fits the worst-case bound, so encode straight into the QByteArray
+        output.resize(static_cast<int>(tjBufSize(source.width(), source.height(), subsampling)));
+        jpegData = reinterpret_cast<unsigned char*>(output.data());
+        jpegSize = static_cast<unsigned long>(output.size());
+        flags |= TJFLAG_NOREALLOC;
+    }
+
+    if (tjCompress2(tj.get(), source.constBits(), source.width(), source.bytesPerLine(), source.height(),
+                    pixelFormat, &jpegData, &jpegSize, subsampling, jpegQuality, flags) != 0) {
+        errorMessage = QString("Failed to encode JPEG: %1").arg(tjGetErrorStr2(tj.get()));
+        if (settings.progressive) {
+            tjFree(jpegData);
+        }
+        output.clear();
+        return false;
+    }
+
+    if (settings.progressive) {
+        output = QByteArray(reinterpret_cast<const char*>(jpegData), static_cast<int>(jpegSize));
+        tjFree(jpegData);
+    } else {
+        output.resize(static_cast<int>(jpegSize));
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    if (image.colorSpace().isValid()) {
+        writeIccProfile(output, image.colorSpace().iccProfile());
+    }
+#endif
+    return true;
+#else
+    errorMessage = "JPEG support not compiled. Install libjpeg-turbo and rebuild with HAVE_TURBOJPEG defined.";
+    Q_UNUSED(image);
+    Q_UNUSED(quality);
+    Q_UNUSED(yuv);
+    Q_UNUSED(settings);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
@@ -0,0 +1,88 @@
+#ifndef JPEGHANDLER_H
+#define JPEGHANDLER_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include "yuvformat.h"
+
+/**
+ * @brief Handler for JPEG using the TurboJPEG API of libjpeg-turbo
+ *
+ * Decodes straight into a QImage in the layout the encoders take (RGBX or
+ * grayscale), optionally at a DCT-domain reduced scale, and encodes with
+ * explicit chroma subsampling, progressive mode and DCT speed. It requires
+ * libjpeg-turbo to be installed on the system; without it JPEG goes through
+ * Qt's image plugin.
+ */
+class JpegHandler
+{
+public:
+    // Speed and size trade-offs of the encoder
+    struct Settings {
+        bool progressive = false;  // Progressive scans with optimized Huffman tables: smaller, slower
+        bool fastDct = false;      // Faster, slightly less accurate integer DCT
+    };
+
+    JpegHandler();
+    ~JpegHandler();
+
+    /**
+     * @brief Check if libjpeg-turbo is available
+     * @return true if libjpeg-turbo is available and can be used
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Decode a JPEG image held in memory
+     * @param data Encoded file contents
+     * @param image Output QImage (RGBX8888, or Grayscale8 for grayscale files)
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise (including CMYK files,
+     *         which callers leave to Qt)
+     */
+    static bool readData(const QByteArray& data, QImage& image, QString& errorMessage);
+
+    /**
+     * @brief Decode a JPEG image at the smallest DCT scale covering minSize
+     * @param data Encoded file contents
+     * @param minSize Smallest acceptable longer side in pixels (0 for full size)
+     * @param image Output QImage (RGBX8888, or Grayscale8 for grayscale files)
+     * @param imageSize Output full size of the image
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool readData(const QByteArray& data, int minSize, QImage& image,
+                         QSize& imageSize, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to JPEG in memory
+     * @param image The QImage to encode (alpha is ignored)
+     * @param quality Quality setting (0-100, default 90)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to JPEG in memory with explicit encoder settings
+     * @param image The QImage to encode (alpha is ignored)
+     * @param quality Quality setting (0-100, default 90)
+     * @param yuv Chroma subsampling (Auto is 4:2:0; bit depth is ignored)
+     * @param settings Progressive mode and DCT speed
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, const YuvFormat& yuv, const Settings& settings,
+                          QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     */
+    static QVector<QImage::Format> writeFormats();
+};
+
+#endif // JPEGHANDLER_H
@@ -1,11 +1,343 @@
 #include "mainwindow.h"
+#include "bufferpool.h"
+#include "conversionserver.h"
+#include "conversionworker.h"
+#include "folderwatcher.h"
+#include "pixelformat.h"
+#include "pngoptimizer.h"
+#include "qualitysearch.h"
+#include "reportwriter.h"
+#include "tiffhandler.h"
+#include "tracer.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+
+namespace {
+
+// Headless modes must not create a QApplication (no display needed);
+// matches both "--name" and "--name=value"
+bool hasArgument(int argc, char *argv[], const char* name)
+{
+    const uint length = qstrlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (qstrncmp(argv[i], name, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '=')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Log buffer reuse and the full-image pixel format conversions skipped so far
+void reportStatistics()
+{
+    const BufferPool::Statistics pool = BufferPool::statistics();
+    if (pool.reused + pool.allocated > 0) {
+        qInfo().noquote() << QString("Image buffers: %1 reused, %2 allocated, %3 MB idle")
+            .arg(pool.reused).arg(pool.allocated).arg(pool.idleBytes / (1024 * 1024));
+    }
+
+    const QStringList lines = PixelFormat::avoidedConversions();
+    if (lines.isEmpty()) {
+        return;
+    }
+    qInfo().noquote() << "Pixel format conversions avoided:";
+    for (const QString& line : lines) {
+        qInfo().noquote() << "  " + line;
+    }
+}
+
+int runDaemon(QCoreApplication& app, const QCommandLineParser& parser)
+{
+    ConversionServer server;
+    if (parser.isSet("threads")) {
+        server.setMaxThreads(qMax(1, parser.value("threads").toInt()));
+    }
+    QObject::connect(&server, &ConversionServer::shutdownRequested, &app, &QCoreApplication::quit);
+
+    QString listenError;
+    if (!server.listen(parser.value("daemon"), listenError)) {
+        qCritical().noquote() << listenError;
+        return 1;
+    }
+    qInfo().noquote() << "Listening on" << server.serverName();
+    const int ret = app.exec();
+    reportStatistics();
+    return ret;
+}
+
+// Encoding options shared by the headless modes
+bool parseOptions(const QCommandLineParser& parser, ConversionOptions& options)
+{
+    options.quality = parser.value("quality").toInt();
+    options.targetBytes = parser.value("target-bytes").toLongLong();
+    if (parser.isSet("auto-quality")) {
+        options.minSsim = parser.value("min-ssim").toDouble();
+    }
+    if (!YuvFormat::chromaFromName(parser.value("chroma"), options.yuv.chroma)) {
+        qCritical().noquote() << "Unknown chroma subsampling:" << parser.value("chroma");
+        return false;
+    }
+    options.yuv.bitDepth = parser.value("bit-depth").toInt();
+    if (!YuvFormat::isValidBitDepth(options.yuv.bitDepth)) {
+        qCritical().noquote() << "Invalid bit depth, expected 0, 8 or 10:" << parser.value("bit-depth");
+        return false;
+    }
+    options.progressive = parser.isSet("progressive");
+    options.fastDct = parser.isSet("fast-dct");
+    options.webpMethod = parser.value("webp-method").toInt();
+    options.webpLossless = parser.isSet("webp-lossless");
+    options.webpNearLossless = parser.value("webp-near-lossless").toInt();
+    options.webpAlphaQuality = parser.value("webp-alpha-quality").toInt();
+    options.pngFastEncode = parser.isSet("png-fast");
+    options.trustedInput = parser.isSet("trusted-input");
+    options.forceReencode = parser.isSet("force-reencode");
+    if (parser.isSet("png-optimize")) {
+        options.pngOptimizeMs = parser.value("png-optimize").toInt();
+    }
+    if (!TiffHandler::compressionFromName(parser.value("tiff-compression"), options.tiff.compression)) {
+        qCritical().noquote() << "Unknown TIFF compression:" << parser.value("tiff-compression");
+        return false;
+    }
+    options.tiff.predictor = !parser.isSet("tiff-no-predictor");
+    options.tiff.tileSize = parser.value("tiff-tile").toInt();
+    if (!TiffHandler::isValidTileSize(options.tiff.tileSize)) {
+        qCritical().noquote() << QString("Invalid TIFF tile size, expected a multiple of 16 up to %1:")
+                                     .arg(TiffHandler::MAX_TILE_SIZE) << parser.value("tiff-tile");
+        return false;
+    }
+    if (parser.isSet("region")) {
+        const QStringList parts = parser.value("region").split(',');
+        QVector<int> values;
+        for (const QString& part : parts) {
+            bool ok = false;
+            values.append(part.trimmed().toInt(&ok));
+            if (!ok) {
+                values.clear();
+                break;
+            }
+        }
+        if (values.size() != 4 || values[2] <= 0 || values[3] <= 0) {
+            qCritical().noquote() << "Invalid region, expected x,y,width,height:" << parser.value("region");
+            return false;
+        }
+        options.region = QRect(values[0], values[1], values[2], values[3]);
+    }
+    return true;
+}
+
+int runWatch(QCoreApplication& app, const QCommandLineParser& parser)
+{
+    ImageConverter::Format format;
+    if (!ImageConverter::formatFromName(parser.value("format"), format)) {
+        qCritical().noquote() << "Unknown target format:" << parser.value("format");
+        return 1;
+    }
+    QString outputFolder = parser.value("output");
+
+    ConversionOptions options;
+    if (!parseOptions(parser, options)) {
+        return 1;
+    }
+
+    ConversionController controller;
+    if (parser.isSet("threads")) {
+        controller.setMaxThreads(parser.value("threads").toInt());
+    }
+    if (parser.isSet("prefetch")) {
+        controller.setPrefetch(qMax(0, parser.value("prefetch").toInt()));
+    }
+    controller.setLocalityOrder(parser.isSet("locality-order"));
+    ReportWriter reportWriter;
+    if (parser.isSet("report")) {
+        QString reportError;
+        if (!reportWriter.open(parser.value("report"), true, reportError)) {
+            qCritical().noquote() << reportError;
+            return 1;
+        }
+        controller.setResultSink(&reportWriter);
+    }
+    QObject::connect(&controller, &ConversionController::finished, [](const ConversionSummary& summary) {
+        qInfo().noquote() << QString("Converted %1 file(s), %2 failed, %3 duplicate(s)")
+            .arg(summary.succeeded).arg(summary.failed).arg(summary.duplicates);
+        reportStatistics();
+    });
+
+    FolderWatcher watcher;
+    if (parser.isSet("settle")) {
+        watcher.setSettleTime(parser.value("settle").toInt());
+    }
+    // Outputs written back into the watched folder must not be picked up again
+    if (outputFolder.isEmpty()) {
+        watcher.setExcludedSuffixes({ImageConverter::getExtension(format)});
+    }
+
+    // The first batch fixes the settings later batches reuse
+    bool started = false;
+    QObject::connect(&watcher, &FolderWatcher::filesReady, [&](const QStringList& files) {
+        if (!started) {
+            controller.startConversion(files, outputFolder, format, options);
+            started = true;
+        } else {
+            controller.enqueueFiles(files);
+        }
+    });
+
+    QString watchError;
+    if (!watcher.start(parser.value("watch"), parser.isSet("existing"), watchError)) {
+        qCritical().noquote() << watchError;
+        return 1;
+    }
+    qInfo().noquote() << "Watching" << parser.value("watch");
+    return app.exec();
+}
+
+int runMerge(const QCommandLineParser& parser)
+{
+    ConversionOptions options;
+    if (!parseOptions(parser, options)) {
+        return 1;
+    }
+    const QStringList inputs = parser.positionalArguments();
+    if (inputs.isEmpty()) {
+        qCritical().noquote() << "No input files to merge";
+        return 1;
+    }
+    if (!options.region.isEmpty()) {
+        qCritical().noquote() << "--region is not supported with --merge";
+        return 1;
+    }
+
+    QString mergeError;
+    if (!ImageConverter::convertToMultiPage(inputs, parser.value("merge"), options, mergeError)) {
+        qCritical().noquote() << mergeError;
+        return 1;
+    }
+    qInfo().noquote() << QString("Merged %1 file(s) into %2").arg(inputs.size()).arg(parser.value("merge"));
+    reportStatistics();
+    return 0;
+}
+
+int runCompare(const QCommandLineParser& parser)
+{
+    const QStringList reports = parser.positionalArguments();
+    if (reports.size() != 1) {
+        qCritical().noquote() << "--compare takes the baseline report and one current report";
+        return 1;
+    }
+    bool ok = false;
+    const double tolerance = parser.value("size-tolerance").toDouble(&ok);
+    if (!ok || tolerance < 0) {
+        qCritical().noquote() << "Invalid --size-tolerance";
+        return 1;
+    }
+
+    QStringList regressions;
+    QString compareError;
+    if (!ReportWriter::compare(parser.value("compare"), reports.first(), tolerance, regressions, compareError)) {
+        qCritical().noquote() << compareError;
+        return 1;
+    }
+    for (const QString& regression : regressions) {
+        qWarning().noquote() << regression;
+    }
+    qInfo().noquote() << QString("%1 regression(s)").arg(regressions.size());
+    // Non-zero on any regression, so scripts can gate on it
+    return regressions.isEmpty() ? 0 : 2;
+}
+
+int runHeadless(QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Image converter (headless modes)");
+    parser.addHelpOption();
+    parser.addOption({"daemon", "Listen for conversion requests on a local socket.", "name"});
+    parser.addOption({"threads", "Number of conversion threads for the daemon and watch mode (default: one per core).", "count"});
+    parser.addOption({"prefetch", "Upcoming inputs to read ahead in watch mode (default: two per thread, 0 disables).", "count"});
+    parser.addOption({"locality-order", "Convert in directory and inode order, for inputs on spinning disks or cold storage."});
+    parser.addOption({"watch", "Convert images dropped into a folder.", "folder"});
+    parser.addOption({"output", "Output folder for watch mode (default: watched folder).", "folder"});
+    parser.addOption({"format", "Target format for watch mode.", "format", "png"});
+    parser.addOption({"quality", "Quality for watch mode (-1 for the format default).", "quality", "-1"});
+    parser.addOption({"target-bytes", "Highest quality whose output fits this many bytes.", "bytes"});
+    parser.addOption({"auto-quality", "Pick the lowest quality that reaches the SSIM threshold."});
+    parser.addOption({"min-ssim", "SSIM threshold of --auto-quality.", "ssim",
+                      QString::number(QualitySearch::DEFAULT_MIN_SSIM)});
+    parser.addOption({"chroma", "JPEG/AVIF/HEIC chroma subsampling: auto, 420, 422 or 444.", "mode", "auto"});
+    parser.addOption({"bit-depth", "AVIF/HEIC bit depth: 8 or 10 (0 follows the source).", "bits", "0"});
+    parser.addOption({"progressive", "Write progressive JPEG (smaller, slower to encode)."});
+    parser.addOption({"fast-dct", "Use the faster, slightly less accurate JPEG DCT."});
+    parser.addOption({"webp-method", "WebP speed preset: 0 fastest, 6 smallest.", "method", "4"});
+    parser.addOption({"webp-lossless", "Write lossless WebP (quality sets the compression effort)."});
+    parser.addOption({"webp-near-lossless", "Near-lossless WebP preprocessing strength (0-100, 100 is off).", "level",
+                      "100"});
+    parser.addOption({"webp-alpha-quality", "WebP alpha plane quality (0-100).", "quality", "100"});
+    parser.addOption({"merge", "Write the given input files as the pages of one TIFF.", "file"});
+    parser.addOption({"tiff-compression", "TIFF compression: none, lzw, deflate or zstd.", "mode", "lzw"});
+    parser.addOption({"tiff-no-predictor", "Do not apply the TIFF horizontal predictor."});
+    parser.addOption({"tiff-tile", "Write TIFF in square tiles of this size (a multiple of 16, at most 4096) instead of strips.", "pixels", "0"});
+    parser.addOption({"region", "Convert only this region of each image; TIFF inputs read just the tiles it covers.",
+                      "x,y,width,height"});
+    parser.addOption({"png-fast", "Write PNG with a low compression level and one cheap filter."});
+    parser.addOption({"trusted-input", "Skip decoder integrity checks (PNG checksums) on trusted inputs."});
+    parser.addOption({"force-reencode", "Re-encode inputs already in the target format instead of copying them."});
+    parser.addOption({"png-optimize", "Search for the smallest lossless PNG for up to this many ms per image.", "ms",
+                      QString::number(PngOptimizer::DEFAULT_TIME_BUDGET_MS)});
+    parser.addOption({"report", "Append results to a JSONL or CSV report.", "file"});
+    parser.addOption({"compare", "Compare the report given as input against this baseline report.", "baseline"});
+    parser.addOption({"size-tolerance", "Output growth --compare allows before reporting a regression (0.05 = 5%).",
+                      "fraction", "0.05"});
+    parser.addOption({"settle", "Milliseconds a file must stay unchanged before converting.", "ms"});
+    parser.addOption({"buffer-pool", "Megabytes of idle image buffers kept for reuse (0 disables).", "mb",
+                      QString::number(BufferPool::DEFAULT_CAPACITY / (1024 * 1024))});
+    parser.addOption({"existing", "Also convert images already in the watched folder."});
+    parser.addPositionalArgument("inputs", "Input files for --merge, or the report for --compare.", "[inputs...]");
+    parser.process(app);
+
+    BufferPool::setCapacity(parser.value("buffer-pool").toLongLong() * 1024 * 1024);
+
+    if (parser.isSet("daemon")) {
+        return runDaemon(app, parser);
+    }
+    if (parser.isSet("merge")) {
+        return runMerge(parser);
+    }
+    if (parser.isSet("compare")) {
+        return runCompare(parser);
+    }
+    return runWatch(app, parser);
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    // Record conversion spans when a trace output path is given
+    const QString tracePath = qEnvironmentVariable("IMAGE_CONVERTERS_TRACE");
+    if (!tracePath.isEmpty()) {
+        Tracer::setEnabled(true);
+        Tracer::setThreadName("main");
+    }
+
+    int ret;
+    if (hasArgument(argc, argv, "--daemon") || hasArgument(argc, argv, "--watch") ||
+        hasArgument(argc, argv, "--merge") || hasArgument(argc, argv, "--compare")) {
+        QCoreApplication a(argc, argv);
+        ret = runHeadless(a);
+    } else {
+        QApplication a(argc, argv);
+        MainWindow w;
+        w.show();
+        ret = a.exec();
+    }
+
+    if (Tracer::isEnabled()) {
+        QString traceError;
+        if (!Tracer::writeChromeTrace(tracePath, traceError)) {
+            qWarning() << traceError;
+        }
+    }
+    return ret;
 }
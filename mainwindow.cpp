@@ -2,13 +2,18 @@
 #include "./ui_mainwindow.h"
 #include "droparea.h"
 #include "imagepreview.h"
+#include "pngoptimizer.h"
+#include "qualitysearch.h"
 
+#include <QDir>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QFileInfo>
 #include <QApplication>
 #include <QStandardItemModel>
 
+const QString MainWindow::REPORT_FILE_NAME = "conversion_report.jsonl";
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
@@ -33,13 +38,20 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->qualitySlider, &QSlider::valueChanged, ui->qualitySpinBox, &QSpinBox::setValue);
     connect(ui->qualitySpinBox, QOverload<int>::of(&QSpinBox::valueChanged), ui->qualitySlider, &QSlider::setValue);
 
+    // Automatic quality replaces the manual setting
+    connect(ui->autoQualityCheckBox, &QCheckBox::toggled, ui->qualitySlider, &QSlider::setDisabled);
+    connect(ui->autoQualityCheckBox, &QCheckBox::toggled, ui->qualitySpinBox, &QSpinBox::setDisabled);
+
+    // Resuming only makes sense when a report is kept
+    connect(ui->reportCheckBox, &QCheckBox::toggled, ui->resumeCheckBox, &QCheckBox::setEnabled);
+
     // Connect conversion controller signals
     connect(m_conversionController, &ConversionController::started,
             this, &MainWindow::onConversionStarted);
     connect(m_conversionController, &ConversionController::progress,
             this, &MainWindow::onConversionProgress);
-    connect(m_conversionController, &ConversionController::fileCompleted,
-            this, &MainWindow::onConversionFileCompleted);
+    connect(m_conversionController, &ConversionController::resultsReady,
+            this, &MainWindow::onConversionResultsReady);
     connect(m_conversionController, &ConversionController::finished,
             this, &MainWindow::onConversionFinished);
     connect(m_conversionController, &ConversionController::error,
@@ -151,10 +163,79 @@ void MainWindow::onConvertClicked()
 
     // Get target format and quality
     ImageConverter::Format targetFormat = ImageConverter::formatFromIndex(ui->formatComboBox->currentIndex());
-    int quality = ui->qualitySpinBox->value();
+    ConversionOptions options;
+    options.quality = ui->qualitySpinBox->value();
+    options.targetBytes = static_cast<qint64>(ui->targetSizeSpinBox->value()) * 1024;
+    if (ui->autoQualityCheckBox->isChecked()) {
+        options.minSsim = QualitySearch::DEFAULT_MIN_SSIM;
+    }
+    if (ui->pngOptimizeCheckBox->isChecked()) {
+        options.pngOptimizeMs = PngOptimizer::DEFAULT_TIME_BUDGET_MS;
+    }
+    options.progressive = ui->progressiveCheckBox->isChecked();
+    options.forceReencode = ui->reencodeCheckBox->isChecked();
+
+    // Combo order: Auto, 4:2:0, 4:2:2, 4:4:4 and Auto, 8-bit, 10-bit
+    static const ChromaSubsampling chromaModes[] = {
+        ChromaSubsampling::Auto, ChromaSubsampling::YUV420,
+        ChromaSubsampling::YUV422, ChromaSubsampling::YUV444
+    };
+    static const int bitDepths[] = {0, 8, 10};
+    options.yuv.chroma = chromaModes[qBound(0, ui->chromaComboBox->currentIndex(), 3)];
+    options.yuv.bitDepth = bitDepths[qBound(0, ui->bitDepthComboBox->currentIndex(), 2)];
+
+    QStringList files = m_selectedFiles;
+    if (!openReport(files)) {
+        return;
+    }
+    if (files.isEmpty()) {
+        QString ignored;
+        m_reportWriter.close(ignored);
+        QMessageBox::information(this, "Nothing to Convert",
+            "All selected files were already converted according to the report.");
+        return;
+    }
+
+    // Start conversion with quality settings
+    m_conversionController->startConversion(files, m_outputFolder, targetFormat, options);
+}
+
+bool MainWindow::openReport(QStringList& files)
+{
+    if (!ui->reportCheckBox->isChecked()) {
+        m_conversionController->setResultSink(nullptr);
+        return true;
+    }
+
+    QString reportDir = m_outputFolder.isEmpty() ? QFileInfo(files.first()).absolutePath() : m_outputFolder;
+    QString reportPath = reportDir + "/" + REPORT_FILE_NAME;
 
-    // Start conversion with quality setting
-    m_conversionController->startConversion(m_selectedFiles, m_outputFolder, targetFormat, quality);
+    // Drop inputs the previous run already converted
+    if (ui->resumeCheckBox->isChecked() && QFileInfo::exists(reportPath)) {
+        QSet<QString> converted;
+        QString loadError;
+        if (!ReportWriter::loadSucceededInputs(reportPath, converted, loadError)) {
+            QMessageBox::warning(this, "Report Error", loadError);
+            return false;
+        }
+        QStringList remaining;
+        for (const QString& file : files) {
+            if (!converted.contains(file)) {
+                remaining.append(file);
+            }
+        }
+        files = remaining;
+    }
+
+    // A fresh run starts a fresh report; only resuming keeps the earlier records
+    QDir().mkpath(reportDir);
+    QString openError;
+    if (!m_reportWriter.open(reportPath, ui->resumeCheckBox->isChecked(), openError)) {
+        QMessageBox::warning(this, "Report Error", openError);
+        return false;
+    }
+    m_conversionController->setResultSink(&m_reportWriter);
+    return true;
 }
 
 void MainWindow::onConversionStarted()
@@ -164,28 +245,41 @@ void MainWindow::onConversionStarted()
     ui->progressBar->setValue(0);
     ui->convertBtn->setText("Cancel");
     ui->convertBtn->setEnabled(true);
+    m_failedResults.clear();
     ui->statusbar->showMessage("Starting conversion...");
 }
 
 void MainWindow::onConversionProgress(int current, int total, const QString& currentFile)
 {
-    int percentage = (current * 100) / total;
+    if (total <= 0) {
+        return;
+    }
+    int percentage = static_cast<int>((static_cast<qint64>(current) * 100) / total);
     ui->progressBar->setValue(percentage);
-    ui->statusbar->showMessage(QString("Converting %1 of %2: %3").arg(current).arg(total).arg(currentFile));
+    ui->statusbar->showMessage(QString("Converted %1 of %2: %3").arg(current).arg(total).arg(currentFile));
 }
 
-void MainWindow::onConversionFileCompleted(const ConversionResult& result)
+void MainWindow::onConversionResultsReady(const QList<ConversionResult>& results)
 {
-    Q_UNUSED(result);
-    // Could update list widget to show status per file
+    // Only the first few failures are kept for the summary dialog
+    for (const ConversionResult& result : results) {
+        if (!result.success && m_failedResults.size() < MAX_LISTED_FAILURES) {
+            m_failedResults.append(result);
+        }
+    }
 }
 
-void MainWindow::onConversionFinished(const QList<ConversionResult>& results)
+void MainWindow::onConversionFinished(const ConversionSummary& summary)
 {
     setUIEnabled(true);
     ui->progressBar->setVisible(false);
     ui->convertBtn->setText("Convert Images");
-    showConversionResults(results);
+
+    QString reportError;
+    if (!m_reportWriter.close(reportError)) {
+        ui->statusbar->showMessage("Error: " + reportError);
+    }
+    showConversionResults(summary);
 }
 
 void MainWindow::onConversionError(const QString& message)
@@ -207,25 +301,29 @@ void MainWindow::updateConvertButtonState()
     ui->convertBtn->setEnabled(!m_selectedFiles.isEmpty());
 }
 
-void MainWindow::showConversionResults(const QList<ConversionResult>& results)
+void MainWindow::showConversionResults(const ConversionSummary& summary)
 {
-    int successCount = 0;
-    int failCount = 0;
+    int successCount = summary.succeeded;
+    int failCount = summary.failed;
     QStringList errors;
 
-    for (const ConversionResult& result : results) {
-        if (result.success) {
-            successCount++;
-        } else {
-            failCount++;
-            QFileInfo info(result.inputFile);
-            errors.append(QString("%1: %2").arg(info.fileName(), result.errorMessage));
-        }
+    for (const ConversionResult& result : m_failedResults) {
+        QFileInfo info(result.inputFile);
+        errors.append(QString("%1: %2").arg(info.fileName(), result.errorMessage));
+    }
+    if (failCount > errors.size()) {
+        errors.append(QString("... and %1 more").arg(failCount - errors.size()));
+    }
+    if (!m_reportWriter.filePath().isEmpty() && ui->reportCheckBox->isChecked()) {
+        errors.append("\nFull report: " + QDir::toNativeSeparators(m_reportWriter.filePath()));
     }
 
     QString message;
     if (failCount == 0) {
         message = QString("Successfully converted %1 file(s)!").arg(successCount);
+        if (summary.duplicates > 0) {
+            message += QString("\n%1 were duplicates of another input.").arg(summary.duplicates);
+        }
         ui->statusbar->showMessage(message);
         QMessageBox::information(this, "Conversion Complete", message);
     } else if (successCount == 0) {
@@ -291,6 +389,15 @@ void MainWindow::setUIEnabled(bool enabled)
     ui->outputFolderBtn->setEnabled(enabled);
     ui->formatComboBox->setEnabled(enabled);
     ui->fileListWidget->setEnabled(enabled);
-    ui->qualitySlider->setEnabled(enabled);
-    ui->qualitySpinBox->setEnabled(enabled);
+    ui->qualitySlider->setEnabled(enabled && !ui->autoQualityCheckBox->isChecked());
+    ui->qualitySpinBox->setEnabled(enabled && !ui->autoQualityCheckBox->isChecked());
+    ui->autoQualityCheckBox->setEnabled(enabled);
+    ui->pngOptimizeCheckBox->setEnabled(enabled);
+    ui->progressiveCheckBox->setEnabled(enabled);
+    ui->reencodeCheckBox->setEnabled(enabled);
+    ui->chromaComboBox->setEnabled(enabled);
+    ui->bitDepthComboBox->setEnabled(enabled);
+    ui->targetSizeSpinBox->setEnabled(enabled);
+    ui->reportCheckBox->setEnabled(enabled);
+    ui->resumeCheckBox->setEnabled(enabled && ui->reportCheckBox->isChecked());
 }
@@ -5,6 +5,7 @@
 #include <QStringList>
 #include "imageconverter.h"
 #include "conversionworker.h"
+#include "reportwriter.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -31,8 +32,8 @@ private slots:
     // Conversion progress slots
     void onConversionStarted();
     void onConversionProgress(int current, int total, const QString& currentFile);
-    void onConversionFileCompleted(const ConversionResult& result);
-    void onConversionFinished(const QList<ConversionResult>& results);
+    void onConversionResultsReady(const QList<ConversionResult>& results);
+    void onConversionFinished(const ConversionSummary& summary);
     void onConversionError(const QString& message);
 
 private:
@@ -41,12 +42,20 @@ private:
     QString m_outputFolder;
     ImageConverter *m_converter;
     ConversionController *m_conversionController;
+    ReportWriter m_reportWriter;
+    QList<ConversionResult> m_failedResults;
+
+    // Failures listed in the summary dialog; the rest are in the report
+    static const int MAX_LISTED_FAILURES = 20;
+    static const QString REPORT_FILE_NAME;
 
     void updateFileList();
     void updateConvertButtonState();
-    void showConversionResults(const QList<ConversionResult>& results);
+    void showConversionResults(const ConversionSummary& summary);
     void updateFormatAvailability();
     void setUIEnabled(bool enabled);
+    bool openReport(QStringList& files);
+
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,362 @@
+#include "outputwriter.h"
+#include "tracer.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <QAtomicInteger>
+#include <cerrno>
+#endif
+
+namespace {
+
+// Make the renames into a directory durable; a no-op where directories cannot be synced
+void syncDirectories(const QSet<QString>& directories)
+{
+#ifdef Q_OS_UNIX
+    for (const QString& directory : directories) {
+        const int fd = ::open(QFile::encodeName(directory).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+#else
+    Q_UNUSED(directories);
+#endif
+}
+
+#ifdef HAVE_LIBURING
+// Longest single write submitted; larger buffers continue in follow-up writes
+const qint64 MAX_WRITE_BYTES = 1 << 30;
+
+// One file of an io_uring batch
+struct PendingWrite {
+    const QByteArray* data = nullptr;
+    int fd = -1;
+    QByteArray tempPath;
+    qint64 written = 0;
+    bool syncing = false;
+    QString errorMessage;
+};
+
+// Temporary file beside the destination, so the rename stays on one filesystem
+int openTemporary(const QString& filePath, QByteArray& tempPath)
+{
+    static QAtomicInteger<quint32> counter;
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        tempPath = QFile::encodeName(filePath) + '.' + QByteArray::number(getpid()) + '.' +
+                   QByteArray::number(counter.fetchAndAddRelaxed(1)) + ".part";
+        // 0666 before the umask, as for any newly created output
+        const int fd = ::open(tempPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd >= 0) {
+            // A replaced output keeps its permissions, as with QSaveFile
+            struct stat existing;
+            if (::stat(QFile::encodeName(filePath).constData(), &existing) == 0) {
+                ::fchmod(fd, existing.st_mode & 07777);
+            }
+            return fd;
+        }
+        if (errno != EEXIST) {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+// Queue the next step for a file: the rest of its data, then a data sync
+void queueNext(io_uring* ring, PendingWrite& write)
+{
+    io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    if (write.written < write.data->size()) {
+        const qint64 length = qMin<qint64>(write.data->size() - write.written, MAX_WRITE_BYTES);
+        io_uring_prep_write(sqe, write.fd, write.data->constData() + write.written,
+                            static_cast<unsigned>(length), static_cast<__u64>(write.written));
+    } else {
+        io_uring_prep_fsync(sqe, write.fd, IORING_FSYNC_DATASYNC);
+        write.syncing = true;
+    }
+    io_uring_sqe_set_data(sqe, &write);
+}
+
+// Rings need IORING_OP_WRITE (Linux 5.6); older kernels and seccomp filters get the thread pool
+io_uring* createRing()
+{
+    io_uring* ring = new io_uring;
+    if (io_uring_queue_init(OutputWriter::BATCH_SIZE, ring, 0) != 0) {
+        delete ring;
+        return nullptr;
+    }
+    io_uring_probe* probe = io_uring_get_probe_ring(ring);
+    const bool supported = probe && io_uring_opcode_supported(probe, IORING_OP_WRITE) &&
+                           io_uring_opcode_supported(probe, IORING_OP_FSYNC);
+    if (probe) {
+        io_uring_free_probe(probe);
+    }
+    if (!supported) {
+        io_uring_queue_exit(ring);
+        delete ring;
+        return nullptr;
+    }
+    return ring;
+}
+#endif
+
+} // namespace
+
+OutputWriter::OutputWriter()
+    : m_pendingBytes(0)
+    , m_closing(false)
+    , m_thread(nullptr)
+    , m_ring(nullptr)
+{
+    m_pool.setMaxThreadCount(FALLBACK_THREADS);
+}
+
+OutputWriter::~OutputWriter()
+{
+    close();
+}
+
+void OutputWriter::start()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closing = false;
+    }
+#ifdef HAVE_LIBURING
+    if (!m_thread) {
+        m_ring = createRing();
+        if (m_ring) {
+            m_thread = QThread::create([this]() { run(); });
+            m_thread->start();
+        }
+    }
+#endif
+}
+
+void OutputWriter::close()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closing = true;
+        m_queueNotEmpty.wakeAll();
+    }
+    if (m_thread) {
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+    m_pool.waitForDone();
+
+    // Fallback writers sync the directories they renamed into once per batch
+    QSet<QString> directories;
+    {
+        QMutexLocker locker(&m_mutex);
+        directories.swap(m_unsyncedDirectories);
+    }
+    syncDirectories(directories);
+#ifdef HAVE_LIBURING
+    if (m_ring) {
+        io_uring_queue_exit(m_ring);
+        delete m_ring;
+        m_ring = nullptr;
+    }
+#endif
+}
+
+bool OutputWriter::usesIoUring() const
+{
+    return m_ring != nullptr;
+}
+
+void OutputWriter::submit(const QString& filePath, const QByteArray& data, const Completion& done)
+{
+    QMutexLocker locker(&m_mutex);
+    // Only when far behind: waiting beats buffering without bound
+    while (m_pendingBytes > 0 && m_pendingBytes + data.size() > MAX_PENDING_BYTES) {
+        m_queueNotFull.wait(&m_mutex);
+    }
+    m_pendingBytes += data.size();
+
+    Job job;
+    job.filePath = filePath;
+    job.data = data;
+    job.done = done;
+    if (m_thread) {
+        m_queue.append(job);
+        m_queueNotEmpty.wakeOne();
+        return;
+    }
+    locker.unlock();
+
+    m_pool.start([this, job]() {
+        QString errorMessage;
+        const bool written = writeFile(job.filePath, job.data, errorMessage);
+        if (written) {
+            QMutexLocker locker(&m_mutex);
+            m_unsyncedDirectories.insert(QFileInfo(job.filePath).absolutePath());
+        }
+        complete(job, written, errorMessage);
+    });
+}
+
+bool OutputWriter::writeFile(const QString& filePath, const QByteArray& data, QString& errorMessage)
+{
+    TraceSpan span("writeOutput", "io", filePath);
+    // Writes to a temporary file and renames it over the destination on commit()
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = "Failed to open output file for writing";
+        return false;
+    }
+    if (file.write(data) != data.size()) {
+        errorMessage = "Failed to write complete file";
+        return false;
+    }
+    if (!file.commit()) {
+        errorMessage = "Failed to move output file into place";
+        return false;
+    }
+    return true;
+}
+
+void OutputWriter::run()
+{
+    Tracer::setThreadName("OutputWriter");
+    QList<Job> batch;
+    for (;;) {
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.isEmpty() && !m_closing) {
+                m_queueNotEmpty.wait(&m_mutex);
+            }
+            if (m_queue.isEmpty()) {
+                return;
+            }
+            // Whatever queued up while the last batch was in flight, up to the ring size
+            while (!m_queue.isEmpty() && batch.size() < BATCH_SIZE) {
+                batch.append(m_queue.takeFirst());
+            }
+        }
+        writeBatch(batch);
+        batch.clear();
+    }
+}
+
+void OutputWriter::writeBatch(QList<Job>& batch)
+{
+#ifdef HAVE_LIBURING
+    if (m_ring) {
+        TraceSpan span("OutputWriter::writeBatch", "io");
+        QVector<PendingWrite> writes(batch.size());
+        int inFlight = 0;
+        for (int i = 0; i < batch.size(); ++i) {
+            PendingWrite& write = writes[i];
+            write.data = &batch[i].data;
+            write.fd = openTemporary(batch[i].filePath, write.tempPath);
+            if (write.fd < 0) {
+                write.errorMessage = "Failed to open output file for writing";
+                continue;
+            }
+            queueNext(m_ring, write);
+            ++inFlight;
+        }
+        io_uring_submit(m_ring);
+
+        while (inFlight > 0) {
+            io_uring_cqe* cqe = nullptr;
+            const int waited = io_uring_wait_cqe(m_ring, &cqe);
+            if (waited == -EINTR) {
+                continue;
+            }
+            if (waited < 0) {
+                // Only a broken ring fails here; closing it lets the kernel finish or cancel
+                // what is in flight, and later batches go through the fallback
+                for (PendingWrite& write : writes) {
+                    if (write.errorMessage.isEmpty()) {
+                        write.errorMessage = "Failed to write complete file";
+                    }
+                }
+                io_uring_queue_exit(m_ring);
+                delete m_ring;
+                m_ring = nullptr;
+                break;
+            }
+
+            PendingWrite& write = *static_cast<PendingWrite*>(io_uring_cqe_get_data(cqe));
+            const int res = cqe->res;
+            io_uring_cqe_seen(m_ring, cqe);
+            --inFlight;
+
+            if (res < 0 || (!write.syncing && res == 0)) {
+                write.errorMessage = write.syncing ? "Failed to sync output file" : "Failed to write complete file";
+            } else if (!write.syncing) {
+                // Short writes continue where they stopped
+                write.written += res;
+                queueNext(m_ring, write);
+                ++inFlight;
+            }
+            // Submit follow-ups once every completion already posted has been handled
+            if (io_uring_cq_ready(m_ring) == 0) {
+                io_uring_submit(m_ring);
+            }
+        }
+
+        QSet<QString> directories;
+        for (int i = 0; i < batch.size(); ++i) {
+            PendingWrite& write = writes[i];
+            if (write.fd >= 0) {
+                ::close(write.fd);
+                if (write.errorMessage.isEmpty() &&
+                    ::rename(write.tempPath.constData(), QFile::encodeName(batch[i].filePath).constData()) != 0) {
+                    write.errorMessage = "Failed to move output file into place";
+                }
+                if (!write.errorMessage.isEmpty()) {
+                    ::unlink(write.tempPath.constData());
+                } else {
+                    directories.insert(QFileInfo(batch[i].filePath).absolutePath());
+                }
+            }
+        }
+
+        // One directory sync per batch makes all of its renames durable
+        syncDirectories(directories);
+        for (int i = 0; i < batch.size(); ++i) {
+            complete(batch[i], writes[i].errorMessage.isEmpty(), writes[i].errorMessage);
+        }
+        return;
+    }
+#endif
+    QVector<QString> errors(batch.size());
+    QSet<QString> directories;
+    for (int i = 0; i < batch.size(); ++i) {
+        if (writeFile(batch[i].filePath, batch[i].data, errors[i])) {
+            directories.insert(QFileInfo(batch[i].filePath).absolutePath());
+        }
+    }
+    syncDirectories(directories);
+    for (int i = 0; i < batch.size(); ++i) {
+        complete(batch[i], errors[i].isEmpty(), errors[i]);
+    }
+}
+
+void OutputWriter::complete(const Job& job, bool success, const QString& errorMessage)
+{
+    job.done(success, errorMessage);
+
+    QMutexLocker locker(&m_mutex);
+    m_pendingBytes -= job.data.size();
+    m_queueNotFull.wakeAll();
+}
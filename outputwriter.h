@@ -0,0 +1,106 @@
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <functional>
+
+class QThread;
+struct io_uring;
+
+/**
+ * @brief Writes encoded outputs off the conversion threads
+ *
+ * Conversion threads hand over finished output buffers and go on to the
+ * next file while the writer puts them on disk. Writing to a slow share
+ * then overlaps encoding instead of stalling it.
+ *
+ * Every file is written to a temporary name next to its destination,
+ * synced and renamed into place, so readers (and a crash) see either the
+ * old file or the complete new one, never a partial write. A replaced
+ * file keeps its permissions. The directories renamed into are synced
+ * once per batch, so the renames themselves survive a crash.
+ *
+ * With liburing, one writer thread submits each queued batch as io_uring
+ * writes and syncs, keeping them all in flight at once. Without it, or
+ * where the kernel refuses a ring, a small pool of threads writes
+ * concurrently instead.
+ */
+class OutputWriter
+{
+public:
+    // Called on a writer thread once the file is in place, or the write has failed
+    typedef std::function<void(bool success, const QString& errorMessage)> Completion;
+
+    // Buffered output bytes before submit() blocks waiting for the writer
+    static const qint64 MAX_PENDING_BYTES = 512 * 1024 * 1024;
+
+    // Files in flight at once: io_uring batch size, or fallback threads
+    static const int BATCH_SIZE = 32;
+    static const int FALLBACK_THREADS = 4;
+
+    OutputWriter();
+    ~OutputWriter();
+
+    /**
+     * @brief Start the writer; picks io_uring when available
+     */
+    void start();
+
+    /**
+     * @brief Finish every queued write, run its completion and stop
+     */
+    void close();
+
+    bool usesIoUring() const;
+
+    /**
+     * @brief Queue a file write
+     *
+     * Returns at once unless MAX_PENDING_BYTES of output are already
+     * waiting. The completion runs on a writer thread.
+     *
+     * @param filePath Destination, replaced atomically if it exists
+     * @param data File content
+     * @param done Completion callback
+     */
+    void submit(const QString& filePath, const QByteArray& data, const Completion& done);
+
+    /**
+     * @brief Write a file on the calling thread through a temporary file renamed into place
+     * @param filePath Destination, replaced atomically if it exists
+     * @param data File content
+     * @param errorMessage Output error message if writing fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeFile(const QString& filePath, const QByteArray& data, QString& errorMessage);
+
+private:
+    struct Job {
+        QString filePath;
+        QByteArray data;
+        Completion done;
+    };
+
+    void run();
+    void writeBatch(QList<Job>& batch);
+    void complete(const Job& job, bool success, const QString& errorMessage);
+
+    QMutex m_mutex;
+    QWaitCondition m_queueNotEmpty;
+    QWaitCondition m_queueNotFull;
+    QList<Job> m_queue;
+    qint64 m_pendingBytes;   // Queued and in flight
+    bool m_closing;
+    QSet<QString> m_unsyncedDirectories; // Renamed into by fallback writers since the last close()
+    QThread* m_thread;       // io_uring submitter
+    io_uring* m_ring;
+    QThreadPool m_pool;      // Fallback writers
+};
+
+#endif // OUTPUTWRITER_H
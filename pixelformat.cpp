@@ -0,0 +1,176 @@
+#include "pixelformat.h"
+#include "tracer.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QPixelFormat>
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+struct Traits {
+    bool alpha = false;
+    bool premultiplied = false;
+    bool gray = false;
+    bool indexed = false;   // Palette (including 1-bit) layouts
+    bool wide = false;      // More than 8 bits per channel
+};
+
+Traits traitsOf(QImage::Format format)
+{
+    const QPixelFormat pixel = QImage::toPixelFormat(format);
+    Traits traits;
+    traits.alpha = pixel.alphaUsage() == QPixelFormat::UsesAlpha;
+    traits.premultiplied = pixel.premultiplied() == QPixelFormat::Premultiplied;
+    traits.gray = pixel.colorModel() == QPixelFormat::Grayscale;
+    traits.indexed = pixel.colorModel() == QPixelFormat::Indexed;
+    traits.wide = static_cast<int>(pixel.bitsPerPixel()) > (traits.gray ? 8 : 32);
+    return traits;
+}
+
+typedef QPair<int, int> FormatPair;
+
+QMutex& statisticsMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+QHash<FormatPair, qint64>& avoidedCounts()
+{
+    static QHash<FormatPair, qint64> counts;
+    return counts;
+}
+
+} // namespace
+
+QImage::Format PixelFormat::choose(const QImage& image, const QVector<QImage::Format>& accepted)
+{
+    if (accepted.contains(image.format())) {
+        return image.format();
+    }
+
+    Traits source = traitsOf(image.format());
+    source.alpha = image.hasAlphaChannel(); // Indexed images carry alpha in their palette
+
+    QImage::Format best = QImage::Format_Invalid;
+    int bestPenalty = INT_MAX;
+    for (QImage::Format format : accepted) {
+        const Traits traits = traitsOf(format);
+        // Never drop alpha, color or depth, nor quantize to a palette
+        if ((source.alpha && !traits.alpha) || (traits.gray && !source.gray) || (source.wide && !traits.wide) ||
+            (traits.indexed && !source.indexed)) {
+            continue;
+        }
+        // Then prefer the same alpha use and depth, straight alpha and the same color model
+        const int penalty = (traits.alpha != source.alpha ? 8 : 0) + (traits.wide != source.wide ? 4 : 0) +
+                            (traits.premultiplied ? 2 : 0) +
+                            (traits.gray != source.gray || traits.indexed != source.indexed ? 1 : 0);
+        if (penalty < bestPenalty) {
+            best = format;
+            bestPenalty = penalty;
+        }
+    }
+    return best;
+}
+
+QImage PixelFormat::negotiate(const QImage& image, const QVector<QImage::Format>& accepted)
+{
+    if (image.isNull() || accepted.isEmpty()) {
+        return image;
+    }
+    const QImage::Format target = choose(image, accepted);
+    if (target == QImage::Format_Invalid || target == image.format()) {
+        return image;
+    }
+
+    TraceSpan span("PixelFormat::convert", "convert");
+    return image.convertToFormat(target);
+}
+
+QImage PixelFormat::negotiate(const QImage& image, const QVector<QImage::Format>& accepted,
+                              QImage::Format former)
+{
+    if (image.isNull()) {
+        return image;
+    }
+    QImage::Format target = choose(image, accepted);
+    if (target == QImage::Format_Invalid) {
+        // Nothing accepted keeps everything; lose it the way the consumer always did
+        target = former;
+    }
+    if (target == image.format()) {
+        if (image.format() != former) {
+            recordAvoided(image.format(), former);
+        }
+        return image;
+    }
+
+    TraceSpan span("PixelFormat::convert", "convert");
+    return image.convertToFormat(target);
+}
+
+void PixelFormat::recordAvoided(QImage::Format from, QImage::Format to, int count)
+{
+    if (count <= 0 || from == to) {
+        return;
+    }
+    QMutexLocker locker(&statisticsMutex());
+    avoidedCounts()[FormatPair(from, to)] += count;
+}
+
+QStringList PixelFormat::avoidedConversions()
+{
+    QVector<QPair<FormatPair, qint64>> entries;
+    {
+        QMutexLocker locker(&statisticsMutex());
+        const QHash<FormatPair, qint64>& counts = avoidedCounts();
+        for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+            entries.append(qMakePair(it.key(), it.value()));
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const QPair<FormatPair, qint64>& a,
+                                                 const QPair<FormatPair, qint64>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    QStringList lines;
+    for (const auto& entry : entries) {
+        lines.append(QString("%1 -> %2: %3")
+            .arg(name(static_cast<QImage::Format>(entry.first.first)))
+            .arg(name(static_cast<QImage::Format>(entry.first.second)))
+            .arg(entry.second));
+    }
+    return lines;
+}
+
+QString PixelFormat::name(QImage::Format format)
+{
+    switch (format) {
+        case QImage::Format_Mono: return "Mono";
+        case QImage::Format_MonoLSB: return "MonoLSB";
+        case QImage::Format_Indexed8: return "Indexed8";
+        case QImage::Format_RGB32: return "RGB32";
+        case QImage::Format_ARGB32: return "ARGB32";
+        case QImage::Format_ARGB32_Premultiplied: return "ARGB32_Premultiplied";
+        case QImage::Format_RGB16: return "RGB16";
+        case QImage::Format_RGB888: return "RGB888";
+        case QImage::Format_RGBX8888: return "RGBX8888";
+        case QImage::Format_RGBA8888: return "RGBA8888";
+        case QImage::Format_RGBA8888_Premultiplied: return "RGBA8888_Premultiplied";
+        case QImage::Format_Grayscale8: return "Grayscale8";
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        case QImage::Format_RGBX64: return "RGBX64";
+        case QImage::Format_RGBA64: return "RGBA64";
+        case QImage::Format_RGBA64_Premultiplied: return "RGBA64_Premultiplied";
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        case QImage::Format_Grayscale16: return "Grayscale16";
+#endif
+        default: return QString("Format%1").arg(static_cast<int>(format));
+    }
+}
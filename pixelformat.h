@@ -0,0 +1,62 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+#include <QImage>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief Pixel format negotiation between decoders and encoders
+ *
+ * Encoders declare the QImage formats they read in place. An image already
+ * in one of them is passed through untouched; any other is converted once,
+ * to the accepted format that keeps its alpha channel, color and bit depth
+ * (and is never quantized to a palette).
+ * Conversions skipped this way are counted per format pair, so the savings
+ * of a batch can be reported.
+ */
+class PixelFormat
+{
+public:
+    /**
+     * @brief Pick the accepted format an image is best converted to
+     * @param image Source image
+     * @param accepted Formats the consumer reads in place, preferred first
+     * @return The image's own format if accepted, the closest accepted format
+     *         that loses nothing, or QImage::Format_Invalid if every one would
+     */
+    static QImage::Format choose(const QImage& image, const QVector<QImage::Format>& accepted);
+
+    /**
+     * @brief Bring an image into one of the accepted formats
+     * @param image Source image
+     * @param accepted Formats the consumer reads in place; empty accepts any
+     * @return The image itself if nothing needs converting (or nothing lossless
+     *         is accepted), else a copy converted once
+     */
+    static QImage negotiate(const QImage& image, const QVector<QImage::Format>& accepted);
+
+    /**
+     * @brief Like negotiate(), for a consumer that used to convert to one fixed format
+     * @param former Format the consumer previously converted every image to; an
+     *        accepted image in another format counts as an avoided conversion, and
+     *        an image no accepted format holds losslessly is still converted to it
+     */
+    static QImage negotiate(const QImage& image, const QVector<QImage::Format>& accepted,
+                            QImage::Format former);
+
+    /**
+     * @brief Count full-image conversions skipped for a format pair
+     */
+    static void recordAvoided(QImage::Format from, QImage::Format to, int count = 1);
+
+    /**
+     * @brief Avoided conversions as "ARGB32 -> RGBA8888: 12" lines, most frequent first
+     */
+    static QStringList avoidedConversions();
+
+    // Short name of a format, such as "RGBA8888"
+    static QString name(QImage::Format format);
+};
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,478 @@
+#include "pnghandler.h"
+#include "bufferpool.h"
+#include "pixelformat.h"
+#include "tracer.h"
+
+#include <QPixelFormat>
+#include <QPointF>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#ifdef HAVE_LIBSPNG
+#include <spng.h>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#endif
+
+namespace {
+
+struct SpngDeleter {
+    void operator()(spng_ctx* ctx) const { spng_ctx_free(ctx); }
+};
+using SpngContext = std::unique_ptr<spng_ctx, SpngDeleter>;
+
+QString spngError(const char* what, int error)
+{
+    return QString("%1: %2").arg(what).arg(spng_strerror(error));
+}
+
+// Pack one scanline of a 32-bit layout into PNG's RGB or RGBA byte order
+void packRow(const QImage& image, int y, uchar* out)
+{
+    const int width = image.width();
+    if (image.format() == QImage::Format_RGBX8888) {
+        const uchar* in = image.constScanLine(y);
+        for (int x = 0; x < width; ++x, in += 4, out += 3) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }
+        return;
+    }
+
+    // 0xAARRGGBB words
+    const QRgb* in = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    const bool alpha = image.format() == QImage::Format_ARGB32;
+    for (int x = 0; x < width; ++x) {
+        *out++ = static_cast<uchar>(qRed(in[x]));
+        *out++ = static_cast<uchar>(qGreen(in[x]));
+        *out++ = static_cast<uchar>(qBlue(in[x]));
+        if (alpha) {
+            *out++ = static_cast<uchar>(qAlpha(in[x]));
+        }
+    }
+}
+
+// Pack one scanline of a 16-bit layout into PNG's big-endian samples, dropping RGBX64's padding
+void packRow16(const QImage& image, int y, int channels, uchar* out)
+{
+    const quint16* in = reinterpret_cast<const quint16*>(image.constScanLine(y));
+    const int step = image.depth() == 16 ? 1 : 4;
+    for (int x = 0; x < image.width(); ++x, in += step) {
+        for (int c = 0; c < channels; ++c, out += 2) {
+            qToBigEndian<quint16>(in[c], out);
+        }
+    }
+}
+
+// Carry resolution and text chunks into the image, as Qt's reader does
+void readMetadata(spng_ctx* ctx, QImage& image)
+{
+    spng_phys phys;
+    if (spng_get_phys(ctx, &phys) == 0 && phys.unit_specifier == 1 && phys.ppu_x > 0 && phys.ppu_y > 0) {
+        image.setDotsPerMeterX(static_cast<int>(phys.ppu_x));
+        image.setDotsPerMeterY(static_cast<int>(phys.ppu_y));
+    }
+
+    uint32_t count = 0;
+    if (spng_get_text(ctx, nullptr, &count) == 0 && count > 0) {
+        QVector<spng_text> texts(static_cast<int>(count));
+        if (spng_get_text(ctx, texts.data(), &count) == 0) {
+            for (const spng_text& text : texts) {
+                const QByteArray value(text.text, static_cast<int>(text.length));
+                image.setText(QString::fromLatin1(text.keyword),
+                              text.type == SPNG_ITXT ? QString::fromUtf8(value) : QString::fromLatin1(value));
+            }
+        }
+    }
+}
+
+// Write the image's resolution and text the way Qt's writer does: pHYs,
+// then tEXt for Latin-1 values and iTXt for the rest
+int writeMetadata(spng_ctx* ctx, const QImage& image)
+{
+    if (image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0) {
+        spng_phys phys = {};
+        phys.ppu_x = static_cast<uint32_t>(image.dotsPerMeterX());
+        phys.ppu_y = static_cast<uint32_t>(image.dotsPerMeterY());
+        phys.unit_specifier = 1;  // Meter
+        const int error = spng_set_phys(ctx, &phys);
+        if (error) {
+            return error;
+        }
+    }
+
+    // Keywords are 1-79 Latin-1 characters; others cannot be stored
+    QVector<QByteArray> values;
+    QVector<spng_text> texts;
+    const QStringList keys = image.textKeys();
+    values.reserve(keys.size());
+    for (const QString& key : keys) {
+        const QByteArray keyword = key.toLatin1();
+        if (keyword.isEmpty() || keyword.size() > 79 || QString::fromLatin1(keyword) != key) {
+            continue;
+        }
+        const QString value = image.text(key);
+        const QByteArray latin1 = value.toLatin1();
+        const bool isLatin1 = QString::fromLatin1(latin1) == value;
+        values.append(isLatin1 ? latin1 : value.toUtf8());
+
+        spng_text text = {};
+        qstrncpy(text.keyword, keyword.constData(), sizeof(text.keyword));
+        text.type = isLatin1 ? SPNG_TEXT : SPNG_ITXT;
+        text.length = static_cast<size_t>(values.last().size());
+        text.text = const_cast<char*>(values.last().constData());
+        text.language_tag = const_cast<char*>("");
+        text.translated_keyword = const_cast<char*>("");
+        texts.append(text);
+    }
+    return texts.isEmpty() ? 0 : spng_set_text(ctx, texts.data(), static_cast<uint32_t>(texts.size()));
+}
+
+} // namespace
+#endif
+
+PngHandler::PngHandler()
+{
+}
+
+PngHandler::~PngHandler()
+{
+}
+
+bool PngHandler::isAvailable()
+{
+#ifdef HAVE_LIBSPNG
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PngHandler::canWrite(const QImage& image)
+{
+    if (image.isNull()) {
+        return false;
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    return true;
+#else
+    // Deeper layouts are written as 16-bit through RGBA64, which older Qt lacks
+    const QPixelFormat pixel = QImage::toPixelFormat(image.format());
+    return pixel.colorModel() == QPixelFormat::Grayscale ? pixel.bitsPerPixel() <= 8 : pixel.redSize() <= 8;
+#endif
+}
+
+QVector<QImage::Format> PngHandler::writeFormats()
+{
+    return {QImage::Format_RGBA8888, QImage::Format_RGB888, QImage::Format_Grayscale8, QImage::Format_Indexed8,
+            QImage::Format_RGBX8888, QImage::Format_RGB32, QImage::Format_ARGB32,
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+            QImage::Format_RGBA64, QImage::Format_RGBX64,
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+            QImage::Format_Grayscale16,
+#endif
+    };
+}
+
+bool PngHandler::readData(const QByteArray& data, bool skipChecksums, QImage& image, QString& errorMessage)
+{
+    TraceSpan span("PngHandler::read", "codec");
+
+#ifdef HAVE_LIBSPNG
+    SpngContext ctx(spng_ctx_new(skipChecksums ? SPNG_CTX_IGNORE_ADLER32 : 0));
+    if (!ctx) {
+        errorMessage = "Failed to create PNG decoder";
+        return false;
+    }
+    if (skipChecksums) {
+        spng_set_crc_action(ctx.get(), SPNG_CRC_USE, SPNG_CRC_USE);
+    }
+
+    int error = spng_set_png_buffer(ctx.get(), data.constData(), static_cast<size_t>(data.size()));
+    spng_ihdr ihdr;
+    if (!error) {
+        error = spng_get_ihdr(ctx.get(), &ihdr);
+    }
+    if (error) {
+        errorMessage = spngError("Failed to read PNG header", error);
+        return false;
+    }
+
+    spng_trns trns;
+    const bool hasTrns = spng_get_trns(ctx.get(), &trns) == 0;
+    const bool hasAlpha = hasTrns || ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA ||
+                          ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+
+    // Pick the output layout closest to the file's, so little is expanded
+    int format;
+    QImage::Format imageFormat;
+    if (ihdr.bit_depth == 16) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        format = SPNG_FMT_RGBA16;
+        imageFormat = QImage::Format_RGBA64;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE && !hasTrns) {
+            // The file's own layout, in host byte order
+            format = SPNG_FMT_PNG;
+            imageFormat = QImage::Format_Grayscale16;
+        }
+#endif
+#else
+        errorMessage = "16-bit PNG needs Qt 5.12 or later";
+        return false;
+#endif
+    } else if (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE && !hasTrns) {
+        format = SPNG_FMT_G8;
+        imageFormat = QImage::Format_Grayscale8;
+    } else {
+        format = SPNG_FMT_RGBA8;
+        imageFormat = hasAlpha ? QImage::Format_RGBA8888 : QImage::Format_RGBX8888;
+    }
+
+    QImage decoded = BufferPool::createImage(static_cast<int>(ihdr.width), static_cast<int>(ihdr.height),
+                                             imageFormat);
+    if (decoded.isNull()) {
+        errorMessage = "Failed to allocate image";
+        return false;
+    }
+
+    // Decode row by row into the QImage's (padded) scanlines; interlaced
+    // images visit rows several times and out of order
+    size_t rowBytes = 0;
+    error = spng_decoded_image_size(ctx.get(), format, &rowBytes);
+    if (!error) {
+        rowBytes /= ihdr.height;
+        // tRNS only applies to the expanded formats; the file's own layout has none here
+        const int flags = format == SPNG_FMT_PNG ? 0 : SPNG_DECODE_TRNS;
+        error = spng_decode_image(ctx.get(), nullptr, 0, format, flags | SPNG_DECODE_PROGRESSIVE);
+    }
+    while (!error) {
+        spng_row_info row;
+        error = spng_get_row_info(ctx.get(), &row);
+        if (!error) {
+            error = spng_decode_row(ctx.get(), decoded.scanLine(static_cast<int>(row.row_num)), rowBytes);
+        }
+    }
+    if (error != SPNG_EOI) {
+        errorMessage = spngError("Failed to decode PNG", error);
+        return false;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    // Like Qt's reader: an embedded profile wins, then sRGB, then gAMA with or without cHRM
+    spng_iccp iccp;
+    uint8_t intent = 0;
+    double gamma = 0;
+    spng_chrm chrm;
+    if (spng_get_iccp(ctx.get(), &iccp) == 0) {
+        decoded.setColorSpace(QColorSpace::fromIccProfile(
+            QByteArray(iccp.profile, static_cast<int>(iccp.profile_len))));
+    } else if (spng_get_srgb(ctx.get(), &intent) == 0) {
+        decoded.setColorSpace(QColorSpace::SRgb);
+    } else if (spng_get_gama(ctx.get(), &gamma) == 0 && gamma > 0) {
+        if (spng_get_chrm(ctx.get(), &chrm) == 0) {
+            decoded.setColorSpace(QColorSpace(QPointF(chrm.white_point_x, chrm.white_point_y),
+                                              QPointF(chrm.red_x, chrm.red_y),
+                                              QPointF(chrm.green_x, chrm.green_y),
+                                              QPointF(chrm.blue_x, chrm.blue_y),
+                                              QColorSpace::TransferFunction::Gamma, 1.0f / float(gamma)));
+        } else {
+            decoded.setColorSpace(QColorSpace(QColorSpace::Primaries::SRgb, 1.0f / float(gamma)));
+        }
+    }
+#endif
+    readMetadata(ctx.get(), decoded);
+
+    image = decoded;
+    return true;
+#else
+    errorMessage = "PNG support not compiled. Install libspng and rebuild with HAVE_LIBSPNG defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(skipChecksums);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool PngHandler::writeData(const QImage& image, const Settings& settings, QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("PngHandler::write", "codec");
+
+#ifdef HAVE_LIBSPNG
+    if (!canWrite(image)) {
+        errorMessage = image.isNull() ? "Source image is null" : "16-bit PNG needs Qt 5.12 or later";
+        return false;
+    }
+
+    // Layouts PNG stores as-is are written in place, 32-bit and 16-bit ones
+    // are packed row by row, and the rest is converted once; deeper than 8
+    // bits per channel is written as 16-bit, like Qt's writer
+    QImage source = image;
+    bool packRows = false;
+    spng_ihdr ihdr = {};
+    ihdr.width = static_cast<uint32_t>(image.width());
+    ihdr.height = static_cast<uint32_t>(image.height());
+    ihdr.bit_depth = 8;
+    switch (image.format()) {
+        case QImage::Format_Grayscale8:
+            ihdr.color_type = SPNG_COLOR_TYPE_GRAYSCALE;
+            break;
+        case QImage::Format_Indexed8:
+            ihdr.color_type = SPNG_COLOR_TYPE_INDEXED;
+            break;
+        case QImage::Format_RGB888:
+            ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR;
+            break;
+        case QImage::Format_RGBA8888:
+            ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+            break;
+        case QImage::Format_RGBX8888:
+        case QImage::Format_RGB32:
+            ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR;
+            packRows = true;
+            PixelFormat::recordAvoided(image.format(), QImage::Format_RGB888);
+            break;
+        case QImage::Format_ARGB32:
+            ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+            packRows = true;
+            PixelFormat::recordAvoided(image.format(), QImage::Format_RGBA8888);
+            break;
+        case QImage::Format_Mono:
+        case QImage::Format_MonoLSB:
+            source = image.convertToFormat(QImage::Format_Indexed8);
+            ihdr.color_type = SPNG_COLOR_TYPE_INDEXED;
+            break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        case QImage::Format_Grayscale16:
+            ihdr.color_type = SPNG_COLOR_TYPE_GRAYSCALE;
+            ihdr.bit_depth = 16;
+            packRows = true;
+            break;
+#endif
+        default:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+            if (QImage::toPixelFormat(image.format()).redSize() > 8) {
+                // RGBA64 is read in place; RGB30, premultiplied and float layouts are converted to it
+                if (image.format() != QImage::Format_RGBA64 && image.format() != QImage::Format_RGBX64) {
+                    source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_RGBA64
+                                                                           : QImage::Format_RGBX64);
+                }
+                ihdr.color_type = source.hasAlphaChannel() ? SPNG_COLOR_TYPE_TRUECOLOR_ALPHA
+                                                           : SPNG_COLOR_TYPE_TRUECOLOR;
+                ihdr.bit_depth = 16;
+                packRows = true;
+                break;
+            }
+#endif
+            source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_RGBA8888
+                                                                   : QImage::Format_RGB888);
+            ihdr.color_type = image.hasAlphaChannel() ? SPNG_COLOR_TYPE_TRUECOLOR_ALPHA
+                                                      : SPNG_COLOR_TYPE_TRUECOLOR;
+            break;
+    }
+
+    SpngContext ctx(spng_ctx_new(SPNG_CTX_ENCODER));
+    if (!ctx) {
+        errorMessage = "Failed to create PNG encoder";
+        return false;
+    }
+
+    spng_set_option(ctx.get(), SPNG_ENCODE_TO_BUFFER, 1);
+    if (settings.compressionLevel >= 0) {
+        spng_set_option(ctx.get(), SPNG_IMG_COMPRESSION_LEVEL, qBound(0, settings.compressionLevel, 9));
+    }
+    if (settings.fastFilter) {
+        // Sub is cheap and close to adaptive filtering on photographic content
+        spng_set_option(ctx.get(), SPNG_FILTER_CHOICE, SPNG_FILTER_CHOICE_SUB);
+    }
+
+    int error = spng_set_ihdr(ctx.get(), &ihdr);
+
+    if (!error && ihdr.color_type == SPNG_COLOR_TYPE_INDEXED) {
+        const QVector<QRgb> colors = source.colorTable();
+        if (colors.isEmpty() || colors.size() > 256) {
+            errorMessage = "Invalid color table for a palette PNG";
+            return false;
+        }
+        spng_plte plte = {};
+        spng_trns trns = {};
+        plte.n_entries = static_cast<uint32_t>(colors.size());
+        for (int i = 0; i < colors.size(); ++i) {
+            plte.entries[i].red = static_cast<uint8_t>(qRed(colors[i]));
+            plte.entries[i].green = static_cast<uint8_t>(qGreen(colors[i]));
+            plte.entries[i].blue = static_cast<uint8_t>(qBlue(colors[i]));
+            trns.type3_alpha[i] = static_cast<uint8_t>(qAlpha(colors[i]));
+            // tRNS stops at the last entry that is not opaque
+            if (qAlpha(colors[i]) != 255) {
+                trns.n_type3_entries = static_cast<uint32_t>(i + 1);
+            }
+        }
+        error = spng_set_plte(ctx.get(), &plte);
+        if (!error && trns.n_type3_entries > 0) {
+            error = spng_set_trns(ctx.get(), &trns);
+        }
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QByteArray icc = image.colorSpace().isValid() ? image.colorSpace().iccProfile() : QByteArray();
+    if (!error && !icc.isEmpty()) {
+        spng_iccp iccp = {};
+        strcpy(iccp.profile_name, "ICC Profile");
+        iccp.profile_len = static_cast<size_t>(icc.size());
+        iccp.profile = const_cast<char*>(icc.constData());
+        error = spng_set_iccp(ctx.get(), &iccp);
+    }
+#endif
+    if (!error) {
+        error = writeMetadata(ctx.get(), image);
+    }
+
+    // Encode row by row from the QImage's (padded) scanlines
+    if (!error) {
+        error = spng_encode_image(ctx.get(), nullptr, 0, SPNG_FMT_PNG,
+                                  SPNG_ENCODE_PROGRESSIVE | SPNG_ENCODE_FINALIZE);
+    }
+    const int channels = ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA ? 4 :
+                         ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR ? 3 : 1;
+    const size_t rowBytes = static_cast<size_t>(source.width()) * channels * (ihdr.bit_depth / 8);
+    QByteArray packed(packRows ? static_cast<int>(rowBytes) : 0, Qt::Uninitialized);
+    for (int y = 0; !error && y < source.height(); ++y) {
+        const void* row = source.constScanLine(y);
+        if (packRows && ihdr.bit_depth == 16) {
+            packRow16(source, y, channels, reinterpret_cast<uchar*>(packed.data()));
+            row = packed.constData();
+        } else if (packRows) {
+            packRow(source, y, reinterpret_cast<uchar*>(packed.data()));
+            row = packed.constData();
+        }
+        error = spng_encode_row(ctx.get(), row, rowBytes);
+    }
+    if (error && error != SPNG_EOI) {
+        errorMessage = spngError("Failed to encode PNG", error);
+        return false;
+    }
+
+    size_t size = 0;
+    void* png = spng_get_png_buffer(ctx.get(), &size, &error);
+    if (!png) {
+        errorMessage = spngError("Failed to finish PNG", error);
+        return false;
+    }
+    output = QByteArray(static_cast<const char*>(png), static_cast<int>(size));
+    free(png);
+    return true;
+#else
+    errorMessage = "PNG support not compiled. Install libspng and rebuild with HAVE_LIBSPNG defined.";
+    Q_UNUSED(image);
+    Q_UNUSED(settings);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
@@ -0,0 +1,75 @@
+#ifndef PNGHANDLER_H
+#define PNGHANDLER_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Handler for PNG using libspng
+ *
+ * Decodes straight into a QImage in the layout the encoders take (RGBX,
+ * RGBA, grayscale, 16-bit grayscale or 16-bit RGBA) and encodes row by row
+ * from the QImage's buffer, writing 16-bit samples for deeper sources.
+ * Resolution (pHYs), text and color space chunks are carried over as
+ * Qt's plugin does. Checksum verification can be skipped for trusted inputs, and the
+ * encoder has a fast mode (low compression level, one cheap filter) for
+ * intermediate or throwaway files. It requires libspng to be installed on
+ * the system; without it PNG goes through Qt's image plugin.
+ */
+class PngHandler
+{
+public:
+    // Encoder trade-offs
+    struct Settings {
+        int compressionLevel = -1;  // zlib level 0-9; -1 for the library default
+        bool fastFilter = false;    // One cheap scanline filter instead of per-row adaptive choice
+    };
+
+    PngHandler();
+    ~PngHandler();
+
+    /**
+     * @brief Check if libspng is available
+     * @return true if libspng is available and can be used
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Decode a PNG image held in memory
+     * @param data Encoded file contents
+     * @param skipChecksums Skip CRC and Adler-32 verification (trusted inputs only)
+     * @param image Output QImage (RGBX8888, RGBA8888, Grayscale8, Grayscale16 or RGBA64)
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool readData(const QByteArray& data, bool skipChecksums, QImage& image, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to PNG in memory
+     * @param image The QImage to encode; deeper than 8 bits per channel is written as 16-bit
+     * @param settings Compression level and filter choice
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, const Settings& settings, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     *
+     * 32-bit layouts with padding or Qt's word order, and 16-bit layouts
+     * (byte-swapped to PNG's order), are repacked one row at a time while
+     * encoding rather than converted as a whole image.
+     */
+    static QVector<QImage::Format> writeFormats();
+
+    /**
+     * @brief Check if an image can be written by this handler
+     * @return true unless the image is null, or deeper than 8 bits per
+     *         channel on Qt before 5.12 (those are left to Qt's PNG writer)
+     */
+    static bool canWrite(const QImage& image);
+};
+
+#endif // PNGHANDLER_H
@@ -0,0 +1,478 @@
+#include "pngoptimizer.h"
+#include "tracer.h"
+
+#include <QBuffer>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QtEndian>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+namespace {
+
+enum ColorType { Gray = 0, RGB = 2, Palette = 3, GrayAlpha = 4, RGBA = 6 };
+enum Filter { FilterNone = 0, FilterSub, FilterUp, FilterAverage, FilterPaeth, FilterAdaptive };
+
+// Input fed to deflate per call, so abandoned trials stop promptly
+const int DEFLATE_CHUNK = 256 * 1024;
+
+// Pixel data in one PNG color type, unfiltered
+struct RawImage {
+    int colorType = RGBA;
+    int bitDepth = 8;
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 4;   // Filter distance, at least 1
+    qsizetype rowBytes = 0;
+    QByteArray rows;
+    QByteArray palette;      // PLTE contents
+    QByteArray transparency; // tRNS contents
+};
+
+// Color and density chunks carried over from the source image
+struct Ancillary {
+    QByteArray iccProfile;   // Uncompressed; written as iCCP
+    bool srgb = false;       // sRGB chunk instead of a profile
+    quint32 pixelsPerMeterX = 0;
+    quint32 pixelsPerMeterY = 0;
+};
+
+struct Trial {
+    const RawImage* raw = nullptr;
+    Filter filter = FilterAdaptive;
+    int strategy = Z_DEFAULT_STRATEGY;
+    QByteArray compressed;
+    bool done = false;
+};
+
+RawImage makeTruecolor(const QImage& argb, bool opaque, bool gray)
+{
+    RawImage raw;
+    raw.width = argb.width();
+    raw.height = argb.height();
+    if (gray) {
+        raw.colorType = opaque ? Gray : GrayAlpha;
+    } else {
+        raw.colorType = opaque ? RGB : RGBA;
+    }
+    raw.bytesPerPixel = (gray ? 1 : 3) + (opaque ? 0 : 1);
+    raw.rowBytes = static_cast<qsizetype>(raw.width) * raw.bytesPerPixel;
+    raw.rows.resize(raw.rowBytes * raw.height);
+
+    uchar* out = reinterpret_cast<uchar*>(raw.rows.data());
+    for (int y = 0; y < raw.height; ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        for (int x = 0; x < raw.width; ++x) {
+            QRgb c = line[x];
+            if (gray) {
+                *out++ = static_cast<uchar>(qRed(c));
+            } else {
+                *out++ = static_cast<uchar>(qRed(c));
+                *out++ = static_cast<uchar>(qGreen(c));
+                *out++ = static_cast<uchar>(qBlue(c));
+            }
+            if (!opaque) {
+                *out++ = static_cast<uchar>(qAlpha(c));
+            }
+        }
+    }
+    return raw;
+}
+
+RawImage makePalette(const QImage& argb, QList<QRgb> colors)
+{
+    // Translucent entries first, so tRNS can stop at the last of them
+    std::stable_sort(colors.begin(), colors.end(), [](QRgb a, QRgb b) {
+        return qAlpha(a) < qAlpha(b);
+    });
+
+    RawImage raw;
+    raw.colorType = Palette;
+    raw.width = argb.width();
+    raw.height = argb.height();
+    raw.bitDepth = colors.size() <= 2 ? 1 : colors.size() <= 4 ? 2 : colors.size() <= 16 ? 4 : 8;
+    raw.bytesPerPixel = 1;
+    raw.rowBytes = (static_cast<qsizetype>(raw.width) * raw.bitDepth + 7) / 8;
+    raw.rows.fill(0, raw.rowBytes * raw.height);
+
+    QHash<QRgb, int> index;
+    for (int i = 0; i < colors.size(); ++i) {
+        QRgb c = colors[i];
+        index.insert(c, i);
+        raw.palette.append(static_cast<char>(qRed(c)));
+        raw.palette.append(static_cast<char>(qGreen(c)));
+        raw.palette.append(static_cast<char>(qBlue(c)));
+        if (qAlpha(c) < 255) {
+            raw.transparency.append(static_cast<char>(qAlpha(c)));
+        }
+    }
+
+    const int perByte = 8 / raw.bitDepth;
+    for (int y = 0; y < raw.height; ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        uchar* out = reinterpret_cast<uchar*>(raw.rows.data()) + y * raw.rowBytes;
+        QRgb previous = line[0];
+        int value = index.value(previous);
+        for (int x = 0; x < raw.width; ++x) {
+            if (line[x] != previous) {
+                previous = line[x];
+                value = index.value(previous);
+            }
+            // Samples are packed from the most significant bit
+            int shift = 8 - raw.bitDepth * (x % perByte + 1);
+            out[x / perByte] |= static_cast<uchar>(value << shift);
+        }
+    }
+    return raw;
+}
+
+// Every lossless representation worth trying, smallest expected first.
+// An embedded profile must match the color type: RGB profiles rule out
+// grayscale, grayscale profiles rule out a palette.
+QVector<RawImage> reduceColors(const QImage& image, bool allowGray, bool allowPalette)
+{
+    const QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+
+    bool opaque = true;
+    bool gray = true;
+    bool fewColors = true;
+    QHash<QRgb, int> seen;
+    QList<QRgb> colors;
+
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(argb.constScanLine(y));
+        QRgb previous = ~line[0];
+        for (int x = 0; x < argb.width(); ++x) {
+            QRgb c = line[x];
+            if (c == previous) {
+                continue;
+            }
+            previous = c;
+            opaque = opaque && qAlpha(c) == 255;
+            gray = gray && qRed(c) == qGreen(c) && qGreen(c) == qBlue(c);
+            if (fewColors && !seen.contains(c)) {
+                if (colors.size() == 256) {
+                    fewColors = false;
+                } else {
+                    seen.insert(c, 0);
+                    colors.append(c);
+                }
+            }
+        }
+    }
+
+    QVector<RawImage> candidates;
+    if (fewColors && allowPalette) {
+        candidates.append(makePalette(argb, colors));
+    }
+    candidates.append(makeTruecolor(argb, opaque, gray && allowGray));
+    return candidates;
+}
+
+inline uchar paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uchar>(a);
+    if (pb <= pc) return static_cast<uchar>(b);
+    return static_cast<uchar>(c);
+}
+
+void filterRow(Filter filter, const uchar* row, const uchar* prior, qsizetype length, int bpp, uchar* out)
+{
+    for (qsizetype i = 0; i < length; ++i) {
+        int left = i >= bpp ? row[i - bpp] : 0;
+        int up = prior[i];
+        int upLeft = i >= bpp ? prior[i - bpp] : 0;
+        int predicted = 0;
+        switch (filter) {
+            case FilterSub: predicted = left; break;
+            case FilterUp: predicted = up; break;
+            case FilterAverage: predicted = (left + up) / 2; break;
+            case FilterPaeth: predicted = paethPredictor(left, up, upLeft); break;
+            default: break;
+        }
+        out[i] = static_cast<uchar>(row[i] - predicted);
+    }
+}
+
+// Scanlines prefixed with their filter type; adaptive picks the filter with
+// the smallest sum of absolute (signed) residuals per row
+QByteArray filterImage(const RawImage& raw, Filter filter)
+{
+    const qsizetype length = raw.rowBytes;
+    QByteArray filtered(raw.height * (length + 1), Qt::Uninitialized);
+    QByteArray zeroRow(length, '\0');
+    QByteArray candidate(length, Qt::Uninitialized);
+
+    for (int y = 0; y < raw.height; ++y) {
+        const uchar* row = reinterpret_cast<const uchar*>(raw.rows.constData()) + y * length;
+        const uchar* prior = y > 0 ? row - length : reinterpret_cast<const uchar*>(zeroRow.constData());
+        uchar* out = reinterpret_cast<uchar*>(filtered.data()) + y * (length + 1);
+
+        if (filter != FilterAdaptive) {
+            out[0] = static_cast<uchar>(filter);
+            filterRow(filter, row, prior, length, raw.bytesPerPixel, out + 1);
+            continue;
+        }
+
+        qint64 bestCost = -1;
+        for (int type = FilterNone; type <= FilterPaeth; ++type) {
+            uchar* trial = reinterpret_cast<uchar*>(candidate.data());
+            filterRow(static_cast<Filter>(type), row, prior, length, raw.bytesPerPixel, trial);
+            qint64 cost = 0;
+            for (qsizetype i = 0; i < length; ++i) {
+                cost += std::abs(static_cast<int>(static_cast<signed char>(trial[i])));
+            }
+            if (bestCost < 0 || cost < bestCost) {
+                bestCost = cost;
+                out[0] = static_cast<uchar>(type);
+                memcpy(out + 1, trial, length);
+            }
+        }
+    }
+    return filtered;
+}
+
+// Compress at maximum effort; gives up once the deadline passes unless
+// mustFinish is set
+bool deflateData(const QByteArray& input, int strategy, const QDeadlineTimer& deadline,
+                 bool mustFinish, QByteArray& output)
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15, 9, strategy) != Z_OK) {
+        return false;
+    }
+
+    output.resize(static_cast<int>(deflateBound(&stream, static_cast<uLong>(input.size()))));
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    qsizetype offset = 0;
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (!mustFinish && deadline.hasExpired()) {
+            deflateEnd(&stream);
+            return false;
+        }
+        qsizetype chunk = qMin<qsizetype>(DEFLATE_CHUNK, input.size() - offset);
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.constData() + offset));
+        stream.avail_in = static_cast<uInt>(chunk);
+        offset += chunk;
+        status = deflate(&stream, offset < input.size() ? Z_NO_FLUSH : Z_FINISH);
+    }
+
+    bool ok = status == Z_STREAM_END;
+    output.resize(static_cast<int>(stream.total_out));
+    deflateEnd(&stream);
+    return ok;
+}
+
+void appendChunk(QByteArray& png, const char* type, const QByteArray& data)
+{
+    uchar length[4];
+    qToBigEndian(static_cast<quint32>(data.size()), length);
+    png.append(reinterpret_cast<const char*>(length), 4);
+
+    const int start = png.size();
+    png.append(type, 4);
+    png.append(data);
+
+    uchar crc[4];
+    qToBigEndian(static_cast<quint32>(crc32(0, reinterpret_cast<const Bytef*>(png.constData() + start),
+                                            static_cast<uInt>(png.size() - start))), crc);
+    png.append(reinterpret_cast<const char*>(crc), 4);
+}
+
+Ancillary ancillaryFor(const QImage& image)
+{
+    Ancillary ancillary;
+    if (image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0) {
+        ancillary.pixelsPerMeterX = static_cast<quint32>(image.dotsPerMeterX());
+        ancillary.pixelsPerMeterY = static_cast<quint32>(image.dotsPerMeterY());
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QColorSpace colorSpace = image.colorSpace();
+    if (colorSpace.isValid()) {
+        if (colorSpace == QColorSpace(QColorSpace::SRgb)) {
+            ancillary.srgb = true;
+        } else {
+            ancillary.iccProfile = colorSpace.iccProfile();
+        }
+    }
+#endif
+    return ancillary;
+}
+
+// PNG allows only grayscale profiles on grayscale color types and RGB
+// profiles on the others; bytes 16-19 of an ICC profile name its color space
+bool profileFits(const RawImage& raw, const QByteArray& iccProfile)
+{
+    const QByteArray space = iccProfile.mid(16, 4);
+    const bool grayType = raw.colorType == Gray || raw.colorType == GrayAlpha;
+    return space == (grayType ? "GRAY" : "RGB ");
+}
+
+QByteArray assemblePng(const RawImage& raw, const QByteArray& compressed, const Ancillary& ancillary)
+{
+    QByteArray png("\x89PNG\r\n\x1a\n", 8);
+
+    uchar header[13];
+    qToBigEndian(static_cast<quint32>(raw.width), header);
+    qToBigEndian(static_cast<quint32>(raw.height), header + 4);
+    header[8] = static_cast<uchar>(raw.bitDepth);
+    header[9] = static_cast<uchar>(raw.colorType);
+    header[10] = 0;  // Deflate
+    header[11] = 0;  // Adaptive filtering
+    header[12] = 0;  // No interlace
+    appendChunk(png, "IHDR", QByteArray(reinterpret_cast<const char*>(header), 13));
+
+    // Color chunks must precede PLTE and IDAT. A profile that does not fit
+    // the chosen color type (a grayscale profile on color content, CMYK or
+    // Lab profiles) would make the file invalid, so it is dropped.
+    if (ancillary.srgb) {
+        appendChunk(png, "sRGB", QByteArray(1, '\0'));  // Perceptual intent
+    } else if (!ancillary.iccProfile.isEmpty() && profileFits(raw, ancillary.iccProfile)) {
+        uLongf length = compressBound(static_cast<uLong>(ancillary.iccProfile.size()));
+        QByteArray profile(static_cast<int>(length), Qt::Uninitialized);
+        if (compress2(reinterpret_cast<Bytef*>(profile.data()), &length,
+                      reinterpret_cast<const Bytef*>(ancillary.iccProfile.constData()),
+                      static_cast<uLong>(ancillary.iccProfile.size()), Z_BEST_COMPRESSION) == Z_OK) {
+            profile.resize(static_cast<int>(length));
+            // Profile name, NUL, compression method 0 (deflate)
+            appendChunk(png, "iCCP", QByteArray("ICC Profile\0\0", 13) + profile);
+        }
+    }
+    if (ancillary.pixelsPerMeterX > 0) {
+        uchar density[9];
+        qToBigEndian(ancillary.pixelsPerMeterX, density);
+        qToBigEndian(ancillary.pixelsPerMeterY, density + 4);
+        density[8] = 1;  // Unit: meter
+        appendChunk(png, "pHYs", QByteArray(reinterpret_cast<const char*>(density), 9));
+    }
+
+    if (raw.colorType == Palette) {
+        appendChunk(png, "PLTE", raw.palette);
+        if (!raw.transparency.isEmpty()) {
+            appendChunk(png, "tRNS", raw.transparency);
+        }
+    }
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", QByteArray());
+    return png;
+}
+
+} // namespace
+#endif
+
+bool PngOptimizer::isAvailable()
+{
+#ifdef HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PngOptimizer::writeData(const QImage& image, int timeBudgetMs, QByteArray& output, QString& errorMessage,
+                             int maxThreads)
+{
+    TraceSpan span("PngOptimizer::writeData", "codec");
+
+    const bool wide = image.depth() > 32 || image.format() == QImage::Format_Grayscale16;
+    if (!isAvailable() || wide || image.isNull()) {
+        // Quality 0 selects Qt's highest zlib level
+        output.clear();
+        QBuffer buffer(&output);
+        buffer.open(QIODevice::WriteOnly);
+        if (!image.save(&buffer, "PNG", 0)) {
+            errorMessage = "Failed to save image. Check if format is supported.";
+            return false;
+        }
+        return true;
+    }
+
+#ifdef HAVE_ZLIB
+    QDeadlineTimer deadline(timeBudgetMs);
+    const Ancillary ancillary = ancillaryFor(image);
+    // Prefer color types the profile fits; assemblePng drops it where none does
+    const QByteArray profileSpace = ancillary.iccProfile.mid(16, 4);
+    const QVector<RawImage> candidates = reduceColors(image, profileSpace != "RGB ", profileSpace != "GRAY");
+
+    // Adaptive filtering with the default strategy goes first for each
+    // representation; it is usually the winner and the first always finishes
+    QVector<Trial> trials;
+    const QList<int> strategies = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE};
+    for (const RawImage& raw : candidates) {
+        Trial trial;
+        trial.raw = &raw;
+        trials.append(trial);
+    }
+    for (const RawImage& raw : candidates) {
+        // Filters rarely help sub-byte palette data
+        QList<Filter> filters = {FilterAdaptive, FilterNone};
+        if (raw.bitDepth == 8) {
+            filters += {FilterPaeth, FilterUp, FilterSub, FilterAverage};
+        }
+        for (Filter filter : filters) {
+            for (int strategy : strategies) {
+                if (filter == FilterAdaptive && strategy == Z_DEFAULT_STRATEGY) {
+                    continue;
+                }
+                Trial trial;
+                trial.raw = &raw;
+                trial.filter = filter;
+                trial.strategy = strategy;
+                trials.append(trial);
+            }
+        }
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(maxThreads > 0 ? maxThreads : QThread::idealThreadCount());
+    for (int i = 0; i < trials.size(); ++i) {
+        Trial& trial = trials[i];
+        const bool mustFinish = i == 0;
+        pool.start([&trial, &deadline, mustFinish]() {
+            if (!mustFinish && deadline.hasExpired()) {
+                return;
+            }
+            QByteArray filtered = filterImage(*trial.raw, trial.filter);
+            trial.done = deflateData(filtered, trial.strategy, deadline, mustFinish, trial.compressed);
+        });
+    }
+    pool.waitForDone();
+
+    const Trial* best = nullptr;
+    for (const Trial& trial : trials) {
+        if (trial.done && (!best || trial.compressed.size() < best->compressed.size())) {
+            best = &trial;
+        }
+    }
+    if (!best) {
+        errorMessage = "Failed to compress PNG data";
+        return false;
+    }
+
+    output = assemblePng(*best->raw, best->compressed, ancillary);
+    return true;
+#else
+    Q_UNUSED(timeBudgetMs);
+    Q_UNUSED(maxThreads);
+    return false;
+#endif
+}
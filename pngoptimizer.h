@@ -0,0 +1,47 @@
+#ifndef PNGOPTIMIZER_H
+#define PNGOPTIMIZER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+/**
+ * @brief Lossless maximum-compression PNG encoder
+ *
+ * The pixel data is first reduced to the smallest lossless color type
+ * (palette when there are at most 256 colors, grayscale, RGB without an
+ * alpha channel). Combinations of scanline filters and deflate strategies are then
+ * compressed in parallel and the smallest stream is kept. Trials that have
+ * not finished when the time budget runs out are abandoned; the first
+ * trial always completes, so a valid file is produced regardless.
+ *
+ * Besides the critical chunks (and tRNS), only the color space (sRGB or
+ * iCCP) and pixel density (pHYs) are written, so colors and DPI survive.
+ * 16-bit images are left to Qt's PNG writer.
+ */
+class PngOptimizer
+{
+public:
+    // Search time per image when no budget is given explicitly
+    static const int DEFAULT_TIME_BUDGET_MS = 2000;
+
+    /**
+     * @brief Check if the optimizer is available
+     * @return true if zlib was found at build time
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Encode an image as the smallest PNG found within a time budget
+     * @param image The QImage to encode
+     * @param timeBudgetMs Wall time allowed for the search
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @param maxThreads Trials compressed at once (<= 0: one per core)
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int timeBudgetMs, QByteArray& output, QString& errorMessage,
+                          int maxThreads = 0);
+};
+
+#endif // PNGOPTIMIZER_H
@@ -0,0 +1,407 @@
+#include "qualitysearch.h"
+#include "pixelformat.h"
+#include "ssimmetric.h"
+#include "tracer.h"
+
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+const QList<int> QualitySearch::COARSE_QUALITIES = {5, 15, 25, 35, 45, 55, 65, 75, 85, 95};
+
+namespace {
+
+// A full-size result this close to the budget is accepted without refining
+const double CLOSE_ENOUGH = 0.95;
+
+struct Trial {
+    int quality = 0;
+    qint64 bytes = -1;  // -1 if encoding failed
+    double score = -1.0;  // SSIM against the reference, if one was given
+    QByteArray data;
+    QString error;
+};
+
+// An image brought into the encoder's pixel format once for a whole search;
+// every encode after the first would otherwise have converted it again
+class NegotiatedImage
+{
+public:
+    NegotiatedImage(const QImage& image, ImageConverter::Format format)
+        : m_from(image.format())
+        , m_image(PixelFormat::negotiate(image, ImageConverter::encoderFormats(format)))
+    {
+    }
+
+    ~NegotiatedImage()
+    {
+        if (m_encodes > 1 && m_image.format() != m_from) {
+            PixelFormat::recordAvoided(m_from, m_image.format(), m_encodes - 1);
+        }
+    }
+
+    const QImage& image() const { return m_image; }
+    void addEncodes(int count) { m_encodes += count; }
+
+private:
+    Q_DISABLE_COPY(NegotiatedImage)
+
+    QImage::Format m_from;
+    QImage m_image;
+    int m_encodes = 0;
+};
+
+// Shared by every search, so a batch does not build and tear down a pool per image
+QThreadPool& trialPool()
+{
+    static QThreadPool pool;
+    return pool;
+}
+
+// Encode at several qualities concurrently (up to maxThreads, <= 0: one per
+// core), in the order given; with a reference each result is also decoded and scored
+QVector<Trial> encodeTrials(NegotiatedImage& source, ImageConverter::Format format, const YuvFormat& yuv,
+                            const QList<int>& qualities, bool keepData, int maxThreads,
+                            const QImage* reference = nullptr)
+{
+    const QImage& image = source.image();
+    source.addEncodes(qualities.size());
+
+    QVector<Trial> trials(qualities.size());
+    for (int i = 0; i < qualities.size(); ++i) {
+        trials[i].quality = qualities[i];
+    }
+
+    // Workers take the next trial until none are left
+    std::atomic<int> next{0};
+    auto work = [&]() {
+        for (int i = next++; i < trials.size(); i = next++) {
+            Trial& trial = trials[i];
+            QByteArray data;
+            if (!ImageConverter::encode(image, format, trial.quality, yuv, data, trial.error)) {
+                continue;
+            }
+            if (reference) {
+                QImage decoded;
+                if (!ImageConverter::decode(data, ImageConverter::getExtension(format), decoded, trial.error)) {
+                    continue;
+                }
+                // Trials already run in parallel, so each is scored on one thread
+                trial.score = SsimMetric::compare(*reference, decoded, 1);
+            }
+            trial.bytes = data.size();
+            if (keepData) {
+                trial.data = data;
+            }
+        }
+    };
+
+    // The calling thread works too; helpers only join while the shared pool has room
+    if (maxThreads <= 0) {
+        maxThreads = QThread::idealThreadCount();
+    }
+    const int helpers = qMin(static_cast<int>(qualities.size()), maxThreads) - 1;
+    QSemaphore finished;
+    int started = 0;
+    for (; started < helpers; ++started) {
+        if (!trialPool().tryStart([&work, &finished]() { work(); finished.release(); })) {
+            break;
+        }
+    }
+    work();
+    finished.acquire(started);
+    return trials;
+}
+
+// Bisect for the highest quality whose output fits budget, one encode at a time:
+// at most about log2(100) encodes. Every encode made is appended to curve.
+// Returns the quality (0 if not even quality 1 fits), or -1 if encoding failed.
+int bisectQuality(NegotiatedImage& source, ImageConverter::Format format, const YuvFormat& yuv,
+                  double budget, QVector<Trial>& curve, QByteArray& best, QString& errorMessage)
+{
+    int lo = 0;    // Highest quality known to fit
+    int hi = 101;  // Lowest quality known not to fit
+    while (lo + 1 < hi) {
+        const int quality = (lo + hi) / 2;
+        Trial trial;
+        trial.quality = quality;
+        source.addEncodes(1);
+        if (!ImageConverter::encode(source.image(), format, quality, yuv, trial.data, errorMessage)) {
+            return -1;
+        }
+        trial.bytes = trial.data.size();
+        if (trial.bytes <= budget) {
+            lo = quality;
+            best = trial.data;
+        } else {
+            hi = quality;
+        }
+        trial.data.clear();
+        curve.append(trial);
+    }
+    return lo;
+}
+
+// Output size at a quality, interpolated log-linearly between trials
+double interpolateBytes(const QVector<Trial>& curve, double quality)
+{
+    if (curve.size() == 1) {
+        return curve.first().bytes;
+    }
+
+    int upper = 1;
+    while (upper < curve.size() - 1 && curve[upper].quality < quality) {
+        ++upper;
+    }
+    const Trial& a = curve[upper - 1];
+    const Trial& b = curve[upper];
+    double t = (quality - a.quality) / static_cast<double>(b.quality - a.quality);
+    double logBytes = std::log(static_cast<double>(a.bytes)) +
+                      t * (std::log(static_cast<double>(b.bytes)) - std::log(static_cast<double>(a.bytes)));
+    return std::exp(logBytes);
+}
+
+// Highest quality whose predicted size fits the budget (1 if none does)
+int predictQuality(const QVector<Trial>& curve, double scale, qint64 targetBytes)
+{
+    for (int quality = 100; quality > 1; --quality) {
+        if (interpolateBytes(curve, quality) * scale <= targetBytes) {
+            return quality;
+        }
+    }
+    return 1;
+}
+
+// Downscale to about PROXY_PIXELS; scale receives the pixel count ratio
+QImage makeProxy(const QImage& source, double& scale)
+{
+    const qint64 pixels = static_cast<qint64>(source.width()) * source.height();
+    double factor = std::sqrt(static_cast<double>(QualitySearch::PROXY_PIXELS) / pixels);
+    QImage proxy = source.scaled(qMax(1, static_cast<int>(source.width() * factor)),
+                                 qMax(1, static_cast<int>(source.height() * factor)),
+                                 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    scale = static_cast<double>(pixels) / (static_cast<qint64>(proxy.width()) * proxy.height());
+    return proxy;
+}
+
+} // namespace
+
+bool QualitySearch::encodeToSize(const QImage& image, ImageConverter::Format format, qint64 targetBytes,
+                                 const YuvFormat& yuv, QByteArray& output, QString& errorMessage,
+                                 int* chosenQuality)
+{
+    TraceSpan span("QualitySearch::encodeToSize", "convert");
+
+    // Flatten and convert to the encoder's pixel format once instead of in every trial
+    NegotiatedImage negotiated((format == ImageConverter::Format::JPEG) ?
+                               ImageConverter::flattenAlpha(image) : image, format);
+    const QImage& source = negotiated.image();
+
+    const qint64 pixels = static_cast<qint64>(source.width()) * source.height();
+    const bool useProxy = pixels > PROXY_MIN_PIXELS;
+
+    int bestQuality = 0;
+    QVector<Trial> curve;
+
+    if (!useProxy) {
+        // Small enough to bisect on the image itself; every encode is exact
+        bestQuality = bisectQuality(negotiated, format, yuv, targetBytes, curve, output, errorMessage);
+        if (bestQuality < 0) {
+            return false;
+        }
+    } else {
+        // Bisect on the proxy against the budget scaled down to its size; the
+        // encodes made on the way map the size/quality curve
+        double scale = 1.0;
+        NegotiatedImage proxy(makeProxy(source, scale), format);
+        QByteArray proxyOutput;
+        if (bisectQuality(proxy, format, yuv, targetBytes / scale, curve, proxyOutput, errorMessage) < 0) {
+            return false;
+        }
+        std::sort(curve.begin(), curve.end(),
+                  [](const Trial& a, const Trial& b) { return a.quality < b.quality; });
+
+        // Confirm at full size, recalibrating the proxy curve after each encode
+        int lo = 0;    // Highest quality known to fit
+        int hi = 101;  // Lowest quality known not to fit
+        double calibration = 1.0;
+        int quality = predictQuality(curve, scale, targetBytes);
+
+        for (int i = 0; i < MAX_FULL_ENCODES && lo + 1 < hi; ++i) {
+            quality = qBound(lo + 1, quality, hi - 1);
+
+            QByteArray data;
+            negotiated.addEncodes(1);
+            if (!ImageConverter::encode(source, format, quality, yuv, data, errorMessage)) {
+                return false;
+            }
+
+            double predicted = interpolateBytes(curve, quality) * scale;
+            if (predicted > 0) {
+                calibration = data.size() / predicted;
+            }
+
+            if (data.size() <= targetBytes) {
+                lo = quality;
+                bestQuality = quality;
+                output = data;
+                if (data.size() >= targetBytes * CLOSE_ENOUGH) {
+                    break;
+                }
+            } else {
+                hi = quality;
+            }
+
+            int next = predictQuality(curve, scale * calibration, targetBytes);
+            if (next <= lo && lo > 0) {
+                break;  // The calibrated curve says nothing higher fits
+            }
+            if (next <= lo || next >= hi) {
+                next = (lo + hi) / 2;
+            }
+            quality = next;
+        }
+
+        // Last resort when every full-size encode overshot
+        if (bestQuality == 0 && hi > 1) {
+            QByteArray data;
+            negotiated.addEncodes(1);
+            if (!ImageConverter::encode(source, format, 1, yuv, data, errorMessage)) {
+                return false;
+            }
+            if (data.size() <= targetBytes) {
+                bestQuality = 1;
+                output = data;
+            }
+        }
+    }
+
+    if (bestQuality == 0) {
+        errorMessage = QString("Output cannot be made smaller than the target of %1 bytes")
+            .arg(targetBytes);
+        return false;
+    }
+
+    if (chosenQuality) {
+        *chosenQuality = bestQuality;
+    }
+    return true;
+}
+
+bool QualitySearch::encodeToSsim(const QImage& image, ImageConverter::Format format, double minSsim,
+                                 const YuvFormat& yuv, QByteArray& output, QString& errorMessage,
+                                 int* chosenQuality, int maxThreads)
+{
+    TraceSpan span("QualitySearch::encodeToSsim", "convert");
+
+    NegotiatedImage negotiated((format == ImageConverter::Format::JPEG) ?
+                               ImageConverter::flattenAlpha(image) : image, format);
+    const QImage& source = negotiated.image();
+
+    const qint64 pixels = static_cast<qint64>(source.width()) * source.height();
+    const bool useProxy = pixels > PROXY_MIN_PIXELS;
+    double scale = 1.0;
+    NegotiatedImage negotiatedProxy(useProxy ? makeProxy(source, scale) : QImage(), format);
+    NegotiatedImage& proxy = useProxy ? negotiatedProxy : negotiated;
+
+    // Score the coarse qualities, then every quality between the lowest
+    // passing one and the failing one below it
+    QVector<Trial> trials = encodeTrials(proxy, format, yuv, COARSE_QUALITIES, !useProxy, maxThreads, &proxy.image());
+
+    int passing = 101;
+    for (const Trial& trial : trials) {
+        if (trial.bytes < 0) {
+            errorMessage = trial.error;
+            return false;
+        }
+        if (trial.score >= minSsim) {
+            passing = qMin(passing, trial.quality);
+        }
+    }
+    int failing = 0;
+    for (const Trial& trial : trials) {
+        if (trial.quality < passing) {
+            failing = qMax(failing, trial.quality);
+        }
+    }
+
+    QList<int> refine;
+    for (int quality = failing + 1; quality < passing && quality <= 100; ++quality) {
+        refine.append(quality);
+    }
+    trials += encodeTrials(proxy, format, yuv, refine, !useProxy, maxThreads, &proxy.image());
+
+    // Highest quality is the fallback when nothing reaches the threshold
+    const Trial* best = nullptr;
+    for (const Trial& trial : trials) {
+        if (trial.bytes < 0) {
+            errorMessage = trial.error;
+            return false;
+        }
+        bool better = !best ||
+            (trial.score >= minSsim && (best->score < minSsim || trial.quality < best->quality)) ||
+            (best->score < minSsim && trial.quality > best->quality);
+        if (better) {
+            best = &trial;
+        }
+    }
+
+    int quality = best->quality;
+    if (useProxy) {
+        // The proxy only predicts the full-size score: check it, stepping up while
+        // it falls short and then narrowing down between the failing and passing quality
+        int fullFailing = 0;
+        int fullPassing = 101;
+        QByteArray passingOutput;
+        for (int i = 0; i < MAX_FULL_ENCODES; ++i) {
+            QByteArray data;
+            QImage decoded;
+            negotiated.addEncodes(1);
+            if (!ImageConverter::encode(source, format, quality, yuv, data, errorMessage) ||
+                !ImageConverter::decode(data, ImageConverter::getExtension(format), decoded, errorMessage)) {
+                return false;
+            }
+            if (SsimMetric::compare(source, decoded, maxThreads) >= minSsim) {
+                fullPassing = quality;
+                passingOutput = data;
+            } else {
+                fullFailing = quality;
+                output = data;
+            }
+
+            if (fullPassing == fullFailing + 1 || fullFailing == 100) {
+                break;
+            }
+            if (fullPassing <= 100) {
+                if (i == 0) {
+                    break;  // The proxy's choice holds at full size
+                }
+                quality = (fullFailing + fullPassing) / 2;
+            } else if (i == MAX_FULL_ENCODES - 2) {
+                quality = 100;  // Last chance to reach the threshold at all
+            } else {
+                quality = qMin(100, quality + qMax(5, (100 - quality) / 2));
+            }
+        }
+
+        // Without any passing encode the highest quality tried is the fallback
+        if (fullPassing <= 100) {
+            quality = fullPassing;
+            output = passingOutput;
+        } else {
+            quality = fullFailing;
+        }
+    } else {
+        output = best->data;
+    }
+
+    if (chosenQuality) {
+        *chosenQuality = quality;
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef QUALITYSEARCH_H
+#define QUALITYSEARCH_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QString>
+#include "imageconverter.h"
+
+/**
+ * @brief Picks encoder quality settings by searching over trial encodes
+ *
+ * Used for the target-size mode of lossy formats. Small images are bisected
+ * directly, at most about log2(100) = 7 encodes. Larger ones are bisected
+ * on a downscaled proxy; the encodes made on the way map the size/quality
+ * curve, which, rescaled and recalibrated after every full-size encode,
+ * predicts the quality to confirm at full size. Usually one or two
+ * full-size encodes are needed.
+ *
+ * The perceptual mode scores decoded trial encodes with SsimMetric instead
+ * and keeps the lowest quality that reaches the threshold. Large images are
+ * scored on the proxy; the full-size encode at the proxy's quality is then
+ * scored too and the quality stepped up if it falls short.
+ */
+class QualitySearch
+{
+public:
+    // Qualities scored in parallel by the perceptual mode before it refines
+    static const QList<int> COARSE_QUALITIES;
+
+    // Images with more pixels than this are first searched on a proxy
+    static const int PROXY_MIN_PIXELS = 1500000;
+
+    // Approximate pixel count of the proxy
+    static const int PROXY_PIXELS = 500000;
+
+    // Upper bound on full-size encodes per image
+    static const int MAX_FULL_ENCODES = 4;
+
+    // SSIM threshold of the automatic quality mode
+    static constexpr double DEFAULT_MIN_SSIM = 0.98;
+
+    /**
+     * @brief Encode at the highest quality whose output fits a byte budget
+     * @param image The QImage to encode
+     * @param format Target format (JPEG, WebP, HEIC or AVIF)
+     * @param targetBytes Maximum output size in bytes
+     * @param yuv YUV layout for AVIF and HEIC (should already be resolved)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if no quality fits
+     * @param chosenQuality Optional output of the quality that was used
+     * @return true if successful, false otherwise
+     */
+    static bool encodeToSize(const QImage& image, ImageConverter::Format format, qint64 targetBytes,
+                             const YuvFormat& yuv, QByteArray& output, QString& errorMessage,
+                             int* chosenQuality = nullptr);
+
+    /**
+     * @brief Encode at the lowest quality whose output reaches an SSIM threshold
+     * @param image The QImage to encode
+     * @param format Target format (JPEG, WebP, HEIC or AVIF)
+     * @param minSsim SSIM the decoded output must reach, e.g. DEFAULT_MIN_SSIM
+     * @param yuv YUV layout for AVIF and HEIC (should already be resolved)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @param chosenQuality Optional output of the quality that was used
+     * @param maxThreads Trial encodes run at once (<= 0: one per core)
+     * @return true if successful (quality 100 is used if no quality reaches
+     *         the threshold), false otherwise
+     */
+    static bool encodeToSsim(const QImage& image, ImageConverter::Format format, double minSsim,
+                             const YuvFormat& yuv, QByteArray& output, QString& errorMessage,
+                             int* chosenQuality = nullptr, int maxThreads = 0);
+};
+
+#endif // QUALITYSEARCH_H
@@ -0,0 +1,36 @@
+#include "readahead.h"
+#include "tracer.h"
+
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool ReadAhead::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ReadAhead::prefetch(const QString& filePath)
+{
+#ifdef Q_OS_LINUX
+    TraceSpan span("ReadAhead::prefetch", "io", filePath);
+    const int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // Queues the reads and returns; closing the file does not cancel them
+    const bool hinted = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+    ::close(fd);
+    return hinted;
+#else
+    Q_UNUSED(filePath);
+    return false;
+#endif
+}
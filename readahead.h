@@ -0,0 +1,34 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Asks the kernel to start reading files that are about to be converted
+ *
+ * The batch worker hints the next few inputs in its queue, so that their
+ * reads from NFS or spinning disks overlap the conversions running now and
+ * the decoder later finds the data in the page cache. Hints cost no memory
+ * of our own and the kernel drops them under memory pressure.
+ */
+class ReadAhead
+{
+public:
+    // Default cap on bytes hinted but not yet converted
+    static const qint64 DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+    /**
+     * @brief Check if the platform supports read-ahead hints
+     */
+    static bool isSupported();
+
+    /**
+     * @brief Start reading a file into the page cache in the background
+     * @param filePath File to read ahead
+     * @return true if the hint was given, false if unsupported or the file cannot be opened
+     */
+    static bool prefetch(const QString& filePath);
+};
+
+#endif // READAHEAD_H
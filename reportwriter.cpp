@@ -0,0 +1,316 @@
+#include "reportwriter.h"
+
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+
+namespace {
+
+const char* CSV_HEADER = "input,output,success,error,output_size,elapsed_ms,duplicate_of\n";
+
+QString csvField(const QString& value)
+{
+    if (!value.contains(',') && !value.contains('"') &&
+        !value.contains('\n') && !value.contains('\r')) {
+        return value;
+    }
+    QString escaped = value;
+    escaped.replace("\"", "\"\"");
+    return "\"" + escaped + "\"";
+}
+
+// Read one CSV record, joining physical lines while inside a quoted field
+bool readCsvRecord(QTextStream& stream, QStringList& fields)
+{
+    fields.clear();
+    if (stream.atEnd()) {
+        return false;
+    }
+
+    QString field;
+    bool inQuotes = false;
+    QString line = stream.readLine();
+    for (;;) {
+        for (int i = 0; i < line.size(); ++i) {
+            QChar c = line[i];
+            if (inQuotes) {
+                if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                    field += '"';
+                    ++i;
+                } else if (c == '"') {
+                    inQuotes = false;
+                } else {
+                    field += c;
+                }
+            } else if (c == '"') {
+                inQuotes = true;
+            } else if (c == ',') {
+                fields.append(field);
+                field.clear();
+            } else {
+                field += c;
+            }
+        }
+        if (!inQuotes || stream.atEnd()) {
+            break;
+        }
+        field += '\n';
+        line = stream.readLine();
+    }
+    fields.append(field);
+    return true;
+}
+
+} // namespace
+
+ReportWriter::ReportWriter()
+    : m_format(Format::JSONL)
+    , m_thread(nullptr)
+    , m_closing(false)
+    , m_writeFailed(false)
+{
+}
+
+ReportWriter::~ReportWriter()
+{
+    QString ignored;
+    close(ignored);
+}
+
+ReportWriter::Format ReportWriter::formatForPath(const QString& filePath)
+{
+    return QFileInfo(filePath).suffix().toLower() == "csv" ? Format::CSV : Format::JSONL;
+}
+
+bool ReportWriter::open(const QString& filePath, bool append, QString& errorMessage)
+{
+    if (m_thread) {
+        errorMessage = "Report is already open";
+        return false;
+    }
+
+    m_format = formatForPath(filePath);
+    m_file.setFileName(filePath);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly | (append ? QIODevice::Append : QIODevice::Truncate);
+    if (!m_file.open(mode)) {
+        errorMessage = QString("Failed to open report file: %1").arg(m_file.errorString());
+        return false;
+    }
+
+    if (m_format == Format::CSV && m_file.size() == 0) {
+        m_file.write(CSV_HEADER);
+    }
+
+    m_closing = false;
+    m_writeFailed = false;
+    m_thread = QThread::create([this]() { run(); });
+    m_thread->start();
+    return true;
+}
+
+bool ReportWriter::close(QString& errorMessage)
+{
+    if (!m_thread) {
+        return true;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closing = true;
+        m_queueNotEmpty.wakeAll();
+        m_queueNotFull.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    m_file.close();
+
+    if (m_writeFailed) {
+        errorMessage = QString("Failed to write report file: %1").arg(m_file.fileName());
+        return false;
+    }
+    return true;
+}
+
+bool ReportWriter::isOpen() const
+{
+    return m_thread != nullptr;
+}
+
+QString ReportWriter::filePath() const
+{
+    return m_file.fileName();
+}
+
+void ReportWriter::consume(const ConversionResult& result)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_thread) {
+        return;
+    }
+    while (m_queue.size() >= MAX_PENDING && !m_closing) {
+        m_queueNotFull.wait(&m_mutex);
+    }
+    m_queue.append(result);
+    m_queueNotEmpty.wakeOne();
+}
+
+void ReportWriter::run()
+{
+    QList<ConversionResult> batch;
+    for (;;) {
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_queue.isEmpty() && !m_closing) {
+                m_queueNotEmpty.wait(&m_mutex);
+            }
+            if (m_queue.isEmpty()) {
+                return;
+            }
+            batch.swap(m_queue);
+            m_queueNotFull.wakeAll();
+        }
+
+        // One write and flush per drained batch keeps the file readable
+        // while the batch runs without paying a syscall per record
+        QByteArray chunk;
+        for (const ConversionResult& result : batch) {
+            chunk += formatRecord(result);
+        }
+        batch.clear();
+
+        if (m_file.write(chunk) != chunk.size() || !m_file.flush()) {
+            m_writeFailed = true;
+        }
+    }
+}
+
+QByteArray ReportWriter::formatRecord(const ConversionResult& result) const
+{
+    if (m_format == Format::CSV) {
+        QStringList fields;
+        fields << csvField(result.inputFile)
+               << csvField(result.outputFile)
+               << (result.success ? "true" : "false")
+               << csvField(result.errorMessage)
+               << QString::number(result.outputSize)
+               << QString::number(result.elapsedMs)
+               << csvField(result.duplicateOf);
+        return fields.join(',').toUtf8() + '\n';
+    }
+
+    QJsonObject json;
+    json["input"] = result.inputFile;
+    json["output"] = result.outputFile;
+    json["success"] = result.success;
+    json["error"] = result.errorMessage;
+    json["outputSize"] = result.outputSize;
+    json["elapsedMs"] = result.elapsedMs;
+    if (!result.duplicateOf.isEmpty()) {
+        json["duplicateOf"] = result.duplicateOf;
+    }
+    return QJsonDocument(json).toJson(QJsonDocument::Compact) + '\n';
+}
+
+bool ReportWriter::read(const QString& filePath,
+                        const std::function<void(const ConversionResult&)>& visitor,
+                        QString& errorMessage)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        errorMessage = QString("Failed to open report file: %1").arg(file.errorString());
+        return false;
+    }
+
+    if (formatForPath(filePath) == Format::CSV) {
+        QTextStream stream(&file);
+        QStringList fields;
+        bool header = true;
+        while (readCsvRecord(stream, fields)) {
+            if (header) {
+                header = false;
+                continue;
+            }
+            if (fields.size() < 6) {
+                continue;
+            }
+            ConversionResult result;
+            result.inputFile = fields[0];
+            result.outputFile = fields[1];
+            result.success = fields[2] == "true";
+            result.errorMessage = fields[3];
+            result.outputSize = fields[4].toLongLong();
+            result.elapsedMs = fields[5].toLongLong();
+            // Reports written before duplicate detection have six columns
+            result.duplicateOf = fields.value(6);
+            visitor(result);
+        }
+        return true;
+    }
+
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        const QJsonObject json = QJsonDocument::fromJson(line).object();
+        if (json.isEmpty()) {
+            continue;
+        }
+        ConversionResult result;
+        result.inputFile = json["input"].toString();
+        result.outputFile = json["output"].toString();
+        result.success = json["success"].toBool();
+        result.errorMessage = json["error"].toString();
+        result.outputSize = static_cast<qint64>(json["outputSize"].toDouble());
+        result.elapsedMs = static_cast<qint64>(json["elapsedMs"].toDouble());
+        result.duplicateOf = json["duplicateOf"].toString();
+        visitor(result);
+    }
+    return true;
+}
+
+bool ReportWriter::loadSucceededInputs(const QString& filePath, QSet<QString>& inputs,
+                                       QString& errorMessage)
+{
+    return read(filePath, [&inputs](const ConversionResult& result) {
+        // A later record for the same input supersedes an earlier one
+        if (result.success) {
+            inputs.insert(result.inputFile);
+        } else {
+            inputs.remove(result.inputFile);
+        }
+    }, errorMessage);
+}
+
+bool ReportWriter::compare(const QString& baselinePath, const QString& currentPath,
+                           double sizeTolerance, QStringList& regressions,
+                           QString& errorMessage)
+{
+    QHash<QString, ConversionResult> baseline;
+    if (!read(baselinePath, [&baseline](const ConversionResult& result) {
+            baseline.insert(result.inputFile, result);
+        }, errorMessage)) {
+        return false;
+    }
+
+    return read(currentPath, [&](const ConversionResult& current) {
+        auto it = baseline.constFind(current.inputFile);
+        if (it == baseline.constEnd()) {
+            return;
+        }
+        const ConversionResult& before = it.value();
+        QString name = QFileInfo(current.inputFile).fileName();
+
+        if (before.success && !current.success) {
+            regressions.append(QString("%1: now fails (%2)").arg(name, current.errorMessage));
+        } else if (before.success && current.success && before.outputSize > 0 &&
+                   current.outputSize > before.outputSize * (1.0 + sizeTolerance)) {
+            regressions.append(QString("%1: output grew from %2 to %3 bytes")
+                .arg(name).arg(before.outputSize).arg(current.outputSize));
+        }
+    }, errorMessage);
+}
@@ -0,0 +1,109 @@
+#ifndef REPORTWRITER_H
+#define REPORTWRITER_H
+
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QWaitCondition>
+#include <functional>
+#include "conversionworker.h"
+
+class QThread;
+
+/**
+ * @brief Streams conversion results to a JSONL or CSV report file
+ *
+ * Results handed to consume() are queued and written by a background
+ * thread in batches, so converting threads never wait on report I/O unless
+ * the writer falls far behind. Reports written earlier can be loaded back
+ * to skip already converted inputs or to compare two runs.
+ */
+class ReportWriter : public ConversionResultSink
+{
+public:
+    enum class Format {
+        JSONL,
+        CSV
+    };
+
+    // Results queued before consume() blocks waiting for the writer thread
+    static const int MAX_PENDING = 65536;
+
+    ReportWriter();
+    ~ReportWriter() override;
+
+    /**
+     * @brief Pick the report format from the file extension (.csv or JSONL)
+     */
+    static Format formatForPath(const QString& filePath);
+
+    /**
+     * @brief Open a report file and start the writer thread
+     * @param filePath Path to the report file
+     * @param append Keep existing records and append new ones
+     * @param errorMessage Output error message if opening fails
+     * @return true if successful, false otherwise
+     */
+    bool open(const QString& filePath, bool append, QString& errorMessage);
+
+    /**
+     * @brief Write all queued results, stop the writer thread and close the file
+     * @param errorMessage Output error message if any write failed
+     * @return true if every record was written, false otherwise
+     */
+    bool close(QString& errorMessage);
+
+    bool isOpen() const;
+    QString filePath() const;
+
+    void consume(const ConversionResult& result) override;
+
+    /**
+     * @brief Read every record of a JSONL or CSV report
+     * @param filePath Path to the report file
+     * @param visitor Called once per record, in file order
+     * @param errorMessage Output error message if reading fails
+     * @return true if successful, false otherwise
+     */
+    static bool read(const QString& filePath,
+                     const std::function<void(const ConversionResult&)>& visitor,
+                     QString& errorMessage);
+
+    /**
+     * @brief Collect the inputs a report records as converted successfully
+     */
+    static bool loadSucceededInputs(const QString& filePath, QSet<QString>& inputs,
+                                    QString& errorMessage);
+
+    /**
+     * @brief Compare a report against a baseline report
+     * @param baselinePath Report of the reference run
+     * @param currentPath Report of the run under test
+     * @param sizeTolerance Allowed relative output size growth (0.05 = 5%)
+     * @param regressions Output list of human-readable regressions
+     * @param errorMessage Output error message if a report cannot be read
+     * @return true if both reports were read, false otherwise
+     */
+    static bool compare(const QString& baselinePath, const QString& currentPath,
+                        double sizeTolerance, QStringList& regressions,
+                        QString& errorMessage);
+
+private:
+    void run();
+    QByteArray formatRecord(const ConversionResult& result) const;
+
+    QFile m_file;
+    Format m_format;
+    QThread* m_thread;
+    QMutex m_mutex;
+    QWaitCondition m_queueNotEmpty;
+    QWaitCondition m_queueNotFull;
+    QList<ConversionResult> m_queue;
+    bool m_closing;
+    bool m_writeFailed;
+};
+
+#endif // REPORTWRITER_H
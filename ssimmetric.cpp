@@ -0,0 +1,161 @@
+#include "ssimmetric.h"
+#include "tracer.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Stabilising constants for 8-bit data, as in the original SSIM paper
+const double C1 = (0.01 * 255) * (0.01 * 255);
+const double C2 = (0.03 * 255) * (0.03 * 255);
+
+struct WindowSums {
+    quint32 x = 0;
+    quint32 y = 0;
+    quint32 xx = 0;
+    quint32 yy = 0;
+    quint32 xy = 0;
+};
+
+// Sums over a width x height window (used for images smaller than one window)
+WindowSums sumWindow(const uchar* x, qsizetype xStride, const uchar* y, qsizetype yStride,
+                     int width, int height)
+{
+    WindowSums s;
+    for (int row = 0; row < height; ++row) {
+        for (int col = 0; col < width; ++col) {
+            quint32 a = x[row * xStride + col];
+            quint32 b = y[row * yStride + col];
+            s.x += a;
+            s.y += b;
+            s.xx += a * a;
+            s.yy += b * b;
+            s.xy += a * b;
+        }
+    }
+    return s;
+}
+
+#ifdef __SSE2__
+inline quint32 horizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<quint32>(_mm_cvtsi128_si32(v));
+}
+#endif
+
+// Sums over one 8x8 window
+inline WindowSums sumWindow8x8(const uchar* x, qsizetype xStride, const uchar* y, qsizetype yStride)
+{
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sx = zero, sy = zero, sxx = zero, syy = zero, sxy = zero;
+
+    for (int row = 0; row < SsimMetric::WINDOW; ++row) {
+        __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + row * xStride));
+        __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + row * yStride));
+        sx = _mm_add_epi64(sx, _mm_sad_epu8(a, zero));
+        sy = _mm_add_epi64(sy, _mm_sad_epu8(b, zero));
+
+        __m128i a16 = _mm_unpacklo_epi8(a, zero);
+        __m128i b16 = _mm_unpacklo_epi8(b, zero);
+        sxx = _mm_add_epi32(sxx, _mm_madd_epi16(a16, a16));
+        syy = _mm_add_epi32(syy, _mm_madd_epi16(b16, b16));
+        sxy = _mm_add_epi32(sxy, _mm_madd_epi16(a16, b16));
+    }
+
+    WindowSums s;
+    s.x = static_cast<quint32>(_mm_cvtsi128_si32(sx));
+    s.y = static_cast<quint32>(_mm_cvtsi128_si32(sy));
+    s.xx = horizontalSum(sxx);
+    s.yy = horizontalSum(syy);
+    s.xy = horizontalSum(sxy);
+    return s;
+#else
+    return sumWindow(x, xStride, y, yStride, SsimMetric::WINDOW, SsimMetric::WINDOW);
+#endif
+}
+
+double windowSsim(const WindowSums& s, int count)
+{
+    const double n = count;
+    double mx = s.x / n;
+    double my = s.y / n;
+    double vx = s.xx / n - mx * mx;
+    double vy = s.yy / n - my * my;
+    double cxy = s.xy / n - mx * my;
+    return ((2 * mx * my + C1) * (2 * cxy + C2)) /
+           ((mx * mx + my * my + C1) * (vx + vy + C2));
+}
+
+} // namespace
+
+double SsimMetric::compare(const QImage& reference, const QImage& distorted, int maxThreads)
+{
+    if (reference.size() != distorted.size() || reference.isNull()) {
+        return -1.0;
+    }
+
+    TraceSpan span("SsimMetric::compare", "metric");
+
+    const QImage x = reference.convertToFormat(QImage::Format_Grayscale8);
+    const QImage y = distorted.convertToFormat(QImage::Format_Grayscale8);
+    const qsizetype xStride = x.bytesPerLine();
+    const qsizetype yStride = y.bytesPerLine();
+
+    if (x.width() < WINDOW || x.height() < WINDOW) {
+        WindowSums s = sumWindow(x.constBits(), xStride, y.constBits(), yStride, x.width(), x.height());
+        return windowSsim(s, x.width() * x.height());
+    }
+
+    const int windowCols = (x.width() - WINDOW) / STEP + 1;
+    const int windowRows = (x.height() - WINDOW) / STEP + 1;
+
+    if (maxThreads <= 0) {
+        maxThreads = QThread::idealThreadCount();
+    }
+    const int bands = qBound(1, maxThreads, windowRows);
+
+    // Each band of window rows is a tile scored independently
+    QVector<double> bandSums(bands, 0.0);
+    auto scoreBand = [&](int band) {
+        const int firstRow = static_cast<int>(static_cast<qint64>(windowRows) * band / bands);
+        const int lastRow = static_cast<int>(static_cast<qint64>(windowRows) * (band + 1) / bands);
+        double sum = 0.0;
+        for (int row = firstRow; row < lastRow; ++row) {
+            const uchar* xLine = x.constScanLine(row * STEP);
+            const uchar* yLine = y.constScanLine(row * STEP);
+            for (int col = 0; col < windowCols; ++col) {
+                sum += windowSsim(sumWindow8x8(xLine + col * STEP, xStride, yLine + col * STEP, yStride),
+                                  WINDOW * WINDOW);
+            }
+        }
+        bandSums[band] = sum;
+    };
+
+    if (bands == 1) {
+        scoreBand(0);
+    } else {
+        // The calling thread scores the first band while the pool does the rest
+        QThreadPool pool;
+        pool.setMaxThreadCount(bands - 1);
+        for (int band = 1; band < bands; ++band) {
+            pool.start([&scoreBand, band]() { scoreBand(band); });
+        }
+        scoreBand(0);
+        pool.waitForDone();
+    }
+
+    double total = 0.0;
+    for (double sum : bandSums) {
+        total += sum;
+    }
+    return total / (static_cast<double>(windowRows) * windowCols);
+}
@@ -0,0 +1,31 @@
+#ifndef SSIMMETRIC_H
+#define SSIMMETRIC_H
+
+#include <QImage>
+#include <QString>
+
+/**
+ * @brief Structural similarity (SSIM) between two images of the same size
+ *
+ * Computed on luma over 8x8 windows placed every 4 pixels. Window sums use
+ * SSE2 where available, and bands of window rows are scored on separate
+ * threads.
+ */
+class SsimMetric
+{
+public:
+    // Window size and spacing in pixels
+    static const int WINDOW = 8;
+    static const int STEP = 4;
+
+    /**
+     * @brief Mean SSIM of a distorted image against its reference
+     * @param reference The original image
+     * @param distorted The image to score, same size as the reference
+     * @param maxThreads Threads to use (<= 0: one per core)
+     * @return SSIM in [-1, 1] (1 means identical), or -1 if the sizes differ
+     */
+    static double compare(const QImage& reference, const QImage& distorted, int maxThreads = 0);
+};
+
+#endif // SSIMMETRIC_H
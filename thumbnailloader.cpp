@@ -0,0 +1,155 @@
+#include "thumbnailloader.h"
+#include "heifhandler.h"
+#include "imageconverter.h"
+#include "tracer.h"
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+// Reads TIFF fields in the byte order of the EXIF block, returning 0 past the end
+class TiffReader
+{
+public:
+    TiffReader(const uchar* data, quint32 size, bool bigEndian)
+        : m_data(data), m_size(size), m_bigEndian(bigEndian) {}
+
+    quint16 u16(quint32 offset) const
+    {
+        if (offset > m_size || m_size - offset < 2) {
+            return 0;
+        }
+        return m_bigEndian ? qFromBigEndian<quint16>(m_data + offset) : qFromLittleEndian<quint16>(m_data + offset);
+    }
+
+    quint32 u32(quint32 offset) const
+    {
+        if (offset > m_size || m_size - offset < 4) {
+            return 0;
+        }
+        return m_bigEndian ? qFromBigEndian<quint32>(m_data + offset) : qFromLittleEndian<quint32>(m_data + offset);
+    }
+
+private:
+    const uchar* m_data;
+    quint32 m_size;
+    bool m_bigEndian;
+};
+
+// Find the thumbnail's offset and length in IFD1 of a TIFF-structured EXIF block
+bool findThumbnail(const uchar* tiff, quint32 size, quint32& offset, quint32& length)
+{
+    if (size < 8 || (memcmp(tiff, "II", 2) != 0 && memcmp(tiff, "MM", 2) != 0)) {
+        return false;
+    }
+    const TiffReader reader(tiff, size, tiff[0] == 'M');
+    if (reader.u16(2) != 42) {
+        return false;
+    }
+
+    // IFD0 describes the main image; the thumbnail lives in the IFD after it
+    const quint32 ifd0 = reader.u32(4);
+    const quint32 ifd1 = reader.u32(ifd0 + 2 + reader.u16(ifd0) * 12u);
+    if (ifd1 == 0 || ifd1 >= size) {
+        return false;
+    }
+
+    offset = 0;
+    length = 0;
+    const quint16 count = reader.u16(ifd1);
+    for (quint16 i = 0; i < count; ++i) {
+        const quint32 entry = ifd1 + 2 + i * 12u;
+        switch (reader.u16(entry)) {
+            case 0x0201: offset = reader.u32(entry + 8); break;   // JPEGInterchangeFormat
+            case 0x0202: length = reader.u32(entry + 8); break;   // JPEGInterchangeFormatLength
+            default: break;
+        }
+    }
+    return offset > 0 && length > 0 && offset < size && length <= size - offset;
+}
+
+// True if the thumbnail is the full image scaled down, not letterboxed or cropped
+bool hasSameShape(const QSize& thumbnail, const QSize& image)
+{
+    const qint64 difference = qint64(thumbnail.width()) * image.height() - qint64(thumbnail.height()) * image.width();
+    return qAbs(difference) <= qMax(image.width(), image.height());
+}
+
+} // namespace
+
+bool ThumbnailLoader::load(const QByteArray& data, int minSize, QImage& thumbnail,
+                           QSize& imageSize, QString& errorMessage)
+{
+    if (ImageConverter::detectFormat(data) == "heif") {
+        return HeifHandler::readThumbnail(data, minSize, thumbnail, imageSize, errorMessage);
+    }
+
+    TraceSpan span("ThumbnailLoader::exif", "codec");
+
+    QByteArray encoded;
+    if (!readExifThumbnail(data, encoded)) {
+        errorMessage = "No embedded thumbnail";
+        return false;
+    }
+
+    // The JPEG header gives the full size without decoding any pixels
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, "jpeg");
+    imageSize = reader.size();
+
+    QImage image;
+    if (!imageSize.isValid() || !image.loadFromData(encoded, "jpeg")) {
+        errorMessage = "Failed to decode embedded thumbnail";
+        return false;
+    }
+    if (qMax(image.width(), image.height()) < minSize || !hasSameShape(image.size(), imageSize)) {
+        errorMessage = "No embedded thumbnail is large enough";
+        return false;
+    }
+
+    thumbnail = image;
+    return true;
+}
+
+bool ThumbnailLoader::readExifThumbnail(const QByteArray& data, QByteArray& thumbnail)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    const int size = data.size();
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return false;
+    }
+
+    // Walk the marker segments up to the start of the image data
+    int pos = 2;
+    while (pos + 4 <= size && bytes[pos] == 0xFF) {
+        const uchar marker = bytes[pos + 1];
+        if (marker == 0xDA || marker == 0xD9) {
+            break;
+        }
+        const int length = qFromBigEndian<quint16>(bytes + pos + 2);
+        if (length < 2 || pos + 2 + length > size) {
+            break;
+        }
+
+        // APP1 "Exif\0\0" followed by a TIFF structure
+        if (marker == 0xE1 && length >= 16 && memcmp(bytes + pos + 4, "Exif\0\0", 6) == 0) {
+            const uchar* tiff = bytes + pos + 10;
+            const quint32 tiffSize = static_cast<quint32>(length - 8);
+            quint32 offset = 0;
+            quint32 thumbnailLength = 0;
+            if (!findThumbnail(tiff, tiffSize, offset, thumbnailLength) || thumbnailLength < 4 ||
+                tiff[offset] != 0xFF || tiff[offset + 1] != 0xD8) {
+                return false;
+            }
+            thumbnail = QByteArray(reinterpret_cast<const char*>(tiff + offset), static_cast<int>(thumbnailLength));
+            return true;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
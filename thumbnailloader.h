@@ -0,0 +1,42 @@
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Fast path that decodes a file's embedded thumbnail instead of the full image
+ *
+ * HEIF files list their thumbnails as separate items and most camera JPEGs
+ * carry a small JPEG in their EXIF block. Decoding one of those takes a few
+ * milliseconds, against hundreds for a full-resolution HEIC, which is all a
+ * preview or an icon needs.
+ */
+class ThumbnailLoader
+{
+public:
+    /**
+     * @brief Decode an embedded thumbnail whose longer side is at least minSize
+     * @param data Encoded file contents
+     * @param minSize Smallest acceptable longer side in pixels
+     * @param thumbnail Output QImage (the thumbnail)
+     * @param imageSize Output size of the full image
+     * @param errorMessage Output error message if no thumbnail fits
+     * @return true if a thumbnail was decoded, false if the caller must
+     *         decode the full image
+     */
+    static bool load(const QByteArray& data, int minSize, QImage& thumbnail,
+                     QSize& imageSize, QString& errorMessage);
+
+    /**
+     * @brief Extract the JPEG thumbnail from the EXIF block of a JPEG file
+     * @param data Encoded JPEG file contents
+     * @param thumbnail Output encoded thumbnail
+     * @return true if the file has an EXIF thumbnail, false otherwise
+     */
+    static bool readExifThumbnail(const QByteArray& data, QByteArray& thumbnail);
+};
+
+#endif // THUMBNAILLOADER_H
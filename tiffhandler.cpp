@@ -0,0 +1,700 @@
+#include "tiffhandler.h"
+#include "bufferpool.h"
+#include "tracer.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QVector>
+#include <cstring>
+
+#ifdef HAVE_LIBTIFF
+#include <tiffio.h>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QColorSpace>
+#endif
+
+namespace {
+
+// libtiff client procedures over a QBuffer opened read-write
+tmsize_t readProc(thandle_t handle, void* data, tmsize_t size)
+{
+    return static_cast<QBuffer*>(handle)->read(static_cast<char*>(data), size);
+}
+
+tmsize_t writeProc(thandle_t handle, void* data, tmsize_t size)
+{
+    return static_cast<QBuffer*>(handle)->write(static_cast<const char*>(data), size);
+}
+
+toff_t seekProc(thandle_t handle, toff_t offset, int whence)
+{
+    QBuffer* buffer = static_cast<QBuffer*>(handle);
+    qint64 position = static_cast<qint64>(offset);
+    if (whence == SEEK_CUR) {
+        position += buffer->pos();
+    } else if (whence == SEEK_END) {
+        position += buffer->size();
+    }
+    // Seeking past the end of a writable QBuffer pads it with zeros
+    return buffer->seek(position) ? static_cast<toff_t>(buffer->pos()) : static_cast<toff_t>(-1);
+}
+
+int closeProc(thandle_t)
+{
+    return 0;
+}
+
+toff_t sizeProc(thandle_t handle)
+{
+    return static_cast<toff_t>(static_cast<QBuffer*>(handle)->size());
+}
+
+int mapProc(thandle_t, void**, toff_t*)
+{
+    return 0;
+}
+
+void unmapProc(thandle_t, void*, toff_t)
+{
+}
+
+TIFF* openBuffer(QBuffer& buffer, const char* mode)
+{
+    return TIFFClientOpen("memory", mode, &buffer, readProc, writeProc, seekProc, closeProc,
+                          sizeProc, mapProc, unmapProc);
+}
+
+bool compressionTag(TiffHandler::Compression compression, uint16_t& tag, QString& errorMessage)
+{
+    switch (compression) {
+        case TiffHandler::Compression::None: tag = COMPRESSION_NONE; break;
+        case TiffHandler::Compression::LZW: tag = COMPRESSION_LZW; break;
+        case TiffHandler::Compression::Deflate: tag = COMPRESSION_ADOBE_DEFLATE; break;
+        case TiffHandler::Compression::ZSTD:
+#ifdef COMPRESSION_ZSTD
+            tag = COMPRESSION_ZSTD;
+            break;
+#else
+            errorMessage = "This libtiff has no ZSTD support";
+            return false;
+#endif
+    }
+    if (!TIFFIsCODECConfigured(tag)) {
+        errorMessage = "This libtiff was built without the requested compression";
+        return false;
+    }
+    return true;
+}
+
+// Image rows in a layout TIFF stores directly; RGBX rows lose their padding byte or word
+struct PixelLayout {
+    QImage image;
+    int samples = 0;
+    int bitsPerSample = 8;
+    uint16_t photometric = PHOTOMETRIC_MINISBLACK;
+    bool alpha = false;
+    bool dropPadding = false;
+    QVector<uint16_t> colorMap;  // Palette layouts: the red, then green, then blue ramp
+
+    // Packed bytes of count pixels; 1-bit rows end on a whole byte
+    size_t packedBytes(int count) const { return (static_cast<size_t>(count) * samples * bitsPerSample + 7) / 8; }
+    // Offset of pixel x in a source scanline (a multiple of 8 for 1-bit rows)
+    size_t sourceOffset(int x) const { return static_cast<size_t>(x) * image.depth() / 8; }
+
+    // Copy count pixels from a source scanline into packed samples
+    void copyPixels(const uchar* source, uchar* destination, int count) const
+    {
+        if (!dropPadding) {
+            memcpy(destination, source, packedBytes(count));
+            return;
+        }
+        const int step = image.depth() / 8;
+        const int keep = samples * bitsPerSample / 8;
+        for (int x = 0; x < count; ++x) {
+            memcpy(destination + x * keep, source + x * step, keep);
+        }
+    }
+};
+
+// Palette of a 1- or 8-bit indexed image as a TIFF color map, or empty if
+// it has transparent entries (a TIFF palette has no alpha)
+QVector<uint16_t> colorMapFor(const QImage& image, int bitsPerSample)
+{
+    const QVector<QRgb> colors = image.colorTable();
+    const int entries = 1 << bitsPerSample;
+    if (colors.isEmpty() || colors.size() > entries) {
+        return QVector<uint16_t>();
+    }
+    QVector<uint16_t> map(3 * entries, 0);
+    for (int i = 0; i < colors.size(); ++i) {
+        if (qAlpha(colors[i]) != 255) {
+            return QVector<uint16_t>();
+        }
+        map[i] = static_cast<uint16_t>(qRed(colors[i]) * 257);
+        map[entries + i] = static_cast<uint16_t>(qGreen(colors[i]) * 257);
+        map[2 * entries + i] = static_cast<uint16_t>(qBlue(colors[i]) * 257);
+    }
+    return map;
+}
+
+PixelLayout pixelLayout(const QImage& image)
+{
+    PixelLayout layout;
+    layout.alpha = image.hasAlphaChannel();
+    switch (image.format()) {
+        case QImage::Format_Grayscale8:
+            layout.image = image;
+            layout.samples = 1;
+            return layout;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        case QImage::Format_Grayscale16:
+            layout.image = image;
+            layout.samples = 1;
+            layout.bitsPerSample = 16;
+            return layout;
+#endif
+        case QImage::Format_RGB888:
+            layout.image = image;
+            layout.samples = 3;
+            layout.photometric = PHOTOMETRIC_RGB;
+            return layout;
+        case QImage::Format_Mono:
+        case QImage::Format_MonoLSB: {
+            // Bilevel scans stay 1-bit, as with Qt's plugin; TIFF's default fill order is MSB first
+            const QVector<QRgb> colors = image.colorTable();
+            const QVector<uint16_t> map = colorMapFor(image, 1);
+            if (map.isEmpty()) {
+                break;
+            }
+            layout.image = image.format() == QImage::Format_Mono ? image : image.convertToFormat(QImage::Format_Mono);
+            layout.samples = 1;
+            layout.bitsPerSample = 1;
+            layout.alpha = false;
+            if (colors.size() == 2 && colors[0] == qRgb(0, 0, 0) && colors[1] == qRgb(255, 255, 255)) {
+                layout.photometric = PHOTOMETRIC_MINISBLACK;
+            } else if (colors.size() == 2 && colors[0] == qRgb(255, 255, 255) && colors[1] == qRgb(0, 0, 0)) {
+                layout.photometric = PHOTOMETRIC_MINISWHITE;
+            } else {
+                layout.photometric = PHOTOMETRIC_PALETTE;
+                layout.colorMap = map;
+            }
+            return layout;
+        }
+        case QImage::Format_Indexed8: {
+            const QVector<uint16_t> map = colorMapFor(image, 8);
+            if (map.isEmpty()) {
+                break;
+            }
+            layout.image = image;
+            layout.samples = 1;
+            layout.photometric = PHOTOMETRIC_PALETTE;
+            layout.alpha = false;
+            layout.colorMap = map;
+            return layout;
+        }
+        default:
+            break;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (image.depth() > 32) {
+        layout.image = image.convertToFormat(layout.alpha ? QImage::Format_RGBA64 : QImage::Format_RGBX64);
+        layout.bitsPerSample = 16;
+    } else
+#endif
+    {
+        layout.image = image.convertToFormat(layout.alpha ? QImage::Format_RGBA8888 : QImage::Format_RGBX8888);
+    }
+    layout.samples = layout.alpha ? 4 : 3;
+    layout.photometric = PHOTOMETRIC_RGB;
+    layout.dropPadding = !layout.alpha;
+    return layout;
+}
+
+// Write one image as the current directory (page) of an open TIFF
+bool writeImage(TIFF* tif, const QImage& image, const TiffHandler::Settings& settings,
+                QString& errorMessage)
+{
+    if (image.isNull()) {
+        errorMessage = "Source image is null";
+        return false;
+    }
+
+    uint16_t compression = COMPRESSION_NONE;
+    if (!compressionTag(settings.compression, compression, errorMessage)) {
+        return false;
+    }
+
+    const PixelLayout layout = pixelLayout(image);
+    const uint32_t width = static_cast<uint32_t>(image.width());
+    const uint32_t height = static_cast<uint32_t>(image.height());
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, static_cast<uint16_t>(layout.bitsPerSample));
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, static_cast<uint16_t>(layout.samples));
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, layout.photometric);
+    if (layout.photometric == PHOTOMETRIC_PALETTE) {
+        const int entries = 1 << layout.bitsPerSample;
+        const uint16_t* map = layout.colorMap.constData();
+        TIFFSetField(tif, TIFFTAG_COLORMAP, map, map + entries, map + 2 * entries);
+    }
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+    if (layout.alpha) {
+        // QImage's RGBA formats are not premultiplied
+        const uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    // Differencing palette indices or 1-bit samples gains nothing (libtiff rejects the latter)
+    if (settings.predictor && compression != COMPRESSION_NONE && layout.bitsPerSample >= 8 &&
+        layout.photometric != PHOTOMETRIC_PALETTE) {
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    }
+
+    // Scans are archived with their resolution
+    if (image.dotsPerMeterX() > 0 && image.dotsPerMeterY() > 0) {
+        TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+        TIFFSetField(tif, TIFFTAG_XRESOLUTION, static_cast<float>(image.dotsPerMeterX() * 0.0254));
+        TIFFSetField(tif, TIFFTAG_YRESOLUTION, static_cast<float>(image.dotsPerMeterY() * 0.0254));
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QByteArray icc = image.colorSpace().isValid() ? image.colorSpace().iccProfile() : QByteArray();
+    if (!icc.isEmpty()) {
+        TIFFSetField(tif, TIFFTAG_ICCPROFILE, static_cast<uint32_t>(icc.size()), icc.constData());
+    }
+#endif
+
+    if (settings.tileSize <= 0) {
+        // Strips of about 256 KB compress well and keep readers' memory low
+        const tmsize_t rowBytes = static_cast<tmsize_t>(layout.packedBytes(static_cast<int>(width)));
+        const uint32_t rowsPerStrip = static_cast<uint32_t>(qMax<tmsize_t>(1, 256 * 1024 / qMax<tmsize_t>(1, rowBytes)));
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, qMin(rowsPerStrip, height));
+
+        QVector<uchar> row(static_cast<int>(rowBytes));
+        for (uint32_t y = 0; y < height; ++y) {
+            layout.copyPixels(layout.image.constScanLine(static_cast<int>(y)), row.data(), static_cast<int>(width));
+            if (TIFFWriteScanline(tif, row.data(), y, 0) < 0) {
+                errorMessage = "Failed to write TIFF strip";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (!TiffHandler::isValidTileSize(settings.tileSize)) {
+        errorMessage = QString("TIFF tile size must be a multiple of 16 up to %1").arg(TiffHandler::MAX_TILE_SIZE);
+        return false;
+    }
+    const uint32_t tileSize = static_cast<uint32_t>(settings.tileSize);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+
+    // Edge tiles are padded with zeros; at most 4096 x 4096 x 8 bytes, so the size fits
+    const size_t tileRowBytes = layout.packedBytes(static_cast<int>(tileSize));
+    QVector<uchar> tile(static_cast<qsizetype>(tileSize) * static_cast<qsizetype>(tileRowBytes));
+    for (uint32_t tileY = 0; tileY < height; tileY += tileSize) {
+        for (uint32_t tileX = 0; tileX < width; tileX += tileSize) {
+            const uint32_t columns = qMin(tileSize, width - tileX);
+            const uint32_t rows = qMin(tileSize, height - tileY);
+            if (columns < tileSize || rows < tileSize) {
+                tile.fill(0);
+            }
+            for (uint32_t y = 0; y < rows; ++y) {
+                const uchar* source = layout.image.constScanLine(static_cast<int>(tileY + y)) +
+                                      layout.sourceOffset(static_cast<int>(tileX));
+                layout.copyPixels(source, tile.data() + static_cast<size_t>(y) * tileRowBytes,
+                                  static_cast<int>(columns));
+            }
+            if (TIFFWriteTile(tif, tile.data(), tileX, tileY, 0, 0) < 0) {
+                errorMessage = "Failed to write TIFF tile";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Classic TIFF offsets are 32-bit; past this many bytes, output is written as BigTIFF
+const qint64 BIGTIFF_THRESHOLD = 0xF0000000LL;
+
+// Copy the tags writeImage sets from the current directory of one TIFF to another
+void copyTags(TIFF* in, TIFF* out)
+{
+    uint32_t value32 = 0;
+    for (uint32_t tag : {TIFFTAG_IMAGEWIDTH, TIFFTAG_IMAGELENGTH, TIFFTAG_ROWSPERSTRIP, TIFFTAG_TILEWIDTH,
+                         TIFFTAG_TILELENGTH, TIFFTAG_SUBFILETYPE}) {
+        if (TIFFGetField(in, tag, &value32)) {
+            TIFFSetField(out, tag, value32);
+        }
+    }
+    uint16_t value16 = 0;
+    for (uint32_t tag : {TIFFTAG_BITSPERSAMPLE, TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_PLANARCONFIG, TIFFTAG_PHOTOMETRIC,
+                         TIFFTAG_ORIENTATION, TIFFTAG_COMPRESSION, TIFFTAG_PREDICTOR, TIFFTAG_RESOLUTIONUNIT}) {
+        if (TIFFGetField(in, tag, &value16)) {
+            TIFFSetField(out, tag, value16);
+        }
+    }
+    float resolution = 0;
+    for (uint32_t tag : {TIFFTAG_XRESOLUTION, TIFFTAG_YRESOLUTION}) {
+        if (TIFFGetField(in, tag, &resolution)) {
+            TIFFSetField(out, tag, resolution);
+        }
+    }
+    uint16_t page = 0;
+    uint16_t pages = 0;
+    if (TIFFGetField(in, TIFFTAG_PAGENUMBER, &page, &pages)) {
+        TIFFSetField(out, TIFFTAG_PAGENUMBER, page, pages);
+    }
+    uint16_t extraCount = 0;
+    uint16_t* extra = nullptr;
+    if (TIFFGetField(in, TIFFTAG_EXTRASAMPLES, &extraCount, &extra)) {
+        TIFFSetField(out, TIFFTAG_EXTRASAMPLES, extraCount, extra);
+    }
+    uint16_t* red = nullptr;
+    uint16_t* green = nullptr;
+    uint16_t* blue = nullptr;
+    if (TIFFGetField(in, TIFFTAG_COLORMAP, &red, &green, &blue)) {
+        TIFFSetField(out, TIFFTAG_COLORMAP, red, green, blue);
+    }
+    uint32_t iccSize = 0;
+    void* icc = nullptr;
+    if (TIFFGetField(in, TIFFTAG_ICCPROFILE, &iccSize, &icc)) {
+        TIFFSetField(out, TIFFTAG_ICCPROFILE, iccSize, icc);
+    }
+}
+
+// Re-write every page of a classic TIFF into a BigTIFF, moving the compressed blocks as they are
+bool copyPages(QByteArray& classic, TIFF* out, QString& errorMessage)
+{
+    QBuffer buffer(&classic);
+    buffer.open(QIODevice::ReadOnly);
+    TIFF* in = openBuffer(buffer, "r");
+    if (!in) {
+        errorMessage = "Failed to reopen TIFF pages";
+        return false;
+    }
+
+    bool ok = true;
+    QByteArray block;
+    do {
+        copyTags(in, out);
+        const bool tiled = TIFFIsTiled(in);
+        const uint32_t count = tiled ? TIFFNumberOfTiles(in) : TIFFNumberOfStrips(in);
+        uint64_t* sizes = nullptr;
+        ok = TIFFGetField(in, tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &sizes) && sizes;
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            // Blocks are at most a 256 KB strip or a 4096 x 4096 tile, before compression
+            const tmsize_t size = static_cast<tmsize_t>(sizes[i]);
+            block.resize(static_cast<int>(size));
+            if (tiled) {
+                ok = TIFFReadRawTile(in, i, block.data(), size) == size &&
+                     TIFFWriteRawTile(out, i, block.data(), size) == size;
+            } else {
+                ok = TIFFReadRawStrip(in, i, block.data(), size) == size &&
+                     TIFFWriteRawStrip(out, i, block.data(), size) == size;
+            }
+        }
+        ok = ok && TIFFWriteDirectory(out);
+    } while (ok && TIFFReadDirectory(in));
+    TIFFClose(in);
+
+    if (!ok) {
+        errorMessage = "Failed to move TIFF pages to BigTIFF";
+    }
+    return ok;
+}
+
+class TiffPageWriter : public FrameWriter
+{
+public:
+    explicit TiffPageWriter(const TiffHandler::Settings& settings)
+        : m_settings(settings), m_buffer(&m_data)
+    {
+        m_buffer.open(QIODevice::ReadWrite);
+        m_tif = openBuffer(m_buffer, "w");
+    }
+    ~TiffPageWriter() override
+    {
+        if (m_tif) {
+            TIFFClose(m_tif);
+        }
+    }
+
+    bool isValid() const { return m_tif != nullptr; }
+
+    bool addFrame(const Frame& frame, QString& errorMessage) override
+    {
+        TraceSpan span("TiffHandler::writePage", "codec");
+
+        // The page count is unknown while streaming, so the file starts as classic
+        // TIFF and moves to BigTIFF once the next page could carry it past 4 GB
+        const qint64 rawBytes = static_cast<qint64>(frame.image.bytesPerLine()) * frame.image.height();
+        if (!m_bigTiff && m_data.size() + rawBytes > BIGTIFF_THRESHOLD && !promote(errorMessage)) {
+            return false;
+        }
+
+        // Page numbers are written without a total, which is unknown while streaming
+        TIFFSetField(m_tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+        TIFFSetField(m_tif, TIFFTAG_PAGENUMBER, static_cast<uint16_t>(m_pages), static_cast<uint16_t>(0));
+        if (!writeImage(m_tif, frame.image, m_settings, errorMessage)) {
+            return false;
+        }
+        // Compressed data is flushed here; the decoded page is not kept
+        if (!TIFFWriteDirectory(m_tif)) {
+            errorMessage = "Failed to write TIFF page";
+            return false;
+        }
+        ++m_pages;
+        return true;
+    }
+
+    bool finish(QByteArray& output, QString& errorMessage) override
+    {
+        if (m_pages == 0) {
+            errorMessage = "No pages were written";
+            return false;
+        }
+        TIFFClose(m_tif);
+        m_tif = nullptr;
+        m_buffer.close();
+        output = m_data;
+        m_data.clear();
+        return true;
+    }
+
+private:
+    // Reopen the output as BigTIFF with the pages written so far
+    bool promote(QString& errorMessage)
+    {
+        TraceSpan span("TiffHandler::promoteToBigTiff", "codec");
+
+        TIFFClose(m_tif);
+        m_buffer.close();
+        QByteArray classic;
+        classic.swap(m_data);
+
+        m_buffer.open(QIODevice::ReadWrite);
+        m_tif = openBuffer(m_buffer, "w8");
+        m_bigTiff = true;
+        if (!m_tif) {
+            errorMessage = "Failed to create BigTIFF encoder";
+            return false;
+        }
+        return m_pages == 0 || copyPages(classic, m_tif, errorMessage);
+    }
+
+    TiffHandler::Settings m_settings;
+    QByteArray m_data;
+    QBuffer m_buffer;
+    TIFF* m_tif = nullptr;
+    int m_pages = 0;
+    bool m_bigTiff = false;
+};
+
+} // namespace
+#endif
+
+TiffHandler::TiffHandler()
+{
+}
+
+TiffHandler::~TiffHandler()
+{
+}
+
+bool TiffHandler::isAvailable()
+{
+#ifdef HAVE_LIBTIFF
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TiffHandler::isValidTileSize(int size)
+{
+    return size == 0 || (size > 0 && size <= MAX_TILE_SIZE && size % 16 == 0);
+}
+
+QVector<QImage::Format> TiffHandler::writeFormats()
+{
+    // Palette and 1-bit images are written as such unless their palette has alpha
+    return {QImage::Format_RGBA8888, QImage::Format_RGBX8888, QImage::Format_RGB888, QImage::Format_Grayscale8,
+            QImage::Format_Indexed8, QImage::Format_Mono,
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+            QImage::Format_RGBA64, QImage::Format_RGBX64,
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+            QImage::Format_Grayscale16,
+#endif
+    };
+}
+
+bool TiffHandler::writeData(const QImage& image, const Settings& settings, QByteArray& output,
+                            QString& errorMessage)
+{
+    TraceSpan span("TiffHandler::write", "codec");
+
+#ifdef HAVE_LIBTIFF
+    output.clear();
+    QBuffer buffer(&output);
+    buffer.open(QIODevice::ReadWrite);
+
+    // BigTIFF only when even the uncompressed pixels could pass the 4 GB limit
+    const qint64 rawBytes = static_cast<qint64>(image.bytesPerLine()) * image.height();
+    TIFF* tif = openBuffer(buffer, rawBytes > BIGTIFF_THRESHOLD ? "w8" : "w");
+    if (!tif) {
+        errorMessage = "Failed to create TIFF encoder";
+        return false;
+    }
+
+    bool ok = writeImage(tif, image, settings, errorMessage);
+    if (ok && !TIFFWriteDirectory(tif)) {
+        errorMessage = "Failed to write TIFF directory";
+        ok = false;
+    }
+    TIFFClose(tif);
+    if (!ok) {
+        output.clear();
+    }
+    return ok;
+#else
+    errorMessage = "TIFF support not compiled. Install libtiff and rebuild with HAVE_LIBTIFF defined.";
+    Q_UNUSED(image);
+    Q_UNUSED(settings);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
+
+std::unique_ptr<FrameWriter> TiffHandler::createPageWriter(const Settings& settings, QString& errorMessage)
+{
+#ifdef HAVE_LIBTIFF
+    std::unique_ptr<TiffPageWriter> writer(new TiffPageWriter(settings));
+    if (!writer->isValid()) {
+        errorMessage = "Failed to create TIFF encoder";
+        return nullptr;
+    }
+    return std::move(writer);
+#else
+    errorMessage = "TIFF support not compiled. Install libtiff and rebuild with HAVE_LIBTIFF defined.";
+    Q_UNUSED(settings);
+    return nullptr;
+#endif
+}
+
+bool TiffHandler::readRegion(const QString& filePath, const QRect& region, QImage& image, QString& errorMessage)
+{
+    TraceSpan span("TiffHandler::readRegion", "codec", filePath);
+
+#ifdef HAVE_LIBTIFF
+    // Opened from disk, so only the blocks that are read are loaded
+    TIFF* tif = TIFFOpen(QFile::encodeName(filePath).constData(), "r");
+    if (!tif) {
+        errorMessage = "Failed to open TIFF file";
+        return false;
+    }
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    const QRect bounds = region & QRect(0, 0, static_cast<int>(width), static_cast<int>(height));
+    if (bounds.isEmpty()) {
+        errorMessage = "Region lies outside the image";
+        TIFFClose(tif);
+        return false;
+    }
+
+    QImage result = BufferPool::createImage(bounds.size(), QImage::Format_RGBA8888_Premultiplied);
+    if (result.isNull()) {
+        errorMessage = "Failed to allocate image";
+        TIFFClose(tif);
+        return false;
+    }
+
+    // Blocks are whole tiles, or strips spanning the full width
+    uint32_t blockWidth = width;
+    uint32_t blockHeight = 0;
+    const bool tiled = TIFFIsTiled(tif);
+    if (tiled) {
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &blockWidth);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &blockHeight);
+    } else {
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &blockHeight);
+        blockHeight = qMin(blockHeight, height);
+    }
+    if (blockWidth == 0 || blockHeight == 0) {
+        errorMessage = "Invalid TIFF block layout";
+        TIFFClose(tif);
+        return false;
+    }
+
+    // libtiff's RGBA readers convert any photometric to 8-bit premultiplied ABGR words
+    QVector<uint32_t> raster(static_cast<int>(blockWidth * blockHeight));
+    const uint32_t firstY = static_cast<uint32_t>(bounds.top()) / blockHeight * blockHeight;
+    const uint32_t firstX = static_cast<uint32_t>(bounds.left()) / blockWidth * blockWidth;
+    bool ok = true;
+    for (uint32_t blockY = firstY; ok && blockY <= static_cast<uint32_t>(bounds.bottom()); blockY += blockHeight) {
+        for (uint32_t blockX = firstX; ok && blockX <= static_cast<uint32_t>(bounds.right()); blockX += blockWidth) {
+            ok = tiled ? TIFFReadRGBATile(tif, blockX, blockY, raster.data()) != 0
+                       : TIFFReadRGBAStrip(tif, blockY, raster.data()) != 0;
+            if (!ok) {
+                break;
+            }
+
+            // The raster is bottom-up: row r of the block sits at (rows - 1 - r)
+            const uint32_t rows = tiled ? blockHeight : qMin(blockHeight, height - blockY);
+            const QRect block = QRect(static_cast<int>(blockX), static_cast<int>(blockY),
+                                      static_cast<int>(blockWidth), static_cast<int>(rows)) & bounds;
+            for (int y = block.top(); y <= block.bottom(); ++y) {
+                const uint32_t* source = raster.constData() + (rows - 1 - (y - blockY)) * blockWidth;
+                uchar* destination = result.scanLine(y - bounds.top());
+                for (int x = block.left(); x <= block.right(); ++x) {
+                    const uint32_t pixel = source[x - blockX];
+                    uchar* out = destination + (x - bounds.left()) * 4;
+                    out[0] = static_cast<uchar>(TIFFGetR(pixel));
+                    out[1] = static_cast<uchar>(TIFFGetG(pixel));
+                    out[2] = static_cast<uchar>(TIFFGetB(pixel));
+                    out[3] = static_cast<uchar>(TIFFGetA(pixel));
+                }
+            }
+        }
+    }
+    TIFFClose(tif);
+
+    if (!ok) {
+        errorMessage = "Failed to decode TIFF block";
+        return false;
+    }
+    image = result;
+    return true;
+#else
+    errorMessage = "TIFF support not compiled. Install libtiff and rebuild with HAVE_LIBTIFF defined.";
+    Q_UNUSED(filePath);
+    Q_UNUSED(region);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool TiffHandler::compressionFromName(const QString& name, Compression& compression)
+{
+    const QString key = name.trimmed().toLower();
+    if (key == "none") {
+        compression = Compression::None;
+    } else if (key == "lzw") {
+        compression = Compression::LZW;
+    } else if (key == "deflate" || key == "zip") {
+        compression = Compression::Deflate;
+    } else if (key == "zstd") {
+        compression = Compression::ZSTD;
+    } else {
+        return false;
+    }
+    return true;
+}
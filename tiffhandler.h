@@ -0,0 +1,101 @@
+#ifndef TIFFHANDLER_H
+#define TIFFHANDLER_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "framestream.h"
+
+/**
+ * @brief Handler for TIFF output and tiled TIFF reading using libtiff
+ *
+ * Writes TIFF with a chosen compression, predictor and strip or tile
+ * layout, and multi-page TIFF one page at a time. Single regions of large
+ * tiled (or stripped) TIFFs can be read without decoding the rest of the
+ * image. It requires libtiff to be installed on the system; without it
+ * TIFF goes through Qt's image plugin.
+ */
+class TiffHandler
+{
+public:
+    enum class Compression {
+        None,
+        LZW,
+        Deflate,
+        ZSTD     // Only if libtiff was built with zstd
+    };
+
+    // Layout and compression of written images
+    struct Settings {
+        Compression compression = Compression::LZW;
+        bool predictor = true;  // Horizontal differencing before compression (smaller for photos and scans)
+        int tileSize = 0;       // > 0: square tiles of this size (see isValidTileSize()); 0 writes strips
+    };
+
+    // Largest tile edge accepted; bigger tiles only cost readers memory
+    static const int MAX_TILE_SIZE = 4096;
+
+    TiffHandler();
+    ~TiffHandler();
+
+    /**
+     * @brief Check if libtiff is available
+     * @return true if libtiff is available and can be used
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Check a tile size setting
+     * @return true for 0 (strips) and multiples of 16 up to MAX_TILE_SIZE
+     */
+    static bool isValidTileSize(int size);
+
+    /**
+     * @brief Encode a QImage to TIFF in memory
+     * @param image The QImage to encode (8 or 16 bits per channel)
+     * @param settings Compression, predictor and layout
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, const Settings& settings, QByteArray& output,
+                          QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     */
+    static QVector<QImage::Format> writeFormats();
+
+    /**
+     * @brief Create a multi-page TIFF encoder fed one page at a time
+     *
+     * Each page is compressed as it is added, so only the current page is
+     * held decoded. Frame durations are ignored.
+     *
+     * @param settings Compression, predictor and layout of every page
+     * @param errorMessage Output error message if the encoder cannot be created
+     * @return The writer, or nullptr on failure
+     */
+    static std::unique_ptr<FrameWriter> createPageWriter(const Settings& settings, QString& errorMessage);
+
+    /**
+     * @brief Read one region of the first page of a TIFF file
+     *
+     * Only the tiles (or strips) overlapping the region are read and
+     * decoded, so a single tile of a huge image costs about one tile.
+     *
+     * @param filePath Path to the TIFF file
+     * @param region Region to read, in image pixels (clipped to the image)
+     * @param image Output QImage (RGBA8888_Premultiplied, 8 bits per channel)
+     * @param errorMessage Output error message if reading fails
+     * @return true if successful, false otherwise
+     */
+    static bool readRegion(const QString& filePath, const QRect& region, QImage& image, QString& errorMessage);
+
+    // Parse "none", "lzw", "deflate" (or "zip") or "zstd"
+    static bool compressionFromName(const QString& name, Compression& compression);
+};
+
+#endif // TIFFHANDLER_H
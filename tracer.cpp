@@ -0,0 +1,242 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    qint64 start;
+    qint64 duration;
+    QString detail;
+};
+
+// Ring buffer owned by one recording thread. The mutex is only ever
+// contended by an export or clear, so recording stays uncontended.
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    quint64 written = 0;
+    int tid = 0;
+    QString threadName;
+};
+
+std::atomic<bool> g_enabled{false};
+std::atomic<int> g_nextTid{1};
+
+std::mutex& registryMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Buffers are shared with the registry so spans survive thread exit
+std::vector<std::shared_ptr<ThreadBuffer>>& registry()
+{
+    static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    return buffers;
+}
+
+// Registered buffers whose thread has exited, waiting for a new thread to take them over
+std::vector<std::shared_ptr<ThreadBuffer>>& idleBuffers()
+{
+    static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    return buffers;
+}
+
+// Hands the thread's buffer back for reuse when the thread exits, so
+// short-lived pool threads do not add a ring each
+struct BufferOwner {
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~BufferOwner()
+    {
+        if (buffer) {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            idleBuffers().push_back(buffer);
+        }
+    }
+};
+
+// Name given before the thread's first span, picked up when its buffer is created
+thread_local QString t_threadName;
+thread_local BufferOwner t_owner;
+
+// Taken on the first recorded span, so threads that never trace cost nothing.
+// An exited thread's ring is continued (same track, older spans kept) before a new one is made.
+ThreadBuffer* threadBuffer()
+{
+    if (!t_owner.buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::vector<std::shared_ptr<ThreadBuffer>>& idle = idleBuffers();
+        if (!idle.empty()) {
+            t_owner.buffer = idle.back();
+            idle.pop_back();
+            std::lock_guard<std::mutex> bufferLock(t_owner.buffer->mutex);
+            t_owner.buffer->threadName = t_threadName;
+        } else {
+            auto created = std::make_shared<ThreadBuffer>();
+            created->events.resize(Tracer::RING_CAPACITY);
+            created->tid = g_nextTid.fetch_add(1);
+            created->threadName = t_threadName;
+            registry().push_back(created);
+            t_owner.buffer = created;
+        }
+    }
+    return t_owner.buffer.get();
+}
+
+QJsonObject eventToJson(const TraceEvent& event, qint64 pid, int tid)
+{
+    QJsonObject json;
+    json["name"] = QString::fromLatin1(event.name);
+    json["cat"] = QString::fromLatin1(event.category);
+    json["ph"] = "X";
+    // Trace-event timestamps are in microseconds
+    json["ts"] = event.start / 1000.0;
+    json["dur"] = event.duration / 1000.0;
+    json["pid"] = pid;
+    json["tid"] = tid;
+    if (!event.detail.isEmpty()) {
+        QJsonObject args;
+        args["file"] = event.detail;
+        json["args"] = args;
+    }
+    return json;
+}
+
+} // namespace
+
+void Tracer::setEnabled(bool enabled)
+{
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Tracer::isEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const QString& name)
+{
+    t_threadName = name;
+    if (!t_owner.buffer) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(t_owner.buffer->mutex);
+    t_owner.buffer->threadName = name;
+}
+
+qint64 Tracer::now()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracer::record(const char* name, const char* category,
+                    qint64 startNs, qint64 durationNs, const QString& detail)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    ThreadBuffer* buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    TraceEvent& slot = buffer->events[buffer->written % RING_CAPACITY];
+    slot.name = name;
+    slot.category = category;
+    slot.start = startNs;
+    slot.duration = durationNs;
+    slot.detail = detail;
+    buffer->written++;
+}
+
+bool Tracer::writeChromeTrace(const QString& filePath, QString& errorMessage)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        errorMessage = "Failed to open trace file for writing";
+        return false;
+    }
+
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        buffers = registry();
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    bool first = true;
+    auto writeEvent = [&](const QJsonObject& json) {
+        file.write(first ? "\n" : ",\n");
+        file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        first = false;
+    };
+
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+
+        if (!buffer->threadName.isEmpty()) {
+            QJsonObject args;
+            args["name"] = buffer->threadName;
+            QJsonObject meta;
+            meta["name"] = "thread_name";
+            meta["ph"] = "M";
+            meta["pid"] = pid;
+            meta["tid"] = buffer->tid;
+            meta["args"] = args;
+            writeEvent(meta);
+        }
+
+        // Oldest surviving span first, so each track reads in time order
+        const quint64 count = qMin<quint64>(buffer->written, RING_CAPACITY);
+        for (quint64 i = buffer->written - count; i < buffer->written; ++i) {
+            writeEvent(eventToJson(buffer->events[i % RING_CAPACITY], pid, buffer->tid));
+        }
+    }
+    file.write("\n]}\n");
+
+    if (file.error() != QFileDevice::NoError) {
+        errorMessage = QString("Failed to write trace file: %1").arg(file.errorString());
+        return false;
+    }
+    return true;
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(registryMutex());
+    for (const auto& buffer : registry()) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->written = 0;
+    }
+}
+
+TraceSpan::TraceSpan(const char* name, const char* category, const QString& detail)
+    : m_name(name)
+    , m_category(category)
+    , m_start(Tracer::isEnabled() ? Tracer::now() : -1)
+{
+    if (m_start >= 0) {
+        m_detail = detail;
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (m_start >= 0) {
+        Tracer::record(m_name, m_category, m_start, Tracer::now() - m_start, m_detail);
+    }
+}
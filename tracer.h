@@ -0,0 +1,92 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @brief Low-overhead span recorder with Chrome trace-event JSON export
+ *
+ * Every thread records completed spans into its own fixed-size ring buffer,
+ * so recording never contends with other converting threads. A thread that
+ * exits hands its buffer on to the next thread that starts recording, so
+ * the number of buffers is bounded by the most threads tracing at once and
+ * memory use stays bounded however many batches the process runs. When a
+ * buffer is full, the oldest spans are overwritten. The collected spans can
+ * be exported in the trace-event JSON format understood by Perfetto and
+ * chrome://tracing.
+ *
+ * Tracing is off by default; when disabled a span costs one atomic load.
+ */
+class Tracer
+{
+public:
+    // Number of spans kept per thread before the oldest are overwritten
+    static const int RING_CAPACITY = 16384;
+
+    /**
+     * @brief Enable or disable span recording for all threads
+     */
+    static void setEnabled(bool enabled);
+
+    /**
+     * @brief Check if span recording is enabled
+     */
+    static bool isEnabled();
+
+    /**
+     * @brief Name the calling thread in exported traces
+     * @param name Label shown for the thread's track in the timeline
+     */
+    static void setThreadName(const QString& name);
+
+    /**
+     * @brief Monotonic timestamp in nanoseconds used for span boundaries
+     */
+    static qint64 now();
+
+    /**
+     * @brief Record a completed span in the calling thread's ring buffer
+     * @param name Span name (must point to a string literal)
+     * @param category Span category (must point to a string literal)
+     * @param startNs Start timestamp from now()
+     * @param durationNs Duration in nanoseconds
+     * @param detail Optional detail, exported as the "file" argument
+     */
+    static void record(const char* name, const char* category,
+                       qint64 startNs, qint64 durationNs, const QString& detail);
+
+    /**
+     * @brief Write all recorded spans as trace-event JSON
+     * @param filePath Path to the output .json file
+     * @param errorMessage Output error message if writing fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeChromeTrace(const QString& filePath, QString& errorMessage);
+
+    /**
+     * @brief Discard all recorded spans
+     */
+    static void clear();
+};
+
+/**
+ * @brief RAII helper recording the lifetime of a scope as a trace span
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, const char* category = "convert",
+                       const QString& detail = QString());
+    ~TraceSpan();
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char* m_name;
+    const char* m_category;
+    QString m_detail;
+    qint64 m_start;
+};
+
+#endif // TRACER_H
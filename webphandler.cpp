@@ -0,0 +1,307 @@
+#include "webphandler.h"
+#include "bufferpool.h"
+#include "tracer.h"
+
+
+#ifdef HAVE_LIBWEBP
+#include <webp/decode.h>
+#include <webp/encode.h>
+#include <webp/mux.h>
+
+namespace {
+
+// WebPWriterFunction appending the encoded stream to a QByteArray
+int appendToByteArray(const uint8_t* data, size_t size, const WebPPicture* picture)
+{
+    static_cast<QByteArray*>(picture->custom_ptr)->append(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    return 1;
+}
+
+bool initConfig(WebPConfig& config, int quality, const WebpHandler::Settings& settings)
+{
+    if (!WebPConfigInit(&config)) {
+        return false;
+    }
+    config.quality = static_cast<float>(qBound(0, quality < 0 ? 90 : quality, 100));
+    config.method = qBound(0, settings.method, 6);
+    config.alpha_quality = qBound(0, settings.alphaQuality, 100);
+    // Lets the encoder run analysis, filtering and alpha coding on extra threads
+    config.thread_level = 1;
+    if (settings.lossless || settings.nearLossless < 100) {
+        config.lossless = 1;
+        config.near_lossless = qBound(0, settings.nearLossless, 100);
+    }
+    return WebPValidateConfig(&config) != 0;
+}
+
+// Import a QImage into a picture, reading the common decoded layouts in place.
+// Without useArgb the import converts to the YUV that lossy still images encode.
+bool importImage(const QImage& image, bool useArgb, WebPPicture& picture)
+{
+    picture.width = image.width();
+    picture.height = image.height();
+    picture.use_argb = useArgb ? 1 : 0;
+
+    const int stride = image.bytesPerLine();
+    switch (image.format()) {
+        case QImage::Format_RGBA8888:
+            return WebPPictureImportRGBA(&picture, image.constBits(), stride) != 0;
+        case QImage::Format_RGBX8888:
+            return WebPPictureImportRGBX(&picture, image.constBits(), stride) != 0;
+        case QImage::Format_RGB888:
+            return WebPPictureImportRGB(&picture, image.constBits(), stride) != 0;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        // 0xAARRGGBB words are B, G, R, A in memory
+        case QImage::Format_ARGB32:
+            return WebPPictureImportBGRA(&picture, image.constBits(), stride) != 0;
+        case QImage::Format_RGB32:
+            return WebPPictureImportBGRX(&picture, image.constBits(), stride) != 0;
+#endif
+        default:
+            break;
+    }
+
+    const QImage converted = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_RGBA8888
+                                                                           : QImage::Format_RGBX8888);
+    return importImage(converted, useArgb, picture);
+}
+
+class WebpAnimationWriter : public FrameWriter
+{
+public:
+    WebpAnimationWriter(const WebPConfig& config, int loopCount)
+        : m_config(config), m_loopCount(loopCount) {}
+    ~WebpAnimationWriter() override
+    {
+        if (m_encoder) {
+            WebPAnimEncoderDelete(m_encoder);
+        }
+    }
+
+    bool addFrame(const Frame& frame, QString& errorMessage) override
+    {
+        TraceSpan span("WebpHandler::writeFrame", "codec");
+
+        // The canvas size comes from the first frame
+        if (!m_encoder) {
+            WebPAnimEncoderOptions options;
+            if (!WebPAnimEncoderOptionsInit(&options)) {
+                errorMessage = "Failed to initialize WebP animation options";
+                return false;
+            }
+            // WebP counts plays rather than repeats; 0 loops forever
+            options.anim_params.loop_count = m_loopCount < 0 ? 0 : m_loopCount + 1;
+            m_encoder = WebPAnimEncoderNew(frame.image.width(), frame.image.height(), &options);
+            if (!m_encoder) {
+                errorMessage = "Failed to create WebP animation encoder";
+                return false;
+            }
+            m_size = frame.image.size();
+        } else if (frame.image.size() != m_size) {
+            errorMessage = "Animation frames differ in size";
+            return false;
+        }
+
+        // Always ARGB: the animation encoder works on ARGB frames and would otherwise
+        // convert a YUV import back, losing chroma twice
+        WebPPicture picture;
+        if (!WebPPictureInit(&picture) || !importImage(frame.image, true, picture)) {
+            WebPPictureFree(&picture);
+            errorMessage = "Failed to import WebP frame";
+            return false;
+        }
+
+        // The encoder compresses the frame now and keeps only the result
+        const bool added = WebPAnimEncoderAdd(m_encoder, &picture, m_timestampMs, &m_config) != 0;
+        WebPPictureFree(&picture);
+        if (!added) {
+            errorMessage = QString("Failed to encode WebP frame: %1").arg(WebPAnimEncoderGetError(m_encoder));
+            return false;
+        }
+        m_timestampMs += frame.durationMs > 0 ? frame.durationMs : DEFAULT_FRAME_MS;
+        return true;
+    }
+
+    bool finish(QByteArray& output, QString& errorMessage) override
+    {
+        if (!m_encoder) {
+            errorMessage = "Animation has no frames";
+            return false;
+        }
+
+        // A null frame marks the end time of the last one
+        WebPData encoded;
+        WebPDataInit(&encoded);
+        if (!WebPAnimEncoderAdd(m_encoder, nullptr, m_timestampMs, nullptr) ||
+            !WebPAnimEncoderAssemble(m_encoder, &encoded)) {
+            errorMessage = QString("Failed to finish WebP animation: %1").arg(WebPAnimEncoderGetError(m_encoder));
+            WebPDataClear(&encoded);
+            return false;
+        }
+        output = QByteArray(reinterpret_cast<const char*>(encoded.bytes), static_cast<int>(encoded.size));
+        WebPDataClear(&encoded);
+        return true;
+    }
+
+private:
+    WebPConfig m_config;
+    int m_loopCount;
+    WebPAnimEncoder* m_encoder = nullptr;
+    QSize m_size;
+    int m_timestampMs = 0;
+};
+
+} // namespace
+#endif
+
+WebpHandler::WebpHandler()
+{
+}
+
+WebpHandler::~WebpHandler()
+{
+}
+
+bool WebpHandler::isAvailable()
+{
+#ifdef HAVE_LIBWEBP
+    return true;
+#else
+    return false;
+#endif
+}
+
+QVector<QImage::Format> WebpHandler::writeFormats()
+{
+    return {QImage::Format_RGBA8888, QImage::Format_RGBX8888, QImage::Format_RGB888,
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            QImage::Format_ARGB32, QImage::Format_RGB32,
+#endif
+    };
+}
+
+bool WebpHandler::readData(const QByteArray& data, QImage& image, QString& errorMessage)
+{
+    TraceSpan span("WebpHandler::read", "codec");
+
+#ifdef HAVE_LIBWEBP
+    WebPDecoderConfig config;
+    if (!WebPInitDecoderConfig(&config)) {
+        errorMessage = "Failed to initialize WebP decoder";
+        return false;
+    }
+
+    const uint8_t* webpData = reinterpret_cast<const uint8_t*>(data.constData());
+    const size_t webpSize = static_cast<size_t>(data.size());
+    if (WebPGetFeatures(webpData, webpSize, &config.input) != VP8_STATUS_OK) {
+        errorMessage = "Failed to read WebP header";
+        return false;
+    }
+    if (config.input.has_animation) {
+        errorMessage = "Animated WebP must be read frame by frame";
+        return false;
+    }
+
+    QImage decoded = BufferPool::createImage(config.input.width, config.input.height,
+                                             config.input.has_alpha ? QImage::Format_RGBA8888
+                                                                    : QImage::Format_RGBX8888);
+    if (decoded.isNull()) {
+        errorMessage = "Failed to allocate image";
+        return false;
+    }
+
+    // Decode straight into the QImage
+    config.options.use_threads = 1;
+    config.output.colorspace = MODE_RGBA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = decoded.bits();
+    config.output.u.RGBA.stride = decoded.bytesPerLine();
+    config.output.u.RGBA.size = static_cast<size_t>(decoded.bytesPerLine()) * decoded.height();
+
+    const VP8StatusCode status = WebPDecode(webpData, webpSize, &config);
+    WebPFreeDecBuffer(&config.output);
+    if (status != VP8_STATUS_OK) {
+        errorMessage = QString("Failed to decode WebP (status %1)").arg(status);
+        return false;
+    }
+
+    image = decoded;
+    return true;
+#else
+    errorMessage = "WebP support not compiled. Install libwebp and rebuild with HAVE_LIBWEBP defined.";
+    Q_UNUSED(data);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool WebpHandler::writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage)
+{
+    return writeData(image, quality, Settings(), output, errorMessage);
+}
+
+bool WebpHandler::writeData(const QImage& image, int quality, const Settings& settings,
+                            QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("WebpHandler::write", "codec");
+
+#ifdef HAVE_LIBWEBP
+    if (image.isNull()) {
+        errorMessage = "Source image is null";
+        return false;
+    }
+
+    WebPConfig config;
+    if (!initConfig(config, quality, settings)) {
+        errorMessage = "Invalid WebP encoder settings";
+        return false;
+    }
+
+    WebPPicture picture;
+    if (!WebPPictureInit(&picture) || !importImage(image, config.lossless != 0, picture)) {
+        WebPPictureFree(&picture);
+        errorMessage = "Failed to import image into WebP picture";
+        return false;
+    }
+
+    output.clear();
+    picture.writer = appendToByteArray;
+    picture.custom_ptr = &output;
+
+    const bool ok = WebPEncode(&config, &picture) != 0;
+    const WebPEncodingError error = picture.error_code;
+    WebPPictureFree(&picture);
+    if (!ok) {
+        errorMessage = QString("Failed to encode WebP (error %1)").arg(error);
+        output.clear();
+        return false;
+    }
+    return true;
+#else
+    errorMessage = "WebP support not compiled. Install libwebp and rebuild with HAVE_LIBWEBP defined.";
+    Q_UNUSED(image);
+    Q_UNUSED(quality);
+    Q_UNUSED(settings);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
+
+std::unique_ptr<FrameWriter> WebpHandler::createAnimationWriter(int quality, const Settings& settings, int loopCount,
+                                                                QString& errorMessage)
+{
+#ifdef HAVE_LIBWEBP
+    WebPConfig config;
+    if (!initConfig(config, quality, settings)) {
+        errorMessage = "Invalid WebP encoder settings";
+        return nullptr;
+    }
+    return std::unique_ptr<FrameWriter>(new WebpAnimationWriter(config, loopCount));
+#else
+    errorMessage = "WebP support not compiled. Install libwebp and rebuild with HAVE_LIBWEBP defined.";
+    Q_UNUSED(quality);
+    Q_UNUSED(settings);
+    Q_UNUSED(loopCount);
+    return nullptr;
+#endif
+}
@@ -0,0 +1,89 @@
+#ifndef WEBPHANDLER_H
+#define WEBPHANDLER_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "framestream.h"
+
+/**
+ * @brief Handler for WebP using libwebp
+ *
+ * Encodes with libwebp's multithreaded encoder, importing the pixels
+ * straight from the QImage's buffer, and exposes the speed preset,
+ * lossless and near-lossless modes and the alpha quality. Animated WebP
+ * is written through libwebpmux's WebPAnimEncoder. It requires libwebp
+ * and libwebpmux to be installed on the system; without them WebP goes
+ * through Qt's image plugin, if one is installed.
+ */
+class WebpHandler
+{
+public:
+    // Encoder trade-offs beyond quality
+    struct Settings {
+        int method = 4;            // Speed preset: 0 fastest, 6 smallest
+        bool lossless = false;     // Lossless; quality then sets the compression effort
+        int nearLossless = 100;    // Lossless with this much preprocessing (0-100, 100 is off)
+        int alphaQuality = 100;    // Lossy alpha plane quality (0-100)
+    };
+
+    WebpHandler();
+    ~WebpHandler();
+
+    /**
+     * @brief Check if libwebp is available
+     * @return true if libwebp is available and can be used
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Decode a still WebP image held in memory
+     * @param data Encoded file contents
+     * @param image Output QImage (RGBA8888, or RGBX8888 without alpha)
+     * @param errorMessage Output error message if decoding fails
+     * @return true if successful, false otherwise (including animations,
+     *         which callers read frame by frame)
+     */
+    static bool readData(const QByteArray& data, QImage& image, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to WebP in memory
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 90)
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Encode a QImage to WebP in memory with explicit encoder settings
+     * @param image The QImage to encode
+     * @param quality Quality setting (0-100, default 90)
+     * @param settings Speed preset, lossless modes and alpha quality
+     * @param output Output buffer receiving the encoded file contents
+     * @param errorMessage Output error message if encoding fails
+     * @return true if successful, false otherwise
+     */
+    static bool writeData(const QImage& image, int quality, const Settings& settings,
+                          QByteArray& output, QString& errorMessage);
+
+    /**
+     * @brief Pixel formats the encoder reads without converting, preferred first
+     */
+    static QVector<QImage::Format> writeFormats();
+
+    /**
+     * @brief Create an animated WebP encoder fed one frame at a time
+     * @param quality Quality setting (0-100, default 90)
+     * @param settings Speed preset, lossless modes and alpha quality
+     * @param loopCount Animation repeats (-1 forever)
+     * @param errorMessage Output error message if the encoder cannot be created
+     * @return The writer, or nullptr on failure
+     */
+    static std::unique_ptr<FrameWriter> createAnimationWriter(int quality, const Settings& settings, int loopCount,
+                                                              QString& errorMessage);
+};
+
+#endif // WEBPHANDLER_H
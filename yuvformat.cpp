@@ -0,0 +1,108 @@
+#include "yuvformat.h"
+#include "tracer.h"
+
+#include <QSet>
+
+#include <cstdlib>
+
+namespace {
+
+// Rows sampled for the content analysis
+const int SAMPLE_ROWS = 64;
+
+// Distinct colors on the sampled rows at or below which content is graphics
+const int GRAPHICS_MAX_COLORS = 512;
+
+// Chroma step between neighbours that 4:2:0 would visibly smear
+const int SHARP_CHROMA_STEP = 48;
+
+// Share of sharp chroma steps above which content is graphics
+const double GRAPHICS_SHARP_RATIO = 0.01;
+
+} // namespace
+
+YuvFormat YuvFormat::resolved(const QImage& image) const
+{
+    YuvFormat result = *this;
+    if (result.chroma == ChromaSubsampling::Auto) {
+        result.chroma = chooseChroma(image);
+    }
+    if (result.bitDepth <= 0) {
+        bool wide = image.depth() > 32 || image.format() == QImage::Format_Grayscale16;
+        result.bitDepth = wide ? 10 : 8;
+    }
+    return result;
+}
+
+ChromaSubsampling YuvFormat::chooseChroma(const QImage& image)
+{
+    if (image.isNull()) {
+        return ChromaSubsampling::YUV420;
+    }
+
+    TraceSpan span("YuvFormat::chooseChroma", "convert");
+
+    QSet<QRgb> colors;
+    bool manyColors = false;
+    qint64 pairs = 0;
+    qint64 sharpSteps = 0;
+
+    const int rows = qMin(SAMPLE_ROWS, image.height());
+    for (int i = 0; i < rows; ++i) {
+        // Whole rows keep neighbouring pixels adjacent
+        const int y = static_cast<int>(static_cast<qint64>(image.height()) * (2 * i + 1) / (2 * rows));
+        const QImage line = image.copy(0, y, image.width(), 1).convertToFormat(QImage::Format_RGB32);
+        const QRgb* pixels = reinterpret_cast<const QRgb*>(line.constScanLine(0));
+
+        int previousCb = 0;
+        int previousCr = 0;
+        for (int x = 0; x < line.width(); ++x) {
+            const int r = qRed(pixels[x]);
+            const int g = qGreen(pixels[x]);
+            const int b = qBlue(pixels[x]);
+            // BT.601 chroma, scaled by 256
+            const int cb = (-43 * r - 85 * g + 128 * b) >> 8;
+            const int cr = (128 * r - 107 * g - 21 * b) >> 8;
+
+            if (x > 0) {
+                ++pairs;
+                if (std::abs(cb - previousCb) + std::abs(cr - previousCr) >= SHARP_CHROMA_STEP) {
+                    ++sharpSteps;
+                }
+            }
+            previousCb = cb;
+            previousCr = cr;
+
+            if (!manyColors) {
+                colors.insert(pixels[x]);
+                manyColors = colors.size() > GRAPHICS_MAX_COLORS;
+            }
+        }
+    }
+
+    if (!manyColors || sharpSteps > pairs * GRAPHICS_SHARP_RATIO) {
+        return ChromaSubsampling::YUV444;
+    }
+    return ChromaSubsampling::YUV420;
+}
+
+bool YuvFormat::chromaFromName(const QString& name, ChromaSubsampling& chroma)
+{
+    QString key = name.trimmed().toLower();
+    key.remove(':');
+    if (key.startsWith("yuv")) {
+        key.remove(0, 3);
+    }
+
+    if (key == "auto") chroma = ChromaSubsampling::Auto;
+    else if (key == "420") chroma = ChromaSubsampling::YUV420;
+    else if (key == "422") chroma = ChromaSubsampling::YUV422;
+    else if (key == "444") chroma = ChromaSubsampling::YUV444;
+    else return false;
+    return true;
+}
+
+bool YuvFormat::isValidBitDepth(int bitDepth)
+{
+    return bitDepth == 0 || bitDepth == 8 || bitDepth == 10;
+}
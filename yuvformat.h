@@ -0,0 +1,39 @@
+#ifndef YUVFORMAT_H
+#define YUVFORMAT_H
+
+#include <QImage>
+#include <QString>
+
+enum class ChromaSubsampling {
+    Auto,    // Chosen per image by YuvFormat::chooseChroma
+    YUV420,
+    YUV422,
+    YUV444
+};
+
+/**
+ * @brief YUV layout requested for AVIF and HEIC output
+ */
+struct YuvFormat {
+    ChromaSubsampling chroma = ChromaSubsampling::Auto;
+    int bitDepth = 0;   // 8 or 10; 0 picks 10 only for sources above 8 bits per channel
+
+    // Copy with Auto values resolved for an image
+    YuvFormat resolved(const QImage& image) const;
+
+    /**
+     * @brief Pick chroma subsampling from image content
+     *
+     * Graphics (few distinct colors, or many sharp color edges) get 4:4:4
+     * so edges stay crisp; photographic content gets 4:2:0.
+     */
+    static ChromaSubsampling chooseChroma(const QImage& image);
+
+    // Parse "auto", "420", "422" or "444" (a "yuv" prefix and ':' are accepted)
+    static bool chromaFromName(const QString& name, ChromaSubsampling& chroma);
+
+    // Check a requested bit depth: 0 (follow the source), 8 or 10
+    static bool isValidBitDepth(int bitDepth);
+};
+
+#endif // YUVFORMAT_H
@@ -0,0 +1,289 @@
+#include "yuvtranscoder.h"
+#include "avifhandler.h"
+#include "tracer.h"
+
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+#include <memory>
+
+#if defined(HAVE_LIBHEIF) && defined(HAVE_LIBAVIF)
+#include <libheif/heif.h>
+#include <avif/avif.h>
+
+namespace {
+
+struct HeifDeleter {
+    void operator()(heif_context* ctx) const { heif_context_free(ctx); }
+    void operator()(heif_image_handle* handle) const { heif_image_handle_release(handle); }
+    void operator()(heif_image* image) const { heif_image_release(image); }
+    void operator()(heif_color_profile_nclx* nclx) const { heif_nclx_color_profile_free(nclx); }
+};
+
+struct AvifDeleter {
+    void operator()(avifImage* image) const { avifImageDestroy(image); }
+};
+
+bool allocatePlanes(avifImage* image, avifPlanesFlags planes)
+{
+#if AVIF_VERSION_MAJOR >= 1
+    return avifImageAllocatePlanes(image, planes) == AVIF_RESULT_OK;
+#else
+    avifImageAllocatePlanes(image, planes);
+    return true;
+#endif
+}
+
+// Copy one plane row by row; both libraries store samples above 8 bits as uint16
+bool copyPlane(const heif_image* source, heif_channel channel, int bytesPerSample,
+               uint8_t* destination, uint32_t destinationRowBytes, uint32_t rows)
+{
+    int stride = 0;
+    const uint8_t* plane = heif_image_get_plane_readonly(source, channel, &stride);
+    if (!plane) {
+        return false;
+    }
+    const size_t rowBytes = static_cast<size_t>(heif_image_get_width(source, channel)) * bytesPerSample;
+    if (rowBytes > destinationRowBytes || static_cast<uint32_t>(heif_image_get_height(source, channel)) < rows) {
+        return false;
+    }
+    for (uint32_t y = 0; y < rows; ++y) {
+        memcpy(destination + y * destinationRowBytes, plane + static_cast<size_t>(y) * stride, rowBytes);
+    }
+    return true;
+}
+
+// Copy the EXIF and XMP blocks attached to the HEIF image into the AVIF image
+bool copyMetadata(heif_image_handle* handle, avifImage* avif, QString& errorMessage)
+{
+    QVector<heif_item_id> ids(heif_image_handle_get_number_of_metadata_blocks(handle, nullptr));
+    heif_image_handle_get_list_of_metadata_block_IDs(handle, nullptr, ids.data(), ids.size());
+
+    for (heif_item_id id : ids) {
+        const QByteArray type = heif_image_handle_get_metadata_type(handle, id);
+        const bool exif = type == "Exif";
+        const bool xmp = type == "mime" &&
+                         QByteArray(heif_image_handle_get_metadata_content_type(handle, id)) == "application/rdf+xml";
+        if (!exif && !xmp) {
+            continue;
+        }
+
+        QByteArray block(static_cast<int>(heif_image_handle_get_metadata_size(handle, id)), Qt::Uninitialized);
+        if (heif_image_handle_get_metadata(handle, id, block.data()).code != heif_error_Ok) {
+            errorMessage = "Failed to read HEIF metadata";
+            return false;
+        }
+        if (exif) {
+            // HEIF puts the offset to the TIFF header ahead of the EXIF data; libavif wants the TIFF data
+            if (block.size() < 4) {
+                continue;
+            }
+            const quint32 offset = qFromBigEndian<quint32>(block.constData());
+            if (offset > static_cast<quint32>(block.size() - 4)) {
+                continue;
+            }
+            block.remove(0, 4 + static_cast<int>(offset));
+        }
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(block.constData());
+#if AVIF_VERSION_MAJOR >= 1
+        const avifResult result = exif ? avifImageSetMetadataExif(avif, bytes, block.size()) :
+                                         avifImageSetMetadataXMP(avif, bytes, block.size());
+        if (result != AVIF_RESULT_OK) {
+            errorMessage = exif ? "Failed to attach EXIF metadata" : "Failed to attach XMP metadata";
+            return false;
+        }
+#else
+        if (exif) {
+            avifImageSetMetadataExif(avif, bytes, block.size());
+        } else {
+            avifImageSetMetadataXMP(avif, bytes, block.size());
+        }
+#endif
+    }
+    return true;
+}
+
+} // namespace
+#endif
+
+bool YuvTranscoder::isAvailable()
+{
+#if defined(HAVE_LIBHEIF) && defined(HAVE_LIBAVIF)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool YuvTranscoder::heifToAvif(const QByteArray& input, int quality, const YuvFormat& yuv,
+                               QByteArray& output, QString& errorMessage)
+{
+    TraceSpan span("YuvTranscoder::heifToAvif", "codec");
+
+#if defined(HAVE_LIBHEIF) && defined(HAVE_LIBAVIF)
+    std::unique_ptr<heif_context, HeifDeleter> ctx(heif_context_alloc());
+    if (!ctx) {
+        errorMessage = "Failed to allocate HEIF context";
+        return false;
+    }
+
+    heif_error error = heif_context_read_from_memory_without_copy(ctx.get(), input.constData(), input.size(), nullptr);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to read HEIF file: %1").arg(error.message);
+        return false;
+    }
+
+    heif_image_handle* rawHandle = nullptr;
+    error = heif_context_get_primary_image_handle(ctx.get(), &rawHandle);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to get image handle: %1").arg(error.message);
+        return false;
+    }
+    std::unique_ptr<heif_image_handle, HeifDeleter> handle(rawHandle);
+
+    // Undefined colorspace and chroma keep the planes exactly as coded
+    heif_image* rawImage = nullptr;
+    error = heif_decode_image(handle.get(), &rawImage, heif_colorspace_undefined, heif_chroma_undefined, nullptr);
+    if (error.code != heif_error_Ok) {
+        errorMessage = QString("Failed to decode image: %1").arg(error.message);
+        return false;
+    }
+    std::unique_ptr<heif_image, HeifDeleter> heifImage(rawImage);
+
+    avifPixelFormat pixelFormat;
+    const heif_colorspace colorspace = heif_image_get_colorspace(heifImage.get());
+    switch (heif_image_get_chroma_format(heifImage.get())) {
+        case heif_chroma_420: pixelFormat = AVIF_PIXEL_FORMAT_YUV420; break;
+        case heif_chroma_422: pixelFormat = AVIF_PIXEL_FORMAT_YUV422; break;
+        case heif_chroma_444: pixelFormat = AVIF_PIXEL_FORMAT_YUV444; break;
+        case heif_chroma_monochrome: pixelFormat = AVIF_PIXEL_FORMAT_YUV400; break;
+        default:
+            errorMessage = "Unsupported HEIF chroma layout for direct transcoding";
+            return false;
+    }
+    if (colorspace != heif_colorspace_YCbCr && colorspace != heif_colorspace_monochrome) {
+        errorMessage = "Unsupported HEIF colorspace for direct transcoding";
+        return false;
+    }
+
+    const int depth = heif_image_get_bits_per_pixel_range(heifImage.get(), heif_channel_Y);
+    if (depth != 8 && depth != 10 && depth != 12) {
+        errorMessage = QString("Unsupported HEIF bit depth for direct transcoding: %1").arg(depth);
+        return false;
+    }
+    const int bytesPerSample = depth > 8 ? 2 : 1;
+
+    // Changing the layout needs resampling, which the RGB path already does
+    // (monochrome sources only qualify for Auto)
+    const ChromaSubsampling sourceChroma =
+        pixelFormat == AVIF_PIXEL_FORMAT_YUV420 ? ChromaSubsampling::YUV420 :
+        pixelFormat == AVIF_PIXEL_FORMAT_YUV422 ? ChromaSubsampling::YUV422 :
+        pixelFormat == AVIF_PIXEL_FORMAT_YUV444 ? ChromaSubsampling::YUV444 : ChromaSubsampling::Auto;
+    if ((yuv.chroma != ChromaSubsampling::Auto && yuv.chroma != sourceChroma) ||
+        (yuv.bitDepth > 0 && yuv.bitDepth != depth)) {
+        errorMessage = "Requested YUV layout differs from the source";
+        return false;
+    }
+
+    const int width = heif_image_get_width(heifImage.get(), heif_channel_Y);
+    const int height = heif_image_get_height(heifImage.get(), heif_channel_Y);
+
+    std::unique_ptr<avifImage, AvifDeleter> avif(avifImageCreate(width, height, depth, pixelFormat));
+    if (!avif) {
+        errorMessage = "Failed to create AVIF image";
+        return false;
+    }
+
+    // Carry over the color description so the YUV values mean the same thing: the
+    // 'colr' box if there is one, else what the decoder read from the coded stream
+    heif_color_profile_nclx* rawNclx = nullptr;
+    if (heif_image_handle_get_nclx_color_profile(handle.get(), &rawNclx).code != heif_error_Ok) {
+        rawNclx = nullptr;
+    }
+    if (!rawNclx && heif_image_get_nclx_color_profile(heifImage.get(), &rawNclx).code != heif_error_Ok) {
+        rawNclx = nullptr;
+    }
+    std::unique_ptr<heif_color_profile_nclx, HeifDeleter> nclx(rawNclx);
+    if (!nclx || nclx->matrix_coefficients == heif_matrix_coefficients_unspecified) {
+        // Guessing the matrix or range would shift colors; the RGB path converts as libheif does
+        errorMessage = "Unknown HEIF color description for direct transcoding";
+        return false;
+    }
+    avif->colorPrimaries = static_cast<avifColorPrimaries>(nclx->color_primaries);
+    avif->transferCharacteristics = static_cast<avifTransferCharacteristics>(nclx->transfer_characteristics);
+    avif->matrixCoefficients = static_cast<avifMatrixCoefficients>(nclx->matrix_coefficients);
+    avif->yuvRange = nclx->full_range_flag ? AVIF_RANGE_FULL : AVIF_RANGE_LIMITED;
+    nclx.reset();
+
+    const heif_color_profile_type profileType = heif_image_handle_get_color_profile_type(handle.get());
+    if (profileType == heif_color_profile_type_prof || profileType == heif_color_profile_type_rICC) {
+        QByteArray icc(static_cast<int>(heif_image_handle_get_raw_color_profile_size(handle.get())), Qt::Uninitialized);
+        if (heif_image_handle_get_raw_color_profile(handle.get(), icc.data()).code == heif_error_Ok) {
+#if AVIF_VERSION_MAJOR >= 1
+            if (avifImageSetProfileICC(avif.get(), reinterpret_cast<const uint8_t*>(icc.constData()),
+                                       icc.size()) != AVIF_RESULT_OK) {
+                errorMessage = "Failed to attach ICC profile";
+                return false;
+            }
+#else
+            avifImageSetProfileICC(avif.get(), reinterpret_cast<const uint8_t*>(icc.constData()), icc.size());
+#endif
+        }
+    }
+
+    if (!copyMetadata(handle.get(), avif.get(), errorMessage)) {
+        return false;
+    }
+
+    if (!allocatePlanes(avif.get(), AVIF_PLANES_YUV)) {
+        errorMessage = "Failed to allocate AVIF planes";
+        return false;
+    }
+
+    // Chroma planes have the subsampled height of the layout
+    const uint32_t chromaRows = pixelFormat == AVIF_PIXEL_FORMAT_YUV420 ? (height + 1) / 2 : height;
+    bool copied = copyPlane(heifImage.get(), heif_channel_Y, bytesPerSample,
+                            avif->yuvPlanes[AVIF_CHAN_Y], avif->yuvRowBytes[AVIF_CHAN_Y], height);
+    if (copied && pixelFormat != AVIF_PIXEL_FORMAT_YUV400) {
+        copied = copyPlane(heifImage.get(), heif_channel_Cb, bytesPerSample,
+                           avif->yuvPlanes[AVIF_CHAN_U], avif->yuvRowBytes[AVIF_CHAN_U], chromaRows) &&
+                 copyPlane(heifImage.get(), heif_channel_Cr, bytesPerSample,
+                           avif->yuvPlanes[AVIF_CHAN_V], avif->yuvRowBytes[AVIF_CHAN_V], chromaRows);
+    }
+
+    if (copied && heif_image_has_channel(heifImage.get(), heif_channel_Alpha)) {
+        if (heif_image_get_bits_per_pixel_range(heifImage.get(), heif_channel_Alpha) != depth) {
+            errorMessage = "Alpha bit depth differs from the color planes";
+            return false;
+        }
+        if (!allocatePlanes(avif.get(), AVIF_PLANES_A)) {
+            errorMessage = "Failed to allocate AVIF alpha plane";
+            return false;
+        }
+        avif->alphaPremultiplied = heif_image_handle_is_premultiplied_alpha(handle.get()) ? AVIF_TRUE : AVIF_FALSE;
+        copied = copyPlane(heifImage.get(), heif_channel_Alpha, bytesPerSample,
+                           avif->alphaPlane, avif->alphaRowBytes, height);
+    }
+
+    if (!copied) {
+        errorMessage = "Unexpected HEIF plane layout for direct transcoding";
+        return false;
+    }
+
+    // The HEIF buffers are no longer needed while the (slow) encoder runs
+    heifImage.reset();
+    handle.reset();
+    ctx.reset();
+
+    return AvifHandler::writeYuv(avif.get(), quality, output, errorMessage);
+#else
+    errorMessage = "Direct HEIC to AVIF transcoding needs both libheif and libavif.";
+    Q_UNUSED(input);
+    Q_UNUSED(quality);
+    Q_UNUSED(yuv);
+    Q_UNUSED(output);
+    return false;
+#endif
+}
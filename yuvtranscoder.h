@@ -0,0 +1,42 @@
+#ifndef YUVTRANSCODER_H
+#define YUVTRANSCODER_H
+
+#include <QByteArray>
+#include <QString>
+#include "yuvformat.h"
+
+/**
+ * @brief Direct HEIC to AVIF transcoding without an RGB round trip
+ *
+ * The decoded YCbCr planes from libheif are copied into a libavif image
+ * with the same chroma subsampling and bit depth, along with the alpha
+ * plane, the color description (NCLX or ICC) and the EXIF and XMP
+ * metadata. The pixels are never converted to RGB. Files whose color
+ * description is unknown are left to the RGB path. This needs both
+ * libheif and libavif.
+ */
+class YuvTranscoder
+{
+public:
+    /**
+     * @brief Check if the direct path is available
+     * @return true if both libheif and libavif were found at build time
+     */
+    static bool isAvailable();
+
+    /**
+     * @brief Transcode a HEIC/HEIF image held in memory to AVIF
+     * @param input Encoded HEIC/HEIF file contents
+     * @param quality AVIF quality setting (0-100, default 80)
+     * @param yuv Requested layout; Auto values keep the source's
+     * @param output Output buffer receiving the AVIF file contents
+     * @param errorMessage Output error message if transcoding fails
+     * @return true if successful, false otherwise (including layouts the
+     *         direct path does not handle or that differ from the requested
+     *         one; callers then decode to RGB)
+     */
+    static bool heifToAvif(const QByteArray& input, int quality, const YuvFormat& yuv,
+                           QByteArray& output, QString& errorMessage);
+};
+
+#endif // YUVTRANSCODER_H